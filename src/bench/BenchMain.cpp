@@ -0,0 +1,349 @@
+/**
+ * Microbenchmarks of the client's hot paths: AES and AEAD messages, RSA key exchange, the Encoder codecs,
+ * parsing the users list and the pending messages. Every benchmark is a name, the time of one operation and
+ * for most of them the bytes it processes.
+ *
+ * bench [--filter <text>] [--out <results.json>] [--baseline <results.json>] [--threshold <percent>] [--min-time <ms>]
+ *
+ * --out writes the results as JSON, --baseline compares them with a file written by --out earlier and
+ * exits with 1 if a benchmark got slower by more than the threshold (10% by default).
+ */
+#include "Benchmark.h"
+#include "AESWrapper.h"
+#include "AEADMessage.h"
+#include "RSAWrapper.h"
+#include "Encoder.h"
+#include "ClientRoster.h"
+#include "Communication.h"
+#include "PendingMessageParser.h"
+#include "PendingMessageView.h"
+#include "WireCodec.h"
+#include <base64.h>
+#include <filters.h>
+#include <boost/algorithm/hex.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const size_t PAYLOAD_SIZES[] = { 16, 1024, 64 * 1024, 1024 * 1024 };
+    const size_t USERS_LIST_SIZES[] = { 10000, 100000, 1000000 };
+    const size_t PENDING_MESSAGES = 10000;
+    const size_t PENDING_SENDERS = 100;
+
+    volatile size_t sink = 0;   // results go here so the compiler keeps the work
+
+    std::string sizeName(const size_t size)
+    {
+        if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+            return std::to_string(size / (1024 * 1024)) + "MiB";
+        if (size >= 1024 && size % 1024 == 0)
+            return std::to_string(size / 1024) + "KiB";
+        return std::to_string(size) + "B";
+    }
+
+    std::string countName(const size_t count)
+    {
+        if (count >= 1000000 && count % 1000000 == 0)
+            return std::to_string(count / 1000000) + "M";
+        if (count >= 1000 && count % 1000 == 0)
+            return std::to_string(count / 1000) + "k";
+        return std::to_string(count);
+    }
+
+    std::vector<uint8_t> randomBytes(const size_t size)
+    {
+        std::vector<uint8_t> bytes(size);
+        if (size != 0)
+            AESWrapper::GenerateKey(bytes.data(), size);
+        return bytes;
+    }
+
+    SymmetricKey randomKey()
+    {
+        SymmetricKey key;
+        AESWrapper::GenerateKey(key.symmetricKey, SYMMETRIC_KEY_SIZE);
+        return key;
+    }
+
+    void benchAES(Benchmark& bench)
+    {
+        const AESWrapper aes(randomKey());
+        for (const size_t size : PAYLOAD_SIZES)
+        {
+            const std::vector<uint8_t> plain = randomBytes(size);
+            std::vector<uint8_t> cipher(AESWrapper::cipherSize(size));
+            std::vector<uint8_t> decrypted(cipher.size());
+            bench.run("aes/encrypt/" + sizeName(size), size, [&]() {
+                sink += aes.encrypt(plain.data(), size, cipher.data());
+            });
+            aes.encrypt(plain.data(), size, cipher.data());
+            bench.run("aes/decrypt/" + sizeName(size), size, [&]() {
+                sink += aes.decrypt(cipher.data(), cipher.size(), decrypted.data());
+            });
+        }
+    }
+
+    void benchAEAD(Benchmark& bench)
+    {
+        const SymmetricKey key = randomKey();
+        for (const size_t size : PAYLOAD_SIZES)
+        {
+            const std::vector<uint8_t> plain = randomBytes(size);
+            bench.run("aead/seal/" + sizeName(size), size, [&]() {
+                sink += AEADMessage::seal(key, plain.data(), size).size();
+            });
+            const std::string sealed = AEADMessage::seal(key, plain.data(), size);
+            std::string opened;
+            bench.run("aead/open/" + sizeName(size), size, [&]() {
+                sink += AEADMessage::open(key, reinterpret_cast<const uint8_t*>(sealed.data()), sealed.size(), opened);
+            });
+        }
+    }
+
+    // a symmetric key wrapped for a peer, as in MSG_SYMMETRIC_KEY_SEND
+    void benchRSA(Benchmark& bench)
+    {
+        if (!bench.selected("rsa/encrypt/symmetric_key") && !bench.selected("rsa/decrypt/symmetric_key"))
+            return;     // generating the key pair takes a while
+
+        RSAPrivateWrapper privateKey;
+        const std::string publicKeyBytes = privateKey.getPublicKey();
+        PublicKey publicKey;
+        memcpy(publicKey.publicKey, publicKeyBytes.data(), std::min(publicKeyBytes.size(), PUBLIC_KEY_SIZE));
+        RSAPublicWrapper publicWrapper(publicKey);
+        const SymmetricKey key = randomKey();
+
+        bench.run("rsa/encrypt/symmetric_key", SYMMETRIC_KEY_SIZE, [&]() {
+            sink += publicWrapper.encrypt(key.symmetricKey, SYMMETRIC_KEY_SIZE).size();
+        });
+        const std::string cipher = publicWrapper.encrypt(key.symmetricKey, SYMMETRIC_KEY_SIZE);
+        bench.run("rsa/decrypt/symmetric_key", SYMMETRIC_KEY_SIZE, [&]() {
+            sink += privateKey.decrypt(reinterpret_cast<const uint8_t*>(cipher.data()), cipher.size()).size();
+        });
+    }
+
+    void benchEncoder(Benchmark& bench)
+    {
+        // a client id the way me.info and the file names have it
+        const std::vector<uint8_t> uuid = randomBytes(CLIENT_ID_SIZE);
+        const std::string uuidHex = Encoder::bytesToHex(uuid.data(), uuid.size());
+        bench.run("encoder/hex_string/encode/16B", CLIENT_ID_SIZE, [&]() {
+            sink += Encoder::bytesToHex(uuid.data(), uuid.size()).size();
+        });
+        bench.run("encoder/hex_string/decode/16B", CLIENT_ID_SIZE, [&]() {
+            sink += Encoder::hexToBytes(uuidHex).size();
+        });
+        // the *_reference cases time what Encoder did before its own kernels, boost::algorithm::hex and
+        // the Crypto++ Base64 filters, so the speedup can be measured on the same machine
+        const std::string uuidString(uuid.begin(), uuid.end());
+        bench.run("encoder/hex_string_reference/encode/16B", CLIENT_ID_SIZE, [&]() {
+            sink += boost::algorithm::hex(uuidString).size();
+        });
+        bench.run("encoder/hex_string_reference/decode/16B", CLIENT_ID_SIZE, [&]() {
+            sink += boost::algorithm::unhex(uuidHex).size();
+        });
+
+        for (const size_t size : PAYLOAD_SIZES)
+        {
+            const std::vector<uint8_t> bytes = randomBytes(size);
+            std::vector<uint8_t> decoded(Encoder::decodedSize(Encoder::base64Size(size)));
+            std::string hex(2 * size, '\0');
+            Encoder::bytesToHex(bytes.data(), size, &hex[0]);
+            bench.run("encoder/hex/encode/" + sizeName(size), size, [&]() {
+                Encoder::bytesToHex(bytes.data(), size, &hex[0]);
+                sink += hex[0];
+            });
+            bench.run("encoder/hex/decode/" + sizeName(size), size, [&]() {
+                sink += Encoder::hexToBytes(hex.data(), hex.size(), decoded.data());
+            });
+
+            std::string base64(Encoder::base64Size(size), '\0');
+            Encoder::encode(bytes.data(), size, &base64[0]);
+            bench.run("encoder/base64/encode/" + sizeName(size), size, [&]() {
+                sink += Encoder::encode(bytes.data(), size, &base64[0]);
+            });
+            bench.run("encoder/base64/decode/" + sizeName(size), size, [&]() {
+                sink += Encoder::decode(base64.data(), base64.size(), decoded.data());
+            });
+
+            const std::string byteString(bytes.begin(), bytes.end());
+            bench.run("encoder/hex_reference/encode/" + sizeName(size), size, [&]() {
+                sink += boost::algorithm::hex(byteString).size();
+            });
+            bench.run("encoder/hex_reference/decode/" + sizeName(size), size, [&]() {
+                sink += boost::algorithm::unhex(hex).size();
+            });
+            bench.run("encoder/base64_reference/encode/" + sizeName(size), size, [&]() {
+                std::string encoded;
+                CryptoPP::StringSource source(byteString, true,
+                    new CryptoPP::Base64Encoder(new CryptoPP::StringSink(encoded), false));
+                sink += encoded.size();
+            });
+            bench.run("encoder/base64_reference/decode/" + sizeName(size), size, [&]() {
+                std::string plain;
+                CryptoPP::StringSource source(base64, true, new CryptoPP::Base64Decoder(new CryptoPP::StringSink(plain)));
+                sink += plain.size();
+            });
+        }
+    }
+
+    // a RESPONSE_USERS_LIST payload: id and NUL padded name of every user
+    std::vector<uint8_t> usersList(const size_t users)
+    {
+        const size_t recordSize = CLIENT_ID_SIZE + CLIENT_NAME_SIZE;
+        std::vector<uint8_t> payload(users * recordSize, 0);
+        const std::vector<uint8_t> ids = randomBytes(users * CLIENT_ID_SIZE);
+        for (size_t i = 0; i < users; ++i)
+        {
+            uint8_t* record = payload.data() + i * recordSize;
+            memcpy(record, ids.data() + i * CLIENT_ID_SIZE, CLIENT_ID_SIZE);
+            const std::string name = "user" + std::to_string(i);
+            memcpy(record + CLIENT_ID_SIZE, name.data(), name.size());
+        }
+        return payload;
+    }
+
+    void benchUsersList(Benchmark& bench)
+    {
+        for (const size_t users : USERS_LIST_SIZES)
+        {
+            const std::string name = "users_list/parse/" + countName(users);
+            if (!bench.selected(name))
+                continue;
+
+            const std::vector<uint8_t> payload = usersList(users);
+            ClientRoster roster;
+            RosterETag etag;
+            std::string error;
+            bench.run(name, payload.size(), [&]() {
+                sink += Communication::parseClientsList(payload.data(), payload.size(), roster, etag, error);
+            });
+        }
+    }
+
+    // a RESPONSE_PULL_PENDING_MSGS payload of text messages from a few senders, 16 to 1024 bytes of ciphertext each
+    std::vector<uint8_t> pendingMessages(const size_t count)
+    {
+        const size_t headerSize = WireCodec::size<PendingMessage>();
+        const std::vector<uint8_t> senders = randomBytes(PENDING_SENDERS * CLIENT_ID_SIZE);
+        std::vector<uint8_t> payload;
+        for (size_t i = 0; i < count; ++i)
+        {
+            PendingMessage header;
+            memcpy(header.clientId.uuid, senders.data() + (i % PENDING_SENDERS) * CLIENT_ID_SIZE, CLIENT_ID_SIZE);
+            header.messageId = static_cast<messageID_t>(i);
+            header.messageType = MSG_SEND_TEXT;
+            header.messageSize = static_cast<csize_t>(AESWrapper::BLOCK_SIZE * (1 + i % 64));
+
+            const size_t offset = payload.size();
+            payload.resize(offset + headerSize + header.messageSize);
+            WireCodec::encode(header, payload.data() + offset);
+            AESWrapper::GenerateKey(payload.data() + offset + headerSize, header.messageSize);
+        }
+        return payload;
+    }
+
+    void benchPendingMessages(Benchmark& bench)
+    {
+        const std::vector<uint8_t> payload = pendingMessages(PENDING_MESSAGES);
+        const std::string count = countName(PENDING_MESSAGES);
+
+        bench.run("pending/view/" + count, payload.size(), [&]() {
+            const PendingMessageView view(payload.data(), payload.size());
+            for (const PendingMessageRecord& record : view)
+                sink += record.content.size;
+        });
+
+        // as it comes off the socket
+        bench.run("pending/parser/" + count, payload.size(), [&]() {
+            PendingMessageParser parser([](const PendingMessageRecord& record) {
+                sink += record.content.size;
+                return true;
+            });
+            for (size_t offset = 0; offset < payload.size(); offset += STREAM_CHUNK_SIZE)
+                parser.feed(payload.data() + offset, std::min(STREAM_CHUNK_SIZE, payload.size() - offset));
+            sink += parser.records();
+        });
+    }
+
+    void usage()
+    {
+        printf("bench [--filter <text>] [--out <results.json>] [--baseline <results.json>] [--threshold <percent>] "
+            "[--min-time <ms>]\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string filter, outPath, baselinePath;
+    double threshold = BENCHMARK_REGRESSION;
+    double minSampleMs = BENCHMARK_MIN_SAMPLE_MS;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue)
+            filter = argv[++i];
+        else if (arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if (arg == "--baseline" && hasValue)
+            baselinePath = argv[++i];
+        else if (arg == "--threshold" && hasValue)
+            threshold = atof(argv[++i]) / 100;
+        else if (arg == "--min-time" && hasValue)
+            minSampleMs = atof(argv[++i]);
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    Benchmark bench(minSampleMs);
+    bench.setFilter(filter);
+    benchAES(bench);
+    benchAEAD(bench);
+    benchRSA(bench);
+    benchEncoder(bench);
+    benchUsersList(bench);
+    benchPendingMessages(bench);
+
+    std::string error;
+    if (!outPath.empty() && !bench.writeJson(outPath, error))
+    {
+        printf("%s\n", error.c_str());
+        return 2;
+    }
+    if (baselinePath.empty())
+        return 0;
+
+    std::vector<BenchmarkComparison> comparisons;
+    if (!bench.compare(baselinePath, threshold, comparisons, error))
+    {
+        printf("%s\n", error.c_str());
+        return 2;
+    }
+
+    size_t regressions = 0;
+    printf("\n%-40s %14s %14s %9s\n", "against baseline", "baseline ns", "current ns", "change");
+    for (const BenchmarkComparison& comparison : comparisons)
+    {
+        if (comparison.baselineNs == 0)
+        {
+            printf("%-40s %14s %14.1f %9s\n", comparison.name.c_str(), "-", comparison.currentNs, "new");
+            continue;
+        }
+        const double change = (comparison.currentNs / comparison.baselineNs - 1) * 100;
+        printf("%-40s %14.1f %14.1f %+8.1f%%%s\n", comparison.name.c_str(), comparison.baselineNs, comparison.currentNs,
+            change, comparison.regression ? "  REGRESSION" : "");
+        if (comparison.regression)
+            ++regressions;
+    }
+    printf("%zu of %zu benchmarks regressed by more than %.1f%%\n", regressions, comparisons.size(), threshold * 100);
+    return regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+namespace
+{
+    //This function times iterations calls of op in nanoseconds
+    double timeIterations(const Benchmark::Operation& op, const uint64_t iterations)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i)
+            op();
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+}
+
+Benchmark::Benchmark(double minSampleMs)
+    : _minSampleNs(minSampleMs * 1e6)
+{
+}
+
+//This function finds how many calls fill a sample, then takes the median time of a call over BENCHMARK_SAMPLES samples
+void Benchmark::run(const std::string& name, const uint64_t bytes, const Operation& op)
+{
+    if (!selected(name))
+        return;
+
+    // the first call warms caches and lazy initialization up and is not counted
+    op();
+    uint64_t iterations = 1;
+    double elapsed = timeIterations(op, iterations);
+    while (elapsed < _minSampleNs)
+    {
+        const double scale = elapsed > 0 ? _minSampleNs / elapsed : 100.0;
+        iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale * 1.2, 100.0)));
+        elapsed = timeIterations(op, iterations);
+    }
+
+    std::vector<double> samples(1, elapsed / iterations);
+    while (samples.size() < BENCHMARK_SAMPLES)
+        samples.push_back(timeIterations(op, iterations) / iterations);
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+
+    BenchmarkResult result;
+    result.name = name;
+    result.bytes = bytes;
+    result.iterations = iterations;
+    result.nsPerOp = samples[samples.size() / 2];
+    _results.push_back(result);
+
+    if (bytes != 0)
+        printf("%-40s %14.1f ns/op %10.1f MB/s\n", name.c_str(), result.nsPerOp, bytes * 1e3 / result.nsPerOp);
+    else
+        printf("%-40s %14.1f ns/op\n", name.c_str(), result.nsPerOp);
+    fflush(stdout);
+}
+
+bool Benchmark::writeJson(const std::string& path, std::string& error) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        error = "Couldn't open " + path;
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(3) << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < _results.size(); ++i)
+    {
+        const BenchmarkResult& result = _results[i];
+        file << "    { \"name\": \"" << escape(result.name) << "\", \"bytes\": " << result.bytes
+            << ", \"iterations\": " << result.iterations << ", \"ns_per_op\": " << result.nsPerOp << " }"
+            << (i + 1 < _results.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+    if (!file)
+    {
+        error = "Couldn't write " + path;
+        return false;
+    }
+    return true;
+}
+
+//This function reads the baseline, a file written by writeJson, and lines every result up with its benchmark there
+bool Benchmark::compare(const std::string& baselinePath, const double threshold, std::vector<BenchmarkComparison>& comparisons,
+    std::string& error) const
+{
+    std::map<std::string, double> baseline;
+    try
+    {
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_json(baselinePath, tree);
+        for (const auto& entry : tree.get_child("benchmarks"))
+            baseline[entry.second.get<std::string>("name")] = entry.second.get<double>("ns_per_op");
+    }
+    catch (const std::exception& e)
+    {
+        error = "Couldn't read the baseline " + baselinePath + ": " + e.what();
+        return false;
+    }
+
+    comparisons.clear();
+    for (const BenchmarkResult& result : _results)
+    {
+        BenchmarkComparison comparison;
+        comparison.name = result.name;
+        comparison.currentNs = result.nsPerOp;
+        const auto it = baseline.find(result.name);
+        if (it != baseline.end())
+        {
+            comparison.baselineNs = it->second;
+            comparison.regression = result.nsPerOp > it->second * (1 + threshold);
+        }
+        comparisons.push_back(comparison);
+    }
+    return true;
+}
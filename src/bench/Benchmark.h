@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+
+const size_t BENCHMARK_SAMPLES = 5;             // the median of them is reported
+const double BENCHMARK_MIN_SAMPLE_MS = 100;     // default time of one sample
+const double BENCHMARK_REGRESSION = 0.10;       // default slowdown against the baseline that counts as a regression
+
+struct BenchmarkResult
+{
+    std::string name;
+    uint64_t bytes = 0;           // processed by one operation, 0 if throughput means nothing for it
+    uint64_t iterations = 0;      // operations in one sample
+    double nsPerOp = 0;
+};
+
+// a result against the same benchmark of the baseline
+struct BenchmarkComparison
+{
+    std::string name;
+    double baselineNs = 0;        // 0 if the baseline doesn't have it
+    double currentNs = 0;
+    bool regression = false;
+};
+
+//This class runs the registered operations, each one as many times as fits in a sample, and keeps the median
+//time of an operation over the samples. The results are written as JSON, a file written earlier is the baseline.
+class Benchmark
+{
+public:
+    typedef std::function<void()> Operation;
+
+    explicit Benchmark(double minSampleMs = BENCHMARK_MIN_SAMPLE_MS);
+
+    virtual ~Benchmark() = default;
+    Benchmark(const Benchmark& other)                = delete;
+    Benchmark(Benchmark&& other) noexcept            = delete;
+    Benchmark& operator=(const Benchmark& other)     = delete;
+    Benchmark& operator=(Benchmark&& other) noexcept = delete;
+
+    // runs op now if name contains the filter, bytes is what one call processes
+    void run(const std::string& name, const uint64_t bytes, const Operation& op);
+    void setFilter(const std::string& filter) { _filter = filter; }
+    bool selected(const std::string& name) const { return name.find(_filter) != std::string::npos; }
+
+    const std::vector<BenchmarkResult>& results() const { return _results; }
+    bool writeJson(const std::string& path, std::string& error) const;
+    // regression is set for results slower than the baseline by more than threshold (0.1 is 10%)
+    bool compare(const std::string& baselinePath, const double threshold, std::vector<BenchmarkComparison>& comparisons,
+        std::string& error) const;
+
+private:
+    double _minSampleNs;
+    std::string _filter;
+    std::vector<BenchmarkResult> _results;
+};
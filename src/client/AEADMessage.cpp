@@ -0,0 +1,167 @@
+#include "AEADMessage.h"
+#include "AESWrapper.h"
+#include "WireCodec.h"
+#include <gcm.h>
+#include <aes.h>
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const uint8_t MIN_CHUNK_SHIFT = 10;
+    const uint8_t MAX_CHUNK_SHIFT = 24;
+
+    //This function splits chunks [0, count) into ranges for the processor's threads, the calling thread takes the last one.
+    //Returns false if any range failed.
+    bool inParallel(const uint64_t count, const std::function<bool(uint64_t, uint64_t)>& work)
+    {
+        const uint64_t threads = std::min<uint64_t>(std::max(1u, std::thread::hardware_concurrency()),
+            count / AEAD_CHUNKS_PER_THREAD);
+        if (threads <= 1)
+            return work(0, count);
+
+        std::vector<std::future<bool>> ranges;
+        uint64_t begin = 0;
+        for (uint64_t t = 0; t + 1 < threads; ++t)
+        {
+            const uint64_t end = begin + count / threads + (t < count % threads ? 1 : 0);
+            ranges.push_back(std::async(std::launch::async, work, begin, end));
+            begin = end;
+        }
+        bool ok = work(begin, count);
+        for (auto& range : ranges)
+            ok = range.get() && ok;
+        return ok;
+    }
+}
+
+AEADHeader AEADMessage::header(const uint64_t plainSize)
+{
+    AEADHeader header;
+    header.chunkShift = AEAD_CHUNK_SHIFT;
+    header.plainSize = plainSize;
+    AESWrapper::GenerateKey(reinterpret_cast<uint8_t*>(&header.nonce), sizeof(header.nonce));
+    return header;
+}
+
+bool AEADMessage::valid(const AEADHeader& header)
+{
+    // the chunk number is the last 32 bits of the IV
+    return header.version == MESSAGE_VERSION_AEAD &&
+        header.chunkShift >= MIN_CHUNK_SHIFT && header.chunkShift <= MAX_CHUNK_SHIFT &&
+        (header.plainSize >> header.chunkShift) < UINT32_MAX;
+}
+
+uint64_t AEADMessage::chunkCount(const AEADHeader& header)
+{
+    // an empty message is one empty chunk, its tag still authenticates the header
+    const uint64_t chunk = static_cast<uint64_t>(1) << header.chunkShift;
+    return std::max<uint64_t>(1, (header.plainSize + chunk - 1) >> header.chunkShift);
+}
+
+uint64_t AEADMessage::sealedSize(const AEADHeader& header)
+{
+    return header.plainSize + chunkCount(header) * TAG_SIZE;
+}
+
+std::string AEADMessage::seal(const SymmetricKey& key, const uint8_t* plain, const size_t length)
+{
+    const AEADMessage message(key, header(length));
+    const size_t headerSize = WireCodec::size<AEADHeader>();
+    std::string sealed(headerSize + static_cast<size_t>(sealedSize(message.getHeader())), '\0');
+    uint8_t* out = reinterpret_cast<uint8_t*>(&sealed[0]);
+    WireCodec::encode(message.getHeader(), out);
+    message.sealChunks(0, message.chunkCount(), plain, out + headerSize);
+    return sealed;
+}
+
+bool AEADMessage::open(const SymmetricKey& key, const uint8_t* message, const size_t length, std::string& plain)
+{
+    const size_t headerSize = WireCodec::size<AEADHeader>();
+    if (length < headerSize)
+        return false;
+    AEADHeader header;
+    WireCodec::decode(message, header);
+    if (!valid(header) || sealedSize(header) != length - headerSize)
+        return false;
+
+    const AEADMessage opener(key, header);
+    plain.resize(static_cast<size_t>(header.plainSize));
+    return opener.openChunks(0, opener.chunkCount(), message + headerSize,
+        reinterpret_cast<uint8_t*>(&plain[0]));
+}
+
+AEADMessage::AEADMessage(const SymmetricKey& key, const AEADHeader& header)
+    : _key(key)
+    , _header(header)
+{
+    static_assert(WireCodec::size<AEADHeader>() == AAD_SIZE, "the associated data is the encoded header");
+    WireCodec::encode(_header, _aad);
+}
+
+size_t AEADMessage::plainSize(const uint64_t index) const
+{
+    const uint64_t offset = index << _header.chunkShift;
+    return static_cast<size_t>(std::min<uint64_t>(chunkSize(), _header.plainSize - offset));
+}
+
+//This function makes the IV of a chunk: the nonce of the message and the chunk number, big-endian
+void AEADMessage::iv(const uint64_t index, uint8_t* out) const
+{
+    for (size_t i = 0; i < sizeof(_header.nonce); ++i)
+        out[i] = static_cast<uint8_t>(_header.nonce >> (8 * i));
+    for (size_t i = 0; i < 4; ++i)
+        out[sizeof(_header.nonce) + i] = static_cast<uint8_t>(index >> (8 * (3 - i)));
+}
+
+void AEADMessage::sealChunks(const uint64_t first, const uint64_t count, const uint8_t* plain, uint8_t* sealed) const
+{
+    const size_t stride = chunkSize() + TAG_SIZE;
+    inParallel(count, [&](const uint64_t begin, const uint64_t end) {
+        // Crypto++ modes keep state, every thread has its own
+        uint8_t nonce[IV_SIZE];
+        iv(first + begin, nonce);
+        CryptoPP::GCM<CryptoPP::AES>::Encryption gcm;
+        gcm.SetKeyWithIV(_key.symmetricKey, sizeof(_key.symmetricKey), nonce, IV_SIZE);
+        for (uint64_t i = begin; i < end; ++i)
+        {
+            const size_t size = plainSize(first + i);
+            uint8_t* out = sealed + i * stride;
+            iv(first + i, nonce);
+            gcm.EncryptAndAuthenticate(out, out + size, TAG_SIZE, nonce, IV_SIZE, _aad, AAD_SIZE,
+                plain + (i << _header.chunkShift), size);
+        }
+        return true;
+    });
+}
+
+bool AEADMessage::openChunks(const uint64_t first, const uint64_t count, const uint8_t* sealed, uint8_t* plain) const
+{
+    const size_t stride = chunkSize() + TAG_SIZE;
+    return inParallel(count, [&](const uint64_t begin, const uint64_t end) {
+        uint8_t nonce[IV_SIZE];
+        iv(first + begin, nonce);
+        CryptoPP::GCM<CryptoPP::AES>::Decryption gcm;
+        try
+        {
+            gcm.SetKeyWithIV(_key.symmetricKey, sizeof(_key.symmetricKey), nonce, IV_SIZE);
+            for (uint64_t i = begin; i < end; ++i)
+            {
+                const size_t size = plainSize(first + i);
+                const uint8_t* in = sealed + i * stride;
+                iv(first + i, nonce);
+                if (!gcm.DecryptAndVerify(plain + (i << _header.chunkShift), in + size, TAG_SIZE, nonce, IV_SIZE,
+                    _aad, AAD_SIZE, in, size))
+                    return false;
+            }
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+        return true;
+    });
+}
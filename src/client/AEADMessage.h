@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "protocol.h"
+
+const uint8_t AEAD_CHUNK_SHIFT = 16;        // 64 KiB chunks
+const uint64_t AEAD_CHUNKS_PER_THREAD = 4;  // fewer chunks than this per thread are sealed or opened on the calling thread
+
+//This class seals and opens the AES-GCM messages (MSG_SEND_TEXT_AEAD, MSG_SEND_FILE_AEAD). The plaintext is cut into
+//chunks of 1 << chunkShift bytes that are sealed one by one, chunk i under the nonce of the header followed by i,
+//with the header as associated data and its own tag behind it. A chunk depends on nothing but the key and the header,
+//so a big message is sealed on several threads and any chunk of it can be opened on its own. There is no padding.
+class AEADMessage
+{
+public:
+    static const size_t TAG_SIZE = 16;
+
+    // header of a new message of plainSize bytes, with a random nonce
+    static AEADHeader header(const uint64_t plainSize);
+    // version, chunk size and chunk count are ones this client handles
+    static bool valid(const AEADHeader& header);
+    static uint64_t chunkCount(const AEADHeader& header);
+    // bytes of the message after the header
+    static uint64_t sealedSize(const AEADHeader& header);
+
+    // a whole message, header and chunks, for a text
+    static std::string seal(const SymmetricKey& key, const uint8_t* plain, const size_t length);
+    // false if message is not a valid AEAD message or any chunk fails its tag
+    static bool open(const SymmetricKey& key, const uint8_t* message, const size_t length, std::string& plain);
+
+    AEADMessage(const SymmetricKey& key, const AEADHeader& header);
+    virtual ~AEADMessage() = default;
+    AEADMessage(const AEADMessage& other) = delete;
+    AEADMessage(AEADMessage&& other) noexcept = delete;
+    AEADMessage& operator=(const AEADMessage& other) = delete;
+    AEADMessage& operator=(AEADMessage&& other) noexcept = delete;
+
+    const AEADHeader& getHeader() const { return _header; }
+    uint64_t chunkCount() const { return chunkCount(_header); }
+    size_t chunkSize() const { return static_cast<size_t>(1) << _header.chunkShift; }
+    // plaintext bytes of chunk index, only the last chunk is shorter
+    size_t plainSize(const uint64_t index) const;
+    size_t sealedChunkSize(const uint64_t index) const { return plainSize(index) + TAG_SIZE; }
+
+    // chunks [first, first + count): plain holds their plaintext back to back, sealed gets each one followed by its tag
+    void sealChunks(const uint64_t first, const uint64_t count, const uint8_t* plain, uint8_t* sealed) const;
+    // the other way around, false if a chunk fails its tag
+    bool openChunks(const uint64_t first, const uint64_t count, const uint8_t* sealed, uint8_t* plain) const;
+
+private:
+    static const size_t IV_SIZE = 12;
+    static const size_t AAD_SIZE = 18;  // the encoded header
+
+    void iv(const uint64_t index, uint8_t* out) const;
+
+    SymmetricKey _key;
+    AEADHeader _header;
+    uint8_t _aad[AAD_SIZE];
+};
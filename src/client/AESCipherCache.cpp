@@ -0,0 +1,49 @@
+#include "AESCipherCache.h"
+#include <cstring>
+
+//This function returns the cached cipher of the peer, a missing or outdated one is built outside the lock
+std::shared_ptr<const AESWrapper> AESCipherCache::get(const ClientID& clientId, const SymmetricKey& symmetricKey)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _ciphers.find(clientId);
+        if (it != _ciphers.end() &&
+            memcmp(it->second->getKey().symmetricKey, symmetricKey.symmetricKey, SYMMETRIC_KEY_SIZE) == 0)
+            return it->second;
+    }
+
+    std::shared_ptr<const AESWrapper> cipher = std::make_shared<AESWrapper>(symmetricKey);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _ciphers[clientId] = cipher;
+    return cipher;
+}
+
+//This function encrypts into the caller's buffer, cipher needs room for AESWrapper::cipherSize(length) bytes
+size_t AESCipherCache::encrypt(const ClientID& clientId, const SymmetricKey& symmetricKey, const uint8_t* plain, size_t length, uint8_t* cipher)
+{
+    return get(clientId, symmetricKey)->encrypt(plain, length, cipher);
+}
+
+//This function decrypts into the caller's buffer, plain needs room for length bytes
+size_t AESCipherCache::decrypt(const ClientID& clientId, const SymmetricKey& symmetricKey, const uint8_t* cipher, size_t length, uint8_t* plain)
+{
+    return get(clientId, symmetricKey)->decrypt(cipher, length, plain);
+}
+
+void AESCipherCache::invalidate(const ClientID& clientId)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _ciphers.erase(clientId);
+}
+
+void AESCipherCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _ciphers.clear();
+}
+
+size_t AESCipherCache::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ciphers.size();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "protocol.h"
+#include "AESWrapper.h"
+
+//This class keeps one ready AESWrapper (expanded key schedules) per peer, so a burst of messages sets the key up once.
+class AESCipherCache
+{
+public:
+    AESCipherCache() = default;
+    virtual ~AESCipherCache() = default;
+    AESCipherCache(const AESCipherCache& other) = delete;
+    AESCipherCache(AESCipherCache&& other) noexcept = delete;
+    AESCipherCache& operator=(const AESCipherCache& other) = delete;
+    AESCipherCache& operator=(AESCipherCache&& other) noexcept = delete;
+
+    // cipher for the peer's current key, rebuilt when the key changed
+    std::shared_ptr<const AESWrapper> get(const ClientID& clientId, const SymmetricKey& symmetricKey);
+
+    size_t encrypt(const ClientID& clientId, const SymmetricKey& symmetricKey, const uint8_t* plain, size_t length, uint8_t* cipher);
+    size_t decrypt(const ClientID& clientId, const SymmetricKey& symmetricKey, const uint8_t* cipher, size_t length, uint8_t* plain);
+
+    void invalidate(const ClientID& clientId);
+    void clear();
+    size_t size() const;
+
+private:
+    mutable std::mutex _mutex;
+    std::unordered_map<ClientID, std::shared_ptr<const AESWrapper>, ClientIDHash> _ciphers;
+};
@@ -1,27 +1,249 @@
-
 #include "AESWrapper.h"
+#include "CpuFeatures.h"
 #include <modes.h>
 #include <aes.h>
-#include <filters.h>
+#include <osrng.h>
 #include <stdexcept>
-#include <immintrin.h>	
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// whole blocks of one CBC stream, decrypted with the AES-NI round keys
+	struct CbcSegment
+	{
+		const uint8_t* keys;
+		const uint8_t* cipher;
+		size_t blocks;
+		uint8_t* plain;
+		const uint8_t* iv;
+	};
+
+	const size_t LANES = 8;		// blocks in flight, enough to hide the latency of the AES rounds
+
+#ifdef CPU_X86
+	TARGET_RDRAND bool generateRdrand(uint8_t* const buffer, const size_t length)
+	{
+		for (size_t i = 0; i < length; i += sizeof(unsigned int))
+		{
+			unsigned int value = 0;
+			int retries = 10;
+			while (!_rdrand32_step(&value))
+			{
+				if (--retries == 0)
+					return false;
+			}
+			memcpy(buffer + i, &value, std::min(sizeof(value), length - i));
+		}
+		return true;
+	}
+
+	TARGET_AESNI __m128i expandStep(__m128i key, __m128i assist)
+	{
+		assist = _mm_shuffle_epi32(assist, 0xff);
+		key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+		key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+		key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+		return _mm_xor_si128(key, assist);
+	}
+
+	// AES-128 key schedule turned around for the equivalent inverse cipher
+	TARGET_AESNI void expandDecryptionKeys(const uint8_t* key, uint8_t (*decryptionKeys)[AESWrapper::BLOCK_SIZE])
+	{
+		__m128i round[AESWrapper::ROUNDS + 1];
+		round[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+		round[1] = expandStep(round[0], _mm_aeskeygenassist_si128(round[0], 0x01));
+		round[2] = expandStep(round[1], _mm_aeskeygenassist_si128(round[1], 0x02));
+		round[3] = expandStep(round[2], _mm_aeskeygenassist_si128(round[2], 0x04));
+		round[4] = expandStep(round[3], _mm_aeskeygenassist_si128(round[3], 0x08));
+		round[5] = expandStep(round[4], _mm_aeskeygenassist_si128(round[4], 0x10));
+		round[6] = expandStep(round[5], _mm_aeskeygenassist_si128(round[5], 0x20));
+		round[7] = expandStep(round[6], _mm_aeskeygenassist_si128(round[6], 0x40));
+		round[8] = expandStep(round[7], _mm_aeskeygenassist_si128(round[7], 0x80));
+		round[9] = expandStep(round[8], _mm_aeskeygenassist_si128(round[8], 0x1b));
+		round[10] = expandStep(round[9], _mm_aeskeygenassist_si128(round[9], 0x36));
+
+		_mm_store_si128(reinterpret_cast<__m128i*>(decryptionKeys[0]), round[AESWrapper::ROUNDS]);
+		for (size_t i = 1; i < AESWrapper::ROUNDS; ++i)
+			_mm_store_si128(reinterpret_cast<__m128i*>(decryptionKeys[i]), _mm_aesimc_si128(round[AESWrapper::ROUNDS - i]));
+		_mm_store_si128(reinterpret_cast<__m128i*>(decryptionKeys[AESWrapper::ROUNDS]), round[0]);
+	}
+
+	TARGET_AESNI inline __m128i roundKey(const uint8_t* keys, const size_t round)
+	{
+		return _mm_load_si128(reinterpret_cast<const __m128i*>(keys + round * AESWrapper::BLOCK_SIZE));
+	}
+
+	//This function decrypts the next LANES blocks, taken from as many segments as needed, false when none are left.
+	//Every lane has its own round keys so the segments don't need to share a key.
+	TARGET_AESNI inline bool decryptLanes(const CbcSegment* segments, const size_t count, size_t& segment, size_t& block)
+	{
+		__m128i state[LANES];
+		__m128i previous[LANES];
+		const uint8_t* keys[LANES];
+		uint8_t* out[LANES];
+		alignas(16) uint8_t unused[LANES][AESWrapper::BLOCK_SIZE];
+
+		size_t lanes = 0;
+		while (lanes < LANES && segment < count)
+		{
+			const CbcSegment& current = segments[segment];
+			if (block == current.blocks)
+			{
+				++segment;
+				block = 0;
+				continue;
+			}
+			const uint8_t* cipher = current.cipher + block * AESWrapper::BLOCK_SIZE;
+			state[lanes] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cipher));
+			previous[lanes] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block == 0 ? current.iv : cipher - AESWrapper::BLOCK_SIZE));
+			keys[lanes] = current.keys;
+			out[lanes] = current.plain + block * AESWrapper::BLOCK_SIZE;
+			++lanes;
+			++block;
+		}
+		if (lanes == 0)
+			return false;
+		// a short group runs full width, the spare lanes repeat the first one into scratch
+		for (size_t lane = lanes; lane < LANES; ++lane)
+		{
+			state[lane] = state[0];
+			previous[lane] = previous[0];
+			keys[lane] = keys[0];
+			out[lane] = unused[lane];
+		}
+
+		for (size_t lane = 0; lane < LANES; ++lane)
+			state[lane] = _mm_xor_si128(state[lane], roundKey(keys[lane], 0));
+		for (size_t round = 1; round < AESWrapper::ROUNDS; ++round)
+		{
+			for (size_t lane = 0; lane < LANES; ++lane)
+				state[lane] = _mm_aesdec_si128(state[lane], roundKey(keys[lane], round));
+		}
+		for (size_t lane = 0; lane < LANES; ++lane)
+		{
+			state[lane] = _mm_aesdeclast_si128(state[lane], roundKey(keys[lane], AESWrapper::ROUNDS));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out[lane]), _mm_xor_si128(state[lane], previous[lane]));
+		}
+		return true;
+	}
+
+	TARGET_AESNI void cbcDecryptAesni(const CbcSegment* segments, const size_t count)
+	{
+		size_t segment = 0;
+		size_t block = 0;
+		while (decryptLanes(segments, count, segment, block))
+		{
+		}
+	}
+
+	//This function takes runs of LANES blocks inside one segment two blocks per register,
+	//the start of a segment and short segments go through decryptLanes()
+	TARGET_VAES void cbcDecryptVaes(const CbcSegment* segments, const size_t count)
+	{
+		size_t segment = 0;
+		size_t block = 0;
+		while (true)
+		{
+			while (segment < count && block == segments[segment].blocks)
+			{
+				++segment;
+				block = 0;
+			}
+			if (segment == count)
+				break;
+			const CbcSegment& current = segments[segment];
+			if (block == 0 || current.blocks - block < LANES)
+			{
+				decryptLanes(segments, count, segment, block);
+				continue;
+			}
+
+			const uint8_t* cipher = current.cipher + block * AESWrapper::BLOCK_SIZE;
+			uint8_t* plain = current.plain + block * AESWrapper::BLOCK_SIZE;
+			__m256i state[LANES / 2];
+			__m256i previous[LANES / 2];
+			for (size_t i = 0; i < LANES / 2; ++i)
+			{
+				state[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cipher + 2 * i * AESWrapper::BLOCK_SIZE));
+				// block > 0 here, so the block before the first lane is still inside the segment
+				previous[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cipher + 2 * i * AESWrapper::BLOCK_SIZE - AESWrapper::BLOCK_SIZE));
+			}
+			__m256i key = _mm256_broadcastsi128_si256(roundKey(current.keys, 0));
+			for (size_t i = 0; i < LANES / 2; ++i)
+				state[i] = _mm256_xor_si256(state[i], key);
+			for (size_t round = 1; round < AESWrapper::ROUNDS; ++round)
+			{
+				key = _mm256_broadcastsi128_si256(roundKey(current.keys, round));
+				for (size_t i = 0; i < LANES / 2; ++i)
+					state[i] = _mm256_aesdec_epi128(state[i], key);
+			}
+			key = _mm256_broadcastsi128_si256(roundKey(current.keys, AESWrapper::ROUNDS));
+			for (size_t i = 0; i < LANES / 2; ++i)
+			{
+				state[i] = _mm256_aesdeclast_epi128(state[i], key);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(plain + 2 * i * AESWrapper::BLOCK_SIZE), _mm256_xor_si256(state[i], previous[i]));
+			}
+			block += LANES;
+		}
+	}
+#endif
+
+	// only called if the processor has AES-NI
+	void cbcDecrypt(const CbcSegment* segments, const size_t count)
+	{
+#ifdef CPU_X86
+		if (CpuFeatures::get().vaes())
+			cbcDecryptVaes(segments, count);
+		else
+			cbcDecryptAesni(segments, count);
+#endif
+	}
+
+	bool overlaps(const uint8_t* first, const uint8_t* second, const size_t length)
+	{
+		return first < second + length && second < first + length;
+	}
+}
 
 
+//This function fills buffer from RDRAND when the processor has it, from the OS generator otherwise
 void AESWrapper::GenerateKey(uint8_t* const buffer, const size_t length)
 {
-	for (size_t i = 0; i < length; i += sizeof(unsigned int))
-		_rdrand32_step(reinterpret_cast<unsigned int*>(&buffer[i]));
+#ifdef CPU_X86
+	if (CpuFeatures::get().rdrand() && generateRdrand(buffer, length))
+		return;
+#endif
+	CryptoPP::AutoSeededRandomPool rng;
+	rng.GenerateBlock(buffer, length);
 }
 
 
 AESWrapper::AESWrapper()
 {
 	GenerateKey(_key.symmetricKey, sizeof(_key.symmetricKey));
+	setKey();
 }
 
 
 AESWrapper::AESWrapper(const SymmetricKey& symKey) : _key(symKey)
 {
+	setKey();
+}
+
+void AESWrapper::setKey()
+{
+	_encryption.SetKey(_key.symmetricKey, sizeof(_key.symmetricKey));
+	_decryption.SetKey(_key.symmetricKey, sizeof(_key.symmetricKey));
+	memset(_decryptionKeys, 0, sizeof(_decryptionKeys));
+#ifdef CPU_X86
+	if (CpuFeatures::get().aesni())
+		expandDecryptionKeys(_key.symmetricKey, _decryptionKeys);
+#endif
 }
 
 std::string AESWrapper::encrypt(const std::string& plain) const
@@ -31,31 +253,172 @@ std::string AESWrapper::encrypt(const std::string& plain) const
 
 std::string AESWrapper::encrypt(const uint8_t* plain, size_t length) const
 {
-	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// for practical use iv should never be a fixed value!
+	std::string cipher(cipherSize(length), '\0');
+	encrypt(plain, length, reinterpret_cast<uint8_t*>(&cipher[0]));
+	return cipher;
+}
+
+
+std::string AESWrapper::decrypt(const uint8_t* cipher, size_t length) const
+{
+	std::string decrypted(length, '\0');
+	decrypted.resize(decrypt(cipher, length, reinterpret_cast<uint8_t*>(&decrypted[0])));
+	return decrypted;
+}
 
-	CryptoPP::AES::Encryption aesEncryption(_key.symmetricKey, sizeof(_key.symmetricKey));
-	CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption(aesEncryption, iv);
 
-	std::string cipher;
-	CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, new CryptoPP::StringSink(cipher));
-	stfEncryptor.Put(plain, length);
-	stfEncryptor.MessageEnd();
+void AESWrapper::encryptBlocks(const uint8_t* plain, size_t length, uint8_t* cipher, uint8_t* iv) const
+{
+	if (length == 0)
+		return;
+	if (length % BLOCK_SIZE != 0)
+		throw std::invalid_argument("AESWrapper::encryptBlocks needs whole blocks");
 
-	return cipher;
+	CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption(_encryption, iv);
+	cbcEncryption.ProcessData(cipher, plain, length);
+
+	// the last cipher block chains into the next call
+	memcpy(iv, cipher + length - BLOCK_SIZE, BLOCK_SIZE);
 }
 
 
-std::string AESWrapper::decrypt(const uint8_t* cipher, size_t length) const
+size_t AESWrapper::encrypt(const uint8_t* plain, size_t length, uint8_t* cipher) const
 {
-	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	
+	AESStreamEncryptor encryptor(*this);
+	return encryptor.final(plain, length, cipher);
+}
 
-	CryptoPP::AES::Decryption aesDecryption(_key.symmetricKey, sizeof(_key.symmetricKey));
-	CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(aesDecryption, iv);
 
-	std::string decrypted;
-	CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, new CryptoPP::StringSink(decrypted));
-	stfDecryptor.Put(cipher, length);
-	stfDecryptor.MessageEnd();
+void AESWrapper::decryptBlocks(const uint8_t* cipher, size_t length, uint8_t* plain, uint8_t* iv) const
+{
+	if (length == 0)
+		return;
+	if (length % BLOCK_SIZE != 0)
+		throw std::invalid_argument("AES ciphertext is not a whole number of blocks");
 
-	return decrypted;
+	// taken before plain may overwrite cipher
+	uint8_t next[BLOCK_SIZE];
+	memcpy(next, cipher + length - BLOCK_SIZE, BLOCK_SIZE);
+	if (CpuFeatures::get().aesni() && !overlaps(cipher, plain, length))
+	{
+		// the blocks of one CBC stream decrypt independently, they go through the AES units side by side
+		const CbcSegment segment = { _decryptionKeys[0], cipher, length / BLOCK_SIZE, plain, iv };
+		cbcDecrypt(&segment, 1);
+	}
+	else
+	{
+		CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(_decryption, iv);
+		cbcDecryption.ProcessData(plain, cipher, length);
+	}
+	memcpy(iv, next, BLOCK_SIZE);
+}
+
+
+bool AESWrapper::removePadding(const uint8_t* plain, const size_t length, size_t& plainSize)
+{
+	const uint8_t padding = plain[length - 1];
+	if (padding == 0 || padding > BLOCK_SIZE)
+		return false;
+	for (size_t i = length - padding; i < length; ++i)
+	{
+		if (plain[i] != padding)
+			return false;
+	}
+	plainSize = length - padding;
+	return true;
+}
+
+
+//This function decrypts all the jobs' blocks in one pass through the AES-NI kernel, one by one without AES-NI
+void AESWrapper::decryptBatch(AESDecryptJob* jobs, const size_t count)
+{
+	static const uint8_t zeroIv[BLOCK_SIZE] = { 0 };
+	std::vector<CbcSegment> segments;
+	segments.reserve(count);
+	const bool aesni = CpuFeatures::get().aesni();
+	for (size_t i = 0; i < count; ++i)
+	{
+		AESDecryptJob& job = jobs[i];
+		job.ok = false;
+		job.plainSize = 0;
+		if (job.length == 0 || job.length % BLOCK_SIZE != 0)
+			continue;
+		if (aesni && !overlaps(job.cipher, job.plain, job.length))
+		{
+			const CbcSegment segment = { job.aes->_decryptionKeys[0], job.cipher, job.length / BLOCK_SIZE, job.plain, zeroIv };
+			segments.push_back(segment);
+		}
+		else
+		{
+			uint8_t iv[BLOCK_SIZE] = { 0 };
+			job.aes->decryptBlocks(job.cipher, job.length, job.plain, iv);
+		}
+	}
+	if (!segments.empty())
+		cbcDecrypt(segments.data(), segments.size());
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		AESDecryptJob& job = jobs[i];
+		if (job.length != 0 && job.length % BLOCK_SIZE == 0)
+			job.ok = removePadding(job.plain, job.length, job.plainSize);
+	}
+}
+
+
+size_t AESWrapper::decrypt(const uint8_t* cipher, size_t length, uint8_t* plain) const
+{
+	AESStreamDecryptor decryptor(*this);
+	return decryptor.final(cipher, length, plain);
+}
+
+
+AESStreamEncryptor::AESStreamEncryptor(const AESWrapper& aes) : _aes(aes)
+{
+	memset(_iv, 0, sizeof(_iv));	// for practical use iv should never be a fixed value!
+}
+
+void AESStreamEncryptor::update(const uint8_t* plain, size_t length, uint8_t* cipher)
+{
+	_aes.encryptBlocks(plain, length, cipher, _iv);
+}
+
+size_t AESStreamEncryptor::final(const uint8_t* plain, size_t length, uint8_t* cipher)
+{
+	const size_t whole = length - length % AESWrapper::BLOCK_SIZE;
+	update(plain, whole, cipher);
+
+	// PKCS#7, like the StreamTransformationFilter default
+	uint8_t block[AESWrapper::BLOCK_SIZE];
+	const size_t tail = length - whole;
+	const uint8_t padding = static_cast<uint8_t>(AESWrapper::BLOCK_SIZE - tail);
+	if (tail > 0)
+		memcpy(block, plain + whole, tail);
+	memset(block + tail, padding, padding);
+	update(block, sizeof(block), cipher + whole);
+
+	return whole + AESWrapper::BLOCK_SIZE;
+}
+
+
+AESStreamDecryptor::AESStreamDecryptor(const AESWrapper& aes) : _aes(aes)
+{
+	memset(_iv, 0, sizeof(_iv));
+}
+
+void AESStreamDecryptor::update(const uint8_t* cipher, size_t length, uint8_t* plain)
+{
+	_aes.decryptBlocks(cipher, length, plain, _iv);
+}
+
+size_t AESStreamDecryptor::final(const uint8_t* cipher, size_t length, uint8_t* plain)
+{
+	if (length == 0 || length % AESWrapper::BLOCK_SIZE != 0)
+		throw std::invalid_argument("AES ciphertext is not a whole number of blocks");
+	update(cipher, length, plain);
+
+	size_t plainSize = 0;
+	if (!AESWrapper::removePadding(plain, length, plainSize))
+		throw std::invalid_argument("AES padding is invalid");
+	return plainSize;
 }
@@ -3,12 +3,34 @@
  */
 #pragma once
 #include <string>
+#include <aes.h>
 #include "protocol.h"
 
+class AESWrapper;
+
+// one message of a decryptBatch() call
+struct AESDecryptJob
+{
+	const AESWrapper* aes = nullptr;
+	const uint8_t* cipher = nullptr;
+	size_t length = 0;
+	uint8_t* plain = nullptr;	// room for length bytes, must not overlap cipher
+	size_t plainSize = 0;		// set by decryptBatch()
+	bool ok = false;			// false if the length or the padding is wrong
+};
+
 class AESWrapper
 {
 public:
+	static const size_t BLOCK_SIZE = 16;
+	static const size_t ROUNDS = 10;
+
 	static void GenerateKey(uint8_t* const buffer, const size_t length);
+	static size_t cipherSize(const size_t plainSize) { return (plainSize / BLOCK_SIZE + 1) * BLOCK_SIZE; }
+	// decrypts many messages in one go, with AES-NI the blocks of several messages are decrypted side by side
+	static void decryptBatch(AESDecryptJob* jobs, const size_t count);
+	// checks the PKCS#7 padding of a decrypted message, plainSize is the size without it
+	static bool removePadding(const uint8_t* plain, const size_t length, size_t& plainSize);
 
 	AESWrapper();
 	AESWrapper(const SymmetricKey& symKey);
@@ -25,6 +47,67 @@ public:
 	std::string encrypt(const uint8_t* plain, size_t length) const;
 	std::string decrypt(const uint8_t* cipher, size_t length) const;
 
+	// cipher needs room for cipherSize(length) bytes, returns the bytes written
+	size_t encrypt(const uint8_t* plain, size_t length, uint8_t* cipher) const;
+	// plain needs room for length bytes, returns the plaintext size without the padding
+	size_t decrypt(const uint8_t* cipher, size_t length, uint8_t* plain) const;
+	// CBC over whole blocks, iv is updated so the next call continues the chain
+	void encryptBlocks(const uint8_t* plain, size_t length, uint8_t* cipher, uint8_t* iv) const;
+	void decryptBlocks(const uint8_t* cipher, size_t length, uint8_t* plain, uint8_t* iv) const;
+
 private:
+	void setKey();
+
 	SymmetricKey _key;
+	// decryption round keys for AES-NI, expanded if the processor has it
+	alignas(16) uint8_t _decryptionKeys[ROUNDS + 1][BLOCK_SIZE];
+	// key schedules are expanded once per key, Crypto++ only reads them while processing
+	mutable CryptoPP::AES::Encryption _encryption;
+	mutable CryptoPP::AES::Decryption _decryption;
+};
+
+
+//This class encrypts a message piece by piece, the output is the same as AESWrapper::encrypt of the whole message.
+class AESStreamEncryptor
+{
+public:
+	AESStreamEncryptor(const AESWrapper& aes);
+
+	virtual ~AESStreamEncryptor() = default;
+	AESStreamEncryptor(const AESStreamEncryptor& other) = delete;
+	AESStreamEncryptor(AESStreamEncryptor&& other) noexcept = delete;
+	AESStreamEncryptor& operator=(const AESStreamEncryptor& other) = delete;
+	AESStreamEncryptor& operator=(AESStreamEncryptor&& other) noexcept = delete;
+
+	// length must be a multiple of BLOCK_SIZE, cipher gets length bytes
+	void update(const uint8_t* plain, size_t length, uint8_t* cipher);
+	// last piece of the message with its padding, cipher needs room for cipherSize(length) bytes
+	size_t final(const uint8_t* plain, size_t length, uint8_t* cipher);
+
+private:
+	const AESWrapper& _aes;
+	uint8_t _iv[AESWrapper::BLOCK_SIZE];
+};
+
+
+//This class decrypts a message piece by piece, the output is the same as AESWrapper::decrypt of the whole message.
+class AESStreamDecryptor
+{
+public:
+	AESStreamDecryptor(const AESWrapper& aes);
+
+	virtual ~AESStreamDecryptor() = default;
+	AESStreamDecryptor(const AESStreamDecryptor& other) = delete;
+	AESStreamDecryptor(AESStreamDecryptor&& other) noexcept = delete;
+	AESStreamDecryptor& operator=(const AESStreamDecryptor& other) = delete;
+	AESStreamDecryptor& operator=(AESStreamDecryptor&& other) noexcept = delete;
+
+	// length must be a multiple of BLOCK_SIZE and not take the last block of the message, plain gets length bytes
+	void update(const uint8_t* cipher, size_t length, uint8_t* plain);
+	// rest of the message with its padding, plain needs room for length bytes, returns the plaintext size
+	size_t final(const uint8_t* cipher, size_t length, uint8_t* plain);
+
+private:
+	const AESWrapper& _aes;
+	uint8_t _iv[AESWrapper::BLOCK_SIZE];
 };
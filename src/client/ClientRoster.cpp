@@ -0,0 +1,402 @@
+#include "ClientRoster.h"
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ROSTER_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace
+{
+    inline size_t idSlot(const ClientID& id, const size_t mask)
+    {
+        return ClientIDHash()(id) & mask;
+    }
+
+    inline size_t nameSlot(std::string_view name, const size_t mask)
+    {
+        return std::hash<std::string_view>()(name) & mask;
+    }
+
+#ifdef ROSTER_SSE2
+    inline unsigned firstBit(const unsigned mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+#endif
+}
+
+//This function finds the NUL that ends a name, 16 bytes are compared against zero at once
+size_t ClientRoster::nameLength(const uint8_t* name, const size_t maxLength)
+{
+    size_t i = 0;
+#ifdef ROSTER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= maxLength; i += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(name + i));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)));
+        if (mask != 0)
+            return i + firstBit(mask);
+    }
+#endif
+    const void* end = memchr(name + i, '\0', maxLength - i);
+    return end ? static_cast<const uint8_t*>(end) - name : maxLength;
+}
+
+//This function adds a user, the id and the name point at the new entry
+ClientRoster::Handle ClientRoster::add(const ClientID& id, std::string_view username)
+{
+    const Handle known = handle(id);
+    if (known != INVALID_HANDLE)
+        return known;
+
+    if ((_ids.size() + 1) * 2 > _idIndex.size())
+        rehash(_idIndex.empty() ? 16 : _idIndex.size() * 2);
+
+    const Handle handle = static_cast<Handle>(_ids.size());
+    if (_nameOffsets.empty())
+        _nameOffsets.push_back(0);
+    _ids.push_back(id);
+    _names.insert(_names.end(), username.begin(), username.end());
+    _nameOffsets.push_back(static_cast<uint32_t>(_names.size()));
+    _flags.push_back(0);
+    _keySlots.push_back(NO_KEYS);
+    insertIndexes(handle);
+    if (_sortedValid)
+        _sorted.insert(std::upper_bound(_sorted.begin(), _sorted.end(), handle,
+            [this](Handle left, Handle right) { return nameLess(left, right); }), handle);
+    return handle;
+}
+
+//This function fills the roster from a users list payload, the names are measured first so the arena is allocated once
+void ClientRoster::assign(const uint8_t* records, const size_t count)
+{
+    const size_t recordSize = sizeof(ClientID) + CLIENT_NAME_SIZE;
+    std::vector<uint32_t> lengths(count);
+    size_t nameBytes = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        // name of user, NUL padded and at most CLIENT_NAME_SIZE - 1 characters
+        lengths[i] = static_cast<uint32_t>(nameLength(records + i * recordSize + sizeof(ClientID), CLIENT_NAME_SIZE - 1));
+        nameBytes += lengths[i];
+    }
+
+    clear();
+    reserve(count, nameBytes);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t* record = records + i * recordSize;
+        ClientID id;
+        memcpy(&id, record, sizeof(ClientID));
+        add(id, std::string_view(reinterpret_cast<const char*>(record + sizeof(ClientID)), lengths[i]));
+    }
+    // name order is built when it is first needed, or carried over from the previous roster by merge
+    _sortedValid = false;
+}
+
+ClientRoster::Handle ClientRoster::handle(const ClientID& id) const
+{
+    if (_idIndex.empty())
+        return INVALID_HANDLE;
+    const size_t mask = _idIndex.size() - 1;
+    for (size_t slot = idSlot(id, mask); _idIndex[slot] != INVALID_HANDLE; slot = (slot + 1) & mask)
+    {
+        if (_ids[_idIndex[slot]] == id)
+            return _idIndex[slot];
+    }
+    return INVALID_HANDLE;
+}
+
+ClientRoster::Handle ClientRoster::handle(std::string_view username) const
+{
+    if (_nameIndex.empty())
+        return INVALID_HANDLE;
+    const size_t mask = _nameIndex.size() - 1;
+    for (size_t slot = nameSlot(username, mask); _nameIndex[slot] != INVALID_HANDLE; slot = (slot + 1) & mask)
+    {
+        if (this->username(_nameIndex[slot]) == username)
+            return _nameIndex[slot];
+    }
+    return INVALID_HANDLE;
+}
+
+std::string_view ClientRoster::username(const Handle handle) const
+{
+    return std::string_view(_names.data() + _nameOffsets[handle], _nameOffsets[handle + 1] - _nameOffsets[handle]);
+}
+
+const PublicKey* ClientRoster::publicKey(const Handle handle) const
+{
+    return (_flags[handle] & PUBLIC_KEY_SET) ? &_keys[_keySlots[handle]].publicKey : nullptr;
+}
+
+const SymmetricKey* ClientRoster::symmetricKey(const Handle handle) const
+{
+    return (_flags[handle] & SYMMETRIC_KEY_SET) ? &_keys[_keySlots[handle]].symmetricKey : nullptr;
+}
+
+void ClientRoster::setPublicKey(const Handle handle, const PublicKey& key)
+{
+    keys(handle).publicKey = key;
+    _flags[handle] |= PUBLIC_KEY_SET;
+}
+
+void ClientRoster::setSymmetricKey(const Handle handle, const SymmetricKey& key)
+{
+    keys(handle).symmetricKey = key;
+    _flags[handle] |= SYMMETRIC_KEY_SET;
+}
+
+void ClientRoster::clearKeys(const Handle handle)
+{
+    _flags[handle] &= ~(PUBLIC_KEY_SET | SYMMETRIC_KEY_SET | AEAD_MESSAGES);
+}
+
+uint8_t ClientRoster::messageVersion(const Handle handle) const
+{
+    return (_flags[handle] & AEAD_MESSAGES) ? MESSAGE_VERSION_AEAD : MESSAGE_VERSION_CBC;
+}
+
+void ClientRoster::setMessageVersion(const Handle handle, const uint8_t version)
+{
+    if (version >= MESSAGE_VERSION_AEAD)
+        _flags[handle] |= AEAD_MESSAGES;
+    else
+        _flags[handle] &= ~AEAD_MESSAGES;
+}
+
+//This function returns the key slot of the user, it is allocated when the first key is stored
+ClientRoster::PeerKeys& ClientRoster::keys(const Handle handle)
+{
+    if (_keySlots[handle] == NO_KEYS)
+    {
+        _keySlots[handle] = static_cast<uint32_t>(_keys.size());
+        _keys.emplace_back();
+    }
+    return _keys[_keySlots[handle]];
+}
+
+bool ClientRoster::get(const ClientID& id, RosterClient& client) const
+{
+    const Handle h = handle(id);
+    if (h == INVALID_HANDLE)
+        return false;
+    copy(h, client);
+    return true;
+}
+
+bool ClientRoster::get(std::string_view username, RosterClient& client) const
+{
+    const Handle h = handle(username);
+    if (h == INVALID_HANDLE)
+        return false;
+    copy(h, client);
+    return true;
+}
+
+void ClientRoster::copy(const Handle handle, RosterClient& client) const
+{
+    client = RosterClient();
+    client.id = _ids[handle];
+    client.username = std::string(username(handle));
+    if (const PublicKey* key = publicKey(handle))
+    {
+        client.publicKey = *key;
+        client.publicKeySet = true;
+    }
+    if (const SymmetricKey* key = symmetricKey(handle))
+    {
+        client.symmetricKey = *key;
+        client.symmetricKeySet = true;
+    }
+    client.messageVersion = messageVersion(handle);
+}
+
+//This function takes the list the server sent, key material of the users found in both lists is carried over
+ClientRoster::MergeResult ClientRoster::merge(ClientRoster&& fresh)
+{
+    MergeResult result;
+    result.initial = empty();
+
+    for (Handle h = 0; h < fresh.size(); ++h)
+    {
+        const Handle known = handle(fresh._ids[h]);
+        if (known == INVALID_HANDLE)
+        {
+            result.added.push_back(Change{ fresh._ids[h], std::string(fresh.username(h)) });
+            continue;
+        }
+        if (const PublicKey* key = publicKey(known))
+            fresh.setPublicKey(h, *key);
+        if (const SymmetricKey* key = symmetricKey(known))
+            fresh.setSymmetricKey(h, *key);
+        fresh.setMessageVersion(h, messageVersion(known));
+    }
+    for (Handle h = 0; h < size(); ++h)
+    {
+        if (fresh.handle(_ids[h]) == INVALID_HANDLE)
+            result.removed.push_back(Change{ _ids[h], std::string(username(h)) });
+    }
+
+    carrySortedOrder(fresh);
+    *this = std::move(fresh);
+    return result;
+}
+
+//This function sorts fresh by name reusing our order: users in both lists keep their relative order,
+//only the users that joined are sorted and merged in.
+void ClientRoster::carrySortedOrder(ClientRoster& fresh) const
+{
+    if (!_sortedValid || fresh._sortedValid)
+        return;
+
+    std::vector<Handle> kept;
+    std::vector<uint8_t> isKept(fresh.size(), 0);
+    kept.reserve(fresh.size());
+    for (const Handle h : _sorted)
+    {
+        const Handle other = fresh.handle(_ids[h]);
+        if (other != INVALID_HANDLE && !isKept[other] && fresh.username(other) == username(h))
+        {
+            kept.push_back(other);
+            isKept[other] = 1;
+        }
+    }
+    std::vector<Handle> added;
+    added.reserve(fresh.size() - kept.size());
+    for (Handle h = 0; h < fresh.size(); ++h)
+    {
+        if (!isKept[h])
+            added.push_back(h);
+    }
+
+    const auto less = [&fresh](Handle left, Handle right) { return fresh.nameLess(left, right); };
+    std::sort(added.begin(), added.end(), less);
+    fresh._sorted.resize(fresh.size());
+    std::merge(kept.begin(), kept.end(), added.begin(), added.end(), fresh._sorted.begin(), less);
+    fresh._sortedValid = true;
+}
+
+bool ClientRoster::nameLess(const Handle left, const Handle right) const
+{
+    const int order = username(left).compare(username(right));
+    return order < 0 || (order == 0 && left < right);
+}
+
+const std::vector<ClientRoster::Handle>& ClientRoster::sortedHandles() const
+{
+    if (!_sortedValid)
+    {
+        _sorted.resize(size());
+        for (Handle h = 0; h < size(); ++h)
+            _sorted[h] = h;
+        std::sort(_sorted.begin(), _sorted.end(), [this](Handle left, Handle right) { return nameLess(left, right); });
+        _sortedValid = true;
+    }
+    return _sorted;
+}
+
+//This function finds the names starting with prefix with two binary searches over the name order
+std::pair<size_t, size_t> ClientRoster::prefixRange(std::string_view prefix) const
+{
+    const std::vector<Handle>& sorted = sortedHandles();
+    const auto first = std::lower_bound(sorted.begin(), sorted.end(), prefix,
+        [this](Handle h, std::string_view value) { return username(h) < value; });
+    const auto last = std::upper_bound(first, sorted.end(), prefix,
+        [this](std::string_view value, Handle h) { return value < username(h).substr(0, value.size()); });
+    return std::make_pair(static_cast<size_t>(first - sorted.begin()), static_cast<size_t>(last - sorted.begin()));
+}
+
+//The first and the last name of the range share the prefix the whole range shares
+std::string ClientRoster::complete(std::string_view prefix) const
+{
+    const std::pair<size_t, size_t> range = prefixRange(prefix);
+    if (range.first == range.second)
+        return std::string(prefix);
+    const std::string_view first = username(sortedAt(range.first));
+    const std::string_view last = username(sortedAt(range.second - 1));
+    size_t common = prefix.size();
+    while (common < first.size() && common < last.size() && first[common] == last[common])
+        ++common;
+    return std::string(first.substr(0, common));
+}
+
+void ClientRoster::clear()
+{
+    _ids.clear();
+    _nameOffsets.clear();
+    _names.clear();
+    _flags.clear();
+    _keySlots.clear();
+    _keys.clear();
+    _idIndex.clear();
+    _nameIndex.clear();
+    _sorted.clear();
+    _sortedValid = false;
+}
+
+void ClientRoster::reserve(const size_t count, const size_t nameBytes)
+{
+    _ids.reserve(count);
+    _nameOffsets.reserve(count + 1);
+    _names.reserve(nameBytes);
+    _flags.reserve(count);
+    _keySlots.reserve(count);
+
+    size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity *= 2;
+    if (capacity > _idIndex.size())
+        rehash(capacity);
+}
+
+size_t ClientRoster::memoryUsage() const
+{
+    return _ids.capacity() * sizeof(ClientID) +
+        _nameOffsets.capacity() * sizeof(uint32_t) +
+        _names.capacity() +
+        _flags.capacity() +
+        _keySlots.capacity() * sizeof(uint32_t) +
+        _keys.capacity() * sizeof(PeerKeys) +
+        (_idIndex.capacity() + _nameIndex.capacity() + _sorted.capacity()) * sizeof(Handle);
+}
+
+//This function resizes both lookup tables and puts every user back in
+void ClientRoster::rehash(const size_t capacity)
+{
+    _idIndex.assign(capacity, INVALID_HANDLE);
+    _nameIndex.assign(capacity, INVALID_HANDLE);
+    for (Handle h = 0; h < _ids.size(); ++h)
+        insertIndexes(h);
+}
+
+void ClientRoster::insertIndexes(const Handle handle)
+{
+    const size_t mask = _idIndex.size() - 1;
+    size_t slot = idSlot(_ids[handle], mask);
+    while (_idIndex[slot] != INVALID_HANDLE)
+        slot = (slot + 1) & mask;
+    _idIndex[slot] = handle;
+
+    // a name that is already taken keeps pointing at its first user
+    const std::string_view name = username(handle);
+    slot = nameSlot(name, mask);
+    while (_nameIndex[slot] != INVALID_HANDLE)
+    {
+        if (username(_nameIndex[slot]) == name)
+            return;
+        slot = (slot + 1) & mask;
+    }
+    _nameIndex[slot] = handle;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "protocol.h"
+
+//A peer as the client knows it, with the keys exchanged with it so far. The roster hands out copies of this.
+struct RosterClient
+{
+    ClientID id;
+    std::string username;
+    PublicKey publicKey;
+    bool publicKeySet = false;
+    SymmetricKey symmetricKey;
+    bool symmetricKeySet = false;
+    uint8_t messageVersion = MESSAGE_VERSION_CBC;   // newest message format the user announced
+};
+
+//This class holds the users list column by column: ids, names in one arena and keys only for the users that have some.
+//Users are addressed by a handle, both lookups (by id and by username) are open addressing tables of handles.
+//A list of the handles sorted by name answers prefix queries, it is built on first use and carried over by merge.
+class ClientRoster
+{
+public:
+    typedef uint32_t Handle;
+    static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+    struct Change
+    {
+        ClientID id;
+        std::string username;
+    };
+
+    // what a users list refresh changed, initial is set when the roster was empty before
+    struct MergeResult
+    {
+        std::vector<Change> added;
+        std::vector<Change> removed;
+        bool initial = false;
+    };
+
+    ClientRoster() = default;
+
+    // returns the handle of the user, an id that is already known keeps its entry
+    Handle add(const ClientID& id, std::string_view username);
+
+    // replaces the roster with count records of a users list response (id + NUL padded name)
+    void assign(const uint8_t* records, const size_t count);
+
+    Handle handle(const ClientID& id) const;
+    Handle handle(std::string_view username) const;
+
+    const ClientID& id(const Handle handle) const { return _ids[handle]; }
+    std::string_view username(const Handle handle) const;
+    // nullptr if no key was exchanged with the user yet
+    const PublicKey* publicKey(const Handle handle) const;
+    const SymmetricKey* symmetricKey(const Handle handle) const;
+    void setPublicKey(const Handle handle, const PublicKey& key);
+    void setSymmetricKey(const Handle handle, const SymmetricKey& key);
+    // forgets both keys and the message version, as for a user seen for the first time
+    void clearKeys(const Handle handle);
+    // MESSAGE_VERSION_CBC until the user announces a newer one
+    uint8_t messageVersion(const Handle handle) const;
+    void setMessageVersion(const Handle handle, const uint8_t version);
+
+    // copy of the user with its keys, false if the user is not in the roster
+    bool get(const ClientID& id, RosterClient& client) const;
+    bool get(std::string_view username, RosterClient& client) const;
+
+    // replaces the roster with fresh, users that are still there keep their keys
+    MergeResult merge(ClientRoster&& fresh);
+
+    // users whose name starts with prefix are positions [first, second) of the name order
+    std::pair<size_t, size_t> prefixRange(std::string_view prefix) const;
+    Handle sortedAt(const size_t position) const { return sortedHandles()[position]; }
+    // the longest prefix all the names starting with prefix share, prefix itself if there is no match
+    std::string complete(std::string_view prefix) const;
+
+    void clear();
+    void reserve(const size_t count, const size_t nameBytes = 0);
+    size_t size() const { return _ids.size(); }
+    bool empty() const { return _ids.empty(); }
+    // bytes held by the columns and the indexes
+    size_t memoryUsage() const;
+
+    // length of a NUL padded name of at most maxLength characters, scanned 16 bytes at a time
+    static size_t nameLength(const uint8_t* name, const size_t maxLength);
+
+private:
+    enum Flags : uint8_t
+    {
+        PUBLIC_KEY_SET    = 1,
+        SYMMETRIC_KEY_SET = 2,
+        AEAD_MESSAGES     = 4
+    };
+    static constexpr uint32_t NO_KEYS = UINT32_MAX;
+
+    struct PeerKeys
+    {
+        PublicKey publicKey;
+        SymmetricKey symmetricKey;
+    };
+
+    void copy(const Handle handle, RosterClient& client) const;
+    PeerKeys& keys(const Handle handle);
+    void rehash(const size_t capacity);
+    void insertIndexes(const Handle handle);
+    const std::vector<Handle>& sortedHandles() const;
+    void carrySortedOrder(ClientRoster& fresh) const;
+    bool nameLess(const Handle left, const Handle right) const;
+
+private:
+    std::vector<ClientID> _ids;
+    std::vector<uint32_t> _nameOffsets;   // size() + 1 entries, name i is [_nameOffsets[i], _nameOffsets[i + 1]) of _names
+    std::vector<char>     _names;
+    std::vector<uint8_t>  _flags;
+    std::vector<uint32_t> _keySlots;      // index into _keys, NO_KEYS until the first key of the user is stored
+    std::vector<PeerKeys> _keys;
+    std::vector<Handle>   _idIndex;       // power of two sized, INVALID_HANDLE marks a free slot
+    std::vector<Handle>   _nameIndex;
+    mutable std::vector<Handle> _sorted;  // handles in name order, valid only if _sortedValid
+    mutable bool          _sortedValid = false;
+};
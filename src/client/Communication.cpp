@@ -1,13 +1,30 @@
 ﻿#include "Communication.h"
 #include "SocketHandler.h"
 #include "FileOperations.h"
+#include "WireCodec.h"
+#include "PendingMessageParser.h"
+#include "Encoder.h"
+#include "AESCipherCache.h"
+#include "RSAEncryptorCache.h"
+#include "PendingMessageDecoder.h"
+#include "AEADMessage.h"
+#include <sha.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <boost/filesystem.hpp>
 
 #define PACKET_SIZE 1024
 
 //constuctor
-Communication::Communication(SocketHandler* socketHandler, std::shared_ptr<FileOperations> fileHandler)
+Communication::Communication(SocketHandler* socketHandler, std::shared_ptr<FileOperations> fileHandler,
+    AESCipherCache* aesCiphers, RSAEncryptorCache* rsaEncryptors)
     :socketHandler(socketHandler)
     , fileHandler(std::move(fileHandler))
+    , aesCiphers(aesCiphers)
+    , rsaEncryptors(rsaEncryptors)
 {
 }
 
@@ -19,7 +36,9 @@ bool Communication::validateHeader(const RESHeader& header, const RSPCode expect
         error = "response code  " + std::to_string(RESPONSE_GENERAL_ERROR) + " - general error.";
         return false;
     }
-    if (header.code != expectedCode)
+    // a conditional users list request may be answered with "not modified"
+    const bool notModified = (expectedCode == RESPONSE_USERS_LIST && header.code == RESPONSE_USERS_LIST_NOT_MODIFIED);
+    if (header.code != expectedCode && !notModified)
     {
         error = "Unexpected response code " + std::to_string(header.code) +
             " received. Expected code was " + std::to_string(expectedCode);
@@ -37,6 +56,9 @@ bool Communication::validateHeader(const RESHeader& header, const RSPCode expect
     case RESPONSE_MSG_SENT_TO_SERVER:
         expectedSize = sizeof(RESMessageSend) - sizeof(RESHeader);
         break;
+    case RESPONSE_USERS_LIST_NOT_MODIFIED:
+        expectedSize = 0;
+        break;
     default:
         return true;  // variable payload size.
     }
@@ -49,13 +71,37 @@ bool Communication::validateHeader(const RESHeader& header, const RSPCode expect
     return true;
 }
 
+// This function sends the request on the borrowed connection and reads and validates the response header
+bool Communication::sendRequestAndReceiveHeader(const uint8_t* request, size_t reqSize,
+    const RSPCode expectedCode, RESHeader& response, std::string& error)
+{
+    uint8_t headerBytes[WireCodec::size<RESHeader>()];
+    if (!socketHandler->send(request, reqSize))
+    {
+        error = "Failed sending request to server on SocketHandler";
+        return false;
+    }
+    // read exactly the header, then exactly the payload it announces
+    if (!socketHandler->receive(headerBytes, sizeof(headerBytes)))
+    {
+        error = "Failed receiving response header from server on SocketHandler";
+        return false;
+    }
+    WireCodec::decode(headerBytes, response);
+    if (!validateHeader(response, expectedCode, error))
+    {
+        error = "Received unexpected response code from server on SocketHandler";
+        return false;
+    }
+    return true;
+}
+
 //function to check if the payload is empty
 bool Communication::receiveUnknownPayload(const uint8_t* request, size_t reqSize,
     const RSPCode expectedCode,
-    uint8_t*& payload, size_t& size, std::string& error)
+    uint8_t*& payload, size_t& size, std::string& error, code_t* responseCode)
 {
     struct RESHeader response;
-    uint8_t buffer[PACKET_SIZE];
     payload = nullptr;
     size = 0;
     if (request == nullptr || reqSize == 0)
@@ -63,64 +109,79 @@ bool Communication::receiveUnknownPayload(const uint8_t* request, size_t reqSize
         error = "Invalid request was provided";
         return false;
     }
-    if (!socketHandler->connect())
+    ScopedConnection connection(*socketHandler);  // borrowed from the pool until we return
+    if (!connection.isConnected())
     {
         error = "Failed connecting to server on SocketHandler";
         return false;
     }
-    if (!socketHandler->send(request, reqSize))
+    if (!sendRequestAndReceiveHeader(request, reqSize, expectedCode, response, error))
+        return false;
+    if (responseCode != nullptr)
+        *responseCode = response.code;
+    if (response.payloadSize == 0)
+        return socketHandler->endMessage();  // no payload.
+    size = response.payloadSize;
+    payload = new uint8_t[size];
+    if (!socketHandler->receive(payload, size) || !socketHandler->endMessage())
     {
-        socketHandler->close();
-        error = "Failed sending request to server on SocketHandler";
+        error = "Failed receiving payload data from server on SocketHandler";
+        delete[] payload;
+        payload = nullptr;
+        size = 0;
         return false;
     }
-    if (!socketHandler->receive(buffer, sizeof(buffer)))
+    return true;
+}
+
+// Same as receiveUnknownPayload but the payload is handed to onChunk piece by piece while it arrives
+bool Communication::receiveStreamedPayload(const uint8_t* request, size_t reqSize,
+    const RSPCode expectedCode,
+    const std::function<bool(const uint8_t*, size_t)>& onChunk,
+    size_t& size, std::string& error)
+{
+    struct RESHeader response;
+    size = 0;
+    if (request == nullptr || reqSize == 0)
     {
-        error = "Failed receiving response header from server on SocketHandler";
+        error = "Invalid request was provided";
         return false;
     }
-    memcpy(&response, buffer, sizeof(RESHeader));
-    if (!validateHeader(response, expectedCode, error))
+    ScopedConnection connection(*socketHandler);
+    if (!connection.isConnected())
     {
-        error = "Received unexpected response code from server on SocketHandler";
+        error = "Failed connecting to server on SocketHandler";
         return false;
     }
-    if (response.payloadSize == 0)
-        return true;  // no payload.
+    if (!sendRequestAndReceiveHeader(request, reqSize, expectedCode, response, error))
+        return false;
+
     size = response.payloadSize;
-    payload = new uint8_t[size];
-    uint8_t* ptr = buffer + sizeof(RESHeader);
-    size_t recSize = sizeof(buffer) - sizeof(RESHeader);
-    if (recSize > size)
-        recSize = size;
-    memcpy(payload, ptr, recSize);
-    ptr = payload + recSize;
-    while (recSize < size)
-    {
-        size_t toRead = (size - recSize);
-        if (toRead > PACKET_SIZE)
-            toRead = PACKET_SIZE;
-        if (!socketHandler->receive(buffer, toRead))
+    std::vector<uint8_t> chunk(std::min<size_t>(size, STREAM_CHUNK_SIZE));
+    size_t received = 0;
+    while (received < size)
+    {
+        const size_t toRead = std::min(chunk.size(), size - received);
+        if (!socketHandler->receive(chunk.data(), toRead))
         {
             error = "Failed receiving payload data from server on SocketHandler";
-            delete[] payload;
-            payload = nullptr;
-            size = 0;
             return false;
         }
-        memcpy(ptr, buffer, toRead);
-        recSize += toRead;
-        ptr += toRead;
+        received += toRead;
+        if (!onChunk(chunk.data(), toRead))
+            return false;  // the consumer has set the error
     }
-    return true;
+    return socketHandler->endMessage();
 }
+
 //checks if the users list is valid
 bool Communication::requestUsersList(uint8_t*& payload, size_t& payloadSize, const ClientID& clientId, std::string& error)
 {
     REQUsersList request(clientId);
 
-    if (!receiveUnknownPayload(reinterpret_cast<const uint8_t*>(&request),
-        sizeof(request),
+    const auto requestBytes = WireCodec::encode(request);
+    if (!receiveUnknownPayload(requestBytes.data(),
+        requestBytes.size(),
         RESPONSE_USERS_LIST,
         payload,
         payloadSize,
@@ -134,69 +195,69 @@ bool Communication::requestUsersList(uint8_t*& payload, size_t& payloadSize, con
 
 /**
  * Sends a request to the server for the current users list that are connected,
- * coping the returned payload into a vector of client structures,if there are errors it handles them.
+ * parsing the returned payload into the roster,if there are errors it handles them.
+ * With ifNoneMatch the tag of the list we have is sent along, notModified is set if the server says it is still current.
  */
-bool Communication::requestAndParseClientsList(const ClientID& self, std::vector<MainLogic::Client>& clients, std::string& error)
+bool Communication::requestAndParseClientsList(const ClientID& self, const RosterETag* ifNoneMatch, ClientRoster& clients,
+    RosterETag& etag, bool& notModified, std::string& error)
 {
-
-    REQUsersList request(self);
-
-
     uint8_t* payload = nullptr;
     size_t payloadSize = 0;
+    code_t responseCode = 0;
+    notModified = false;
 
-
-    if (!receiveUnknownPayload(reinterpret_cast<const uint8_t*>(&request),
-        sizeof(request),
-        RESPONSE_USERS_LIST,
-        payload,
-        payloadSize,
-        error))
+    bool received = false;
+    if (ifNoneMatch != nullptr)
     {
+        REQUsersListConditional request(self);
+        request.payload = *ifNoneMatch;
+        request.header.payloadSize = sizeof(request.payload);
+        const auto requestBytes = WireCodec::encode(request);
+        received = receiveUnknownPayload(requestBytes.data(), requestBytes.size(), RESPONSE_USERS_LIST,
+            payload, payloadSize, error, &responseCode);
+    }
+    else
+    {
+        REQUsersList request(self);
+        const auto requestBytes = WireCodec::encode(request);
+        received = receiveUnknownPayload(requestBytes.data(), requestBytes.size(), RESPONSE_USERS_LIST,
+            payload, payloadSize, error, &responseCode);
+    }
+    if (!received)
         return false;
+    if (responseCode == RESPONSE_USERS_LIST_NOT_MODIFIED)
+    {
+        notModified = true;
+        return true;
     }
 
+    const bool parsed = parseClientsList(payload, payloadSize, clients, etag, error);
+
+    //free the memory
+    delete[] payload;
+    return parsed;
+}
+
+
+bool Communication::parseClientsList(const uint8_t* payload, size_t payloadSize, ClientRoster& clients, RosterETag& etag,
+    std::string& error)
+{
     size_t recordSize = sizeof(ClientID) + CLIENT_NAME_SIZE;
 
 
     if (payloadSize == 0 || (payloadSize % recordSize) != 0)
     {
         error = "invalid size on the useres list that has been received";
-        delete[] payload;
         return false;
     }
 
-    // clean the previous users lisr
-    usersList.clear();
-
-    size_t count = payloadSize / recordSize;
-    uint8_t* ptr = payload; // point to the begging of the payload
-
-    for (size_t i = 0; i < count; ++i)
-    {
-        MainLogic::Client c;
-
-
-        memcpy(&c.id, ptr, sizeof(ClientID));
-        ptr += sizeof(ClientID);
-
-        // copy name of user
-        char nameBuf[CLIENT_NAME_SIZE] = { 0 };
-        memcpy(nameBuf, ptr, CLIENT_NAME_SIZE - 1);
-        ptr += CLIENT_NAME_SIZE;
-
-
-        c.username = nameBuf;
-
-        //add the client to the list
-        usersList.push_back(c);
-    }
-
-    //update the clients list
-    clients = usersList;
+    // same tag the server computes, a truncated SHA-256 of the payload
+    uint8_t digest[CryptoPP::SHA256::DIGESTSIZE];
+    CryptoPP::SHA256().CalculateDigest(digest, payload, payloadSize);
+    memcpy(etag.tag, digest, ROSTER_ETAG_SIZE);
 
-    //free the memory
-    delete[] payload;
+    // the previous users list is replaced, names go straight from the payload into the roster's arena
+    clients.assign(payload, payloadSize / recordSize);
     return true;
 }
 
@@ -221,21 +282,30 @@ bool Communication::sendAndEncryptMessage(
             error = "Missing symmetric key.";
             return false;
         }
-        AESWrapper aes(*symmetricKey);
-        encryptedData = aes.encrypt(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        encryptedData.resize(AESWrapper::cipherSize(data.size()));
+        aesCiphers->encrypt(targetId, *symmetricKey, reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+            reinterpret_cast<uint8_t*>(&encryptedData[0]));
     }
     else if (type == MSG_SEND_TEXT) {
         if (!symmetricKey) {
             error = "Missing symmetric key.";
             return false;
         }
-        AESWrapper aes(*symmetricKey);
-        encryptedData = aes.encrypt(data);
+        encryptedData.resize(AESWrapper::cipherSize(data.size()));
+        aesCiphers->encrypt(targetId, *symmetricKey, reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+            reinterpret_cast<uint8_t*>(&encryptedData[0]));
+    }
+    else if (type == MSG_SEND_TEXT_AEAD) {
+        if (!symmetricKey) {
+            error = "Missing symmetric key.";
+            return false;
+        }
+        encryptedData = AEADMessage::seal(*symmetricKey, reinterpret_cast<const uint8_t*>(data.data()), data.size());
     }
     // Handle symmetric key exchange messages
     else if (type == MSG_SYMMETRIC_KEY_REQUEST) {
-        // According to the original logic, a symmetric key request has no payload.
-        encryptedData = "";
+        // The newest message format this client reads, clients from before it ignore the payload of a request.
+        encryptedData = std::string(1, static_cast<char>(MESSAGE_VERSION));
     }
     else if (type == MSG_SYMMETRIC_KEY_SEND) {
         if (!symmetricKey) {
@@ -246,9 +316,8 @@ bool Communication::sendAndEncryptMessage(
             error = "Missing target's public key.";
             return false;
         }
-        // Encrypt the symmetric key (raw bytes) using the target's public key.
-        RSAPublicWrapper rsa(*publicKey);
-        encryptedData = rsa.encrypt(reinterpret_cast<const uint8_t*>(symmetricKey->symmetricKey), SYMMETRIC_KEY_SIZE);
+        // Encrypt the symmetric key (raw bytes) using the target's public key, parsed once per peer.
+        encryptedData = rsaEncryptors->get(targetId, *publicKey)->encrypt(reinterpret_cast<const uint8_t*>(symmetricKey->symmetricKey), SYMMETRIC_KEY_SIZE);
     }
     else {
         error = "Unexpected message type.";
@@ -261,19 +330,202 @@ bool Communication::sendAndEncryptMessage(
     request.payloadHeader.contentSize = encryptedData.size();
     request.header.payloadSize = sizeof(request.payloadHeader) + encryptedData.size();
 
-    size_t totalSize = sizeof(request) + encryptedData.size();
-    std::vector<uint8_t> buffer(totalSize);
-    memcpy(buffer.data(), &request, sizeof(request));
+    // header, payload header and ciphertext go out in one gather write, the ciphertext is not copied again
+    const auto headerBytes = WireCodec::encode(request.header);
+    const auto payloadHeaderBytes = WireCodec::encode(request.payloadHeader);
+    BufferList buffers;
+    buffers.push_back(boost::asio::buffer(headerBytes));
+    buffers.push_back(boost::asio::buffer(payloadHeaderBytes));
     if (!encryptedData.empty())
-        memcpy(buffer.data() + sizeof(request), encryptedData.data(), encryptedData.size());
+        buffers.push_back(boost::asio::buffer(encryptedData.data(), encryptedData.size()));
 
     RESMessageSend response;
-    bool ok = socketHandler->sendReceive(buffer.data(), totalSize,
-        reinterpret_cast<uint8_t*>(&response), sizeof(response));
+    uint8_t responseBytes[WireCodec::size<RESMessageSend>()] = { 0 };
+    bool ok = socketHandler->sendReceive(buffers, responseBytes, sizeof(responseBytes));
     if (!ok) {
         error = "Failed sending message.";
         return false;
     }
+    WireCodec::decode(responseBytes, response);
+    if (response.payload.clientId != targetId) {
+        error = "Client ID mismatch.";
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Sends length bytes of source, starting at offset, as one encrypted message.
+ * The file is encrypted in FILE_CHUNK_SIZE chunks straight from its mapped pages, the next chunk is prepared
+ * on another thread while the current one is written to the socket, so only two chunks are ever in memory.
+ * part is written in the clear in front of the ciphertext of a MSG_SEND_FILE_PART.
+ * A MSG_SEND_FILE_AEAD is sealed in AEAD chunks instead, the chunks of a file chunk are sealed on several threads.
+ */
+bool Communication::sendFileContent(const ClientID& selfId, const ClientID& targetId, const MSGType type,
+    FileSource& source, const uint64_t offset, const uint64_t length, const FilePartHeader* part,
+    const SymmetricKey& symmetricKey, std::string& error)
+{
+    static_assert(FILE_CHUNK_SIZE % (static_cast<size_t>(1) << AEAD_CHUNK_SHIFT) == 0, "file chunks are whole AEAD chunks");
+    const bool aead = (type == MSG_SEND_FILE_AEAD);
+    const AEADMessage sealer(symmetricKey, aead ? AEADMessage::header(length) : AEADHeader());
+    const size_t partHeaderSize = (part != nullptr) ? WireCodec::size<FilePartHeader>() : 0;
+    const uint64_t contentSize = partHeaderSize + (aead ?
+        WireCodec::size<AEADHeader>() + AEADMessage::sealedSize(sealer.getHeader()) :
+        AESWrapper::cipherSize(static_cast<size_t>(length)));
+    const uint64_t maxContentSize = std::numeric_limits<csize_t>::max() - WireCodec::size<REQSendMessagePayloadHeader>();
+    if (length > FILE_PART_SIZE || contentSize > maxContentSize) {
+        error = "File content is too large for a single message.";
+        return false;
+    }
+
+    REQSendMessage request(selfId, type);
+    request.payloadHeader.clientId = targetId;
+    request.payloadHeader.contentSize = static_cast<csize_t>(contentSize);
+    request.header.payloadSize = static_cast<csize_t>(WireCodec::size<REQSendMessagePayloadHeader>() + contentSize);
+
+    const auto headerBytes = WireCodec::encode(request.header);
+    const auto payloadHeaderBytes = WireCodec::encode(request.payloadHeader);
+    const auto aeadHeaderBytes = WireCodec::encode(sealer.getHeader());
+    uint8_t partHeaderBytes[WireCodec::size<FilePartHeader>()] = { 0 };
+    BufferList buffers;
+    buffers.push_back(boost::asio::buffer(headerBytes));
+    buffers.push_back(boost::asio::buffer(payloadHeaderBytes));
+    if (part != nullptr) {
+        WireCodec::encode(*part, partHeaderBytes);
+        buffers.push_back(boost::asio::buffer(partHeaderBytes));
+    }
+    if (aead)
+        buffers.push_back(boost::asio::buffer(aeadHeaderBytes));
+
+    // plain is only needed when the file is not mapped, each cipher chunk has room for the padding block of the last one
+    // or for the tags of its AEAD chunks
+    const size_t cipherRoom = FILE_CHUNK_SIZE + (aead ? (FILE_CHUNK_SIZE >> AEAD_CHUNK_SHIFT) * AEADMessage::TAG_SIZE : AESWrapper::BLOCK_SIZE);
+    std::vector<uint8_t> plain[2];
+    std::vector<uint8_t> cipher[2] = { std::vector<uint8_t>(cipherRoom), std::vector<uint8_t>(cipherRoom) };
+    const std::shared_ptr<const AESWrapper> aes = aesCiphers->get(targetId, symmetricKey);
+    AESStreamEncryptor encryptor(*aes);
+    uint64_t remaining = length;
+
+    auto scratch = [&](const int slot) -> uint8_t* {
+        if (!source.isMapped() && plain[slot].empty())
+            plain[slot].resize(FILE_CHUNK_SIZE);
+        return plain[slot].data();
+    };
+
+    // encrypts the next chunk into slot, returns the cipher bytes or 0 on a read error
+    auto produce = [&](const int slot) -> size_t {
+        const size_t toRead = static_cast<size_t>(std::min<uint64_t>(remaining, FILE_CHUNK_SIZE));
+        const uint64_t position = offset + (length - remaining);
+        const uint8_t* data = nullptr;
+        if (toRead > 0) {
+            data = source.read(position, toRead, scratch(slot));
+            if (data == nullptr && !source.isMapped())  // the mapping gave out, the rest of the file is read
+                data = source.read(position, toRead, scratch(slot));
+            if (data == nullptr)
+                return 0;
+        }
+        remaining -= toRead;
+        if (aead) {
+            const uint64_t first = (position - offset) >> AEAD_CHUNK_SHIFT;
+            const uint64_t count = std::max<uint64_t>(1, (toRead + sealer.chunkSize() - 1) >> AEAD_CHUNK_SHIFT);
+            sealer.sealChunks(first, count, data, cipher[slot].data());
+            return toRead + static_cast<size_t>(count) * AEADMessage::TAG_SIZE;
+        }
+        if (remaining > 0) {
+            encryptor.update(data, toRead, cipher[slot].data());
+            return toRead;
+        }
+        return encryptor.final(data, toRead, cipher[slot].data());
+    };
+
+    ScopedConnection connection(*socketHandler);
+    if (!connection.isConnected()) {
+        error = "Failed connecting to the server.";
+        return false;
+    }
+
+    // one producer thread reads and encrypts chunk N + 1 while chunk N goes out, the two slots take turns
+    std::mutex handoff;
+    std::condition_variable changed;
+    bool full[2] = { false, false };
+    size_t cipherBytes[2] = { 0, 0 };
+    bool finished = false;  // the producer filled its last slot
+    bool stop = false;      // the sender gave up
+    std::thread producer([&]() {
+        for (int slot = 0; ; slot = 1 - slot) {
+            {
+                std::unique_lock<std::mutex> lock(handoff);
+                changed.wait(lock, [&]() { return !full[slot] || stop; });
+                if (stop)
+                    break;
+            }
+            size_t bytes = 0;
+            try {
+                bytes = produce(slot);
+            }
+            catch (...) {
+                bytes = 0;  // seen as a read error
+            }
+            std::lock_guard<std::mutex> lock(handoff);
+            cipherBytes[slot] = bytes;
+            full[slot] = true;
+            finished = (bytes == 0 || remaining == 0);
+            changed.notify_all();
+            if (finished)
+                break;
+        }
+        std::lock_guard<std::mutex> lock(handoff);
+        finished = true;
+        changed.notify_all();
+    });
+
+    bool written = true;
+    for (int slot = 0; written; slot = 1 - slot) {
+        size_t bytes = 0;
+        {
+            std::unique_lock<std::mutex> lock(handoff);
+            changed.wait(lock, [&]() { return full[slot] || finished; });
+            if (!full[slot])
+                break;
+            bytes = cipherBytes[slot];
+        }
+        if (bytes == 0)
+            break;
+        buffers.push_back(boost::asio::buffer(cipher[slot].data(), bytes));
+        written = socketHandler->write(buffers);
+        buffers.clear();
+
+        std::lock_guard<std::mutex> lock(handoff);
+        full[slot] = false;
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(handoff);
+        stop = true;
+        changed.notify_all();
+    }
+    producer.join();
+    if (!written) {
+        error = "Failed sending file content.";
+        return false;
+    }
+    if (remaining > 0) {
+        socketHandler->abort();
+        error = "Failed reading the file.";
+        return false;
+    }
+
+    RESMessageSend response;
+    uint8_t responseBytes[WireCodec::size<RESMessageSend>()] = { 0 };
+    if (!socketHandler->endSend(WireCodec::size<REQSendMessage>() + static_cast<size_t>(contentSize)) ||
+        !socketHandler->receiveResponse(responseBytes, sizeof(responseBytes))) {
+        error = "Failed sending message.";
+        return false;
+    }
+    WireCodec::decode(responseBytes, response);
+    if (!validateHeader(response.header, RESPONSE_MSG_SENT_TO_SERVER, error))
+        return false;
     if (response.payload.clientId != targetId) {
         error = "Client ID mismatch.";
         return false;
@@ -289,21 +541,15 @@ bool Communication::sendAndEncryptMessage(
  * This function searches the locally stored users list for the provided username.
  * If found, it extracts the corresponding ClientID and then sends a request to obtain
  */
-bool Communication::requestAndParsePublicKey(const ClientID& selfId, const std::string& username, ClientID& clientId, PublicKey& publicKey, std::string& error)
+bool Communication::requestAndParsePublicKey(const ClientID& selfId, const ClientRoster& roster, const std::string& username, ClientID& clientId, PublicKey& publicKey, std::string& error)
 {
     // search for the user in a local users list
-    bool found = false;
-    for (const auto& client : usersList) {
-        if (client.username == username) {
-            clientId = client.id;
-            found = true;
-            break;
-        }
-    }
-    if (!found) {
+    const ClientRoster::Handle client = roster.handle(username);
+    if (client == ClientRoster::INVALID_HANDLE) {
         error = "Username '" + username + "' not found.";
         return false;
     }
+    clientId = roster.id(client);
 
     // Send a request for the target user's public key
     uint8_t* payload = nullptr;
@@ -323,8 +569,10 @@ bool Communication::requestAndParsePublicKey(const ClientID& selfId, const std::
     }
 
     // copy returned ClientID and PublicKey
-    std::memcpy(&clientId, payload, sizeof(ClientID));
-    std::memcpy(&publicKey, payload + sizeof(ClientID), sizeof(PublicKey));
+    RESPublicKeyPayload keyPayload;
+    WireCodec::decode(payload, keyPayload);
+    clientId = keyPayload.clientId;
+    publicKey = keyPayload.clientPublicKey;
 
     delete[] payload;
     return true;
@@ -338,8 +586,9 @@ bool Communication::requestClientPublicKey(const ClientID& selfId, const ClientI
     request.payload = targetClientId;
     request.header.payloadSize = sizeof(request.payload);
 
-    if (!receiveUnknownPayload(reinterpret_cast<const uint8_t*>(&request),
-        sizeof(request),
+    const auto requestBytes = WireCodec::encode(request);
+    if (!receiveUnknownPayload(requestBytes.data(),
+        requestBytes.size(),
         RESPONSE_PUBLIC_KEY,
         payload,
         payloadSize,
@@ -352,157 +601,300 @@ bool Communication::requestClientPublicKey(const ClientID& selfId, const ClientI
 }
 
 
-//this function  gets pending messages for the user it sends
+//this function  gets pending messages for the user, every message is handled as soon as it has arrived.
+//key messages are applied in order on this thread, text is decrypted when the message is read.
 bool Communication::requestAndParsePendingMessages(
     const ClientID& selfId,
     std::vector<MainLogic::Message>& messages,
-    std::vector<MainLogic::Client>& clients,
+    const ClientRoster& clients,
     RSAPrivateWrapper* rsaDecryptor,
     std::function<bool(const ClientID&, const SymmetricKey&)> setSymmetricKey,
+    std::function<void(const ClientID&, uint8_t)> setMessageVersion,
     std::string& error)
 {
     REQMessages request(selfId);
-    uint8_t* payload = nullptr;
     size_t payloadSize = 0;
+    messages.clear();
 
-    if (!receiveUnknownPayload(reinterpret_cast<const uint8_t*>(&request),
-        sizeof(request),
+    PendingMessageDecoder decoder(*aesCiphers);
+    PendingMessageParser parser([&](const PendingMessageRecord& record) {
+        return handlePendingMessage(record, decoder, clients, rsaDecryptor, setSymmetricKey, setMessageVersion, error);
+    });
+    // files go to disk as they arrive instead of being assembled in memory
+    parser.streamRecords(
+        [](const PendingMessage& header) { return header.messageType == MSG_SEND_FILE || header.messageType == MSG_SEND_FILE_AEAD; },
+        [&](const PendingMessage& header, const ByteView& piece, uint64_t offset, bool last) {
+            return handleFilePiece(header, piece, offset, last, decoder, clients, setMessageVersion);
+        });
+
+    const auto requestBytes = WireCodec::encode(request);
+    const bool received = receiveStreamedPayload(requestBytes.data(),
+        requestBytes.size(),
         RESPONSE_PULL_PENDING_MSGS,
-        payload,
+        [&parser](const uint8_t* chunk, size_t size) { return parser.feed(chunk, size); },
         payloadSize,
-        error))
-    {
+        error);
+    decoder.finish(messages);
+    if (!received)
         return false;
-    }
 
-    if (payloadSize == 0 || payload == nullptr)
+    if (payloadSize == 0)
     {
         error = "No pending messages available.";
-        delete[] payload;
         return false;
     }
+    if (!parser.finish())
+    {
+        error = "Invalid pending messages payload size.";
+        return false;
+    }
+    return true;
+}
 
-    size_t parsedBytes = 0;
-    uint8_t* ptr = payload;
-    messages.clear();
-    while (parsedBytes < payloadSize)
+
+// This function decrypts / applies one pending message, returns false on an error that stops the pull
+bool Communication::handlePendingMessage(const PendingMessageRecord& record,
+    PendingMessageDecoder& decoder,
+    const ClientRoster& clients,
+    RSAPrivateWrapper* rsaDecryptor,
+    const std::function<bool(const ClientID&, const SymmetricKey&)>& setSymmetricKey,
+    const std::function<void(const ClientID&, uint8_t)>& setMessageVersion,
+    std::string& error)
+{
+    const PendingMessage& pendingMsg = record.header;
+    const uint8_t* const content = record.content.data;
+
+    // refer to the sender by handle instead of copying it with its keys
+    MainLogic::Message message;
+    message.senderId = pendingMsg.clientId;
+    const ClientRoster::Handle sender = clients.handle(pendingMsg.clientId);
+    const bool knownSender = (sender != ClientRoster::INVALID_HANDLE);
+    if (knownSender)
+        message.username = std::string(clients.username(sender));
+
+    switch (pendingMsg.messageType)
+    {
+    case MSG_SYMMETRIC_KEY_REQUEST:
+    {
+        // No payload to decrypt – just register the request.
+        message.content = "Request for symmetric key.";
+        decoder.add(std::move(message));
+        // A request starts a new key, it carries the newest message format the sender reads, none from older clients.
+        if (knownSender)
+            setMessageVersion(pendingMsg.clientId, record.content.empty() ? MESSAGE_VERSION_CBC : content[0]);
+        break;
+    }
+    case MSG_SYMMETRIC_KEY_SEND:
     {
-        if (payloadSize - parsedBytes < sizeof(PendingMessage))
+        if (record.content.empty())
         {
-            error = "Invalid pending messages payload size.";
-            delete[] payload;
-            return false;
+            error = "Can't decrypt symmetric key. Content length is 0.";
+            break;
         }
 
-        PendingMessage pendingMsg;
-        memcpy(&pendingMsg, ptr, sizeof(PendingMessage));
-        ptr += sizeof(PendingMessage);
-        parsedBytes += sizeof(PendingMessage);
-
-        MainLogic::Message message;
-        MainLogic::Client senderClient;
-        bool foundSender = false;
-        for (const auto& client : clients)
+        std::string key;
+        try {
+            key = rsaDecryptor->decrypt(content, record.content.size);
+        }
+        catch (...)
         {
-            if (memcmp(&client.id, &pendingMsg.clientId, sizeof(ClientID)) == 0)
-            {
-                message.username = client.username;
-                senderClient = client;
-                foundSender = true;
-                break;
-            }
+            error = "Failed to decrypt symmetric key.";
+            return false;
         }
 
-        switch (pendingMsg.messageType)
+        if (key.size() != SYMMETRIC_KEY_SIZE)
+        {
+            error = "Invalid symmetric key size.";
+            return false;
+        }
+        SymmetricKey symKey;
+        memcpy(symKey.symmetricKey, key.data(), SYMMETRIC_KEY_SIZE);
+        if (knownSender)
         {
-        case MSG_SYMMETRIC_KEY_REQUEST:
+            if (setSymmetricKey(pendingMsg.clientId, symKey))
+                message.content = "symmetric key received";
+            else
+                error = "Failed to store symmetric key for client.";
+            decoder.add(std::move(message));
+        }
+        else {
+            error = "Can't store symmetric key, sender unknown.";
+        }
+        break;
+    }
+    case MSG_SEND_TEXT:
+    {
+        if (record.content.empty())
         {
-            // No payload to decrypt – just register the request.
-            message.content = "Request for symmetric key.";
-            messages.push_back(message);
-            // Even if header->messageSize is non-zero, we follow the original logic.
-            parsedBytes += pendingMsg.messageSize;
-            ptr += pendingMsg.messageSize;
+            message.content = "Message with no content provided.";
             break;
         }
-        case MSG_SYMMETRIC_KEY_SEND:
+        message.content = "can't decrypt message"; // Default in case of failure
+        const SymmetricKey* key = knownSender ? clients.symmetricKey(sender) : nullptr;
+        if (key != nullptr)
         {
-            if (pendingMsg.messageSize == 0)
-            {
-                error = "Can't decrypt symmetric key. Content length is 0.";
-                parsedBytes += pendingMsg.messageSize;
-                ptr += pendingMsg.messageSize;
-                continue;
-            }
-
-            std::string key;
-            try {
-                key = rsaDecryptor->decrypt(ptr, pendingMsg.messageSize);
-            }
-            catch (...)
-            {
-                error = "Failed to decrypt symmetric key.";
-                delete[] payload;
-                return false;
-            }
-
-            if (key.size() != SYMMETRIC_KEY_SIZE)
-            {
-                error = "Invalid symmetric key size.";
-                delete[] payload;
-                return false;
-            }
-            SymmetricKey symKey;
-            memcpy(symKey.symmetricKey, key.data(), SYMMETRIC_KEY_SIZE);
-            if (foundSender)
-            {
-                if (setSymmetricKey(senderClient.id, symKey))
-                    message.content = "symmetric key received";
-                else
-                    error = "Failed to store symmetric key for client.";
-                messages.push_back(message);
-            }
-            else {
-                error = "Can't store symmetric key, sender unknown.";
-            }
-            parsedBytes += pendingMsg.messageSize;
-            ptr += pendingMsg.messageSize;
+            // the sender's key as of this message, a key message further down the queue does not apply to it
+            decoder.decrypt(std::move(message), pendingMsg.clientId, *key, content, record.content.size, false);
+            break;
+        }
+        decoder.add(std::move(message));
+        break;
+    }
+    case MSG_SEND_TEXT_AEAD:
+    {
+        message.content = "can't decrypt message";
+        const SymmetricKey* key = knownSender ? clients.symmetricKey(sender) : nullptr;
+        if (key == nullptr)
+        {
+            decoder.add(std::move(message));
             break;
         }
-        case MSG_SEND_TEXT:
-        case MSG_SEND_FILE:
+        // a peer that sends the format reads it
+        setMessageVersion(pendingMsg.clientId, MESSAGE_VERSION_AEAD);
+        decoder.decrypt(std::move(message), pendingMsg.clientId, *key, content, record.content.size, true);
+        break;
+    }
+    case MSG_SEND_FILE_PART:
+    {
+        const SymmetricKey* key = knownSender ? clients.symmetricKey(sender) : nullptr;
+        if (key == nullptr)
         {
-            if (pendingMsg.messageSize == 0)
-            {
-                message.content = "Message with no content provided.";
-                parsedBytes += pendingMsg.messageSize;
-                ptr += pendingMsg.messageSize;
-                break;
-            }
-            message.content = "can't decrypt message"; // Default in case of failure
-            if (foundSender && senderClient.symmetricKeySet)
-            {
-                try {
-                    AESWrapper aes(senderClient.symmetricKey);
-                    message.content = aes.decrypt(ptr, pendingMsg.messageSize);
-                }
-                catch (...) {
-                    message.content = "Decryption failed.";
-                }
-            }
-            messages.push_back(message);
-            parsedBytes += pendingMsg.messageSize;
-            ptr += pendingMsg.messageSize;
+            message.content = "can't decrypt file part";
+            decoder.add(std::move(message));
             break;
         }
-        default:
+        std::string path;
+        if (!storeFilePart(record, pendingMsg.clientId, *key, path, message.content))
         {
-            message.content = ""; // Corrupted or unknown message – do not store.
+            decoder.add(std::move(message));
             break;
         }
+        if (!path.empty())  // only the last part completes the file
+        {
+            message.content = "file received: " + path;
+            decoder.add(std::move(message));
         }
+        break;
     }
-    delete[] payload;
+    default:
+    {
+        message.content = ""; // Corrupted or unknown message – do not store.
+        break;
+    }
+    }
+    return true;
+}
+
+
+// This function starts a received file with the first piece of its ciphertext and passes the rest on to the decoder's writer
+bool Communication::handleFilePiece(const PendingMessage& header,
+    const ByteView& piece,
+    const uint64_t offset,
+    const bool last,
+    PendingMessageDecoder& decoder,
+    const ClientRoster& clients,
+    const std::function<void(const ClientID&, uint8_t)>& setMessageVersion)
+{
+    if (offset == 0)
+    {
+        MainLogic::Message message;
+        message.senderId = header.clientId;
+        const ClientRoster::Handle sender = clients.handle(header.clientId);
+        const SymmetricKey* key = nullptr;
+        if (sender != ClientRoster::INVALID_HANDLE)
+        {
+            message.username = std::string(clients.username(sender));
+            key = clients.symmetricKey(sender);
+        }
+        if (header.messageSize == 0)
+            return true;    // Message with no content provided.
+        if (key == nullptr)
+        {
+            message.content = "can't decrypt message";
+            decoder.add(std::move(message));
+            return true;
+        }
+        const std::string path = (boost::filesystem::path(fileHandler->getTempFolder()) /
+            (Encoder::bytesToHex(header.clientId.uuid, CLIENT_ID_SIZE) + "_message_" + std::to_string(header.messageId))).string();
+        const bool aead = (header.messageType == MSG_SEND_FILE_AEAD);
+        if (aead)
+            setMessageVersion(header.clientId, MESSAGE_VERSION_AEAD);
+        decoder.receiveFile(std::move(message), header.clientId, *key, path, aead);
+    }
+    decoder.fileData(piece.data, piece.size, last);
+    return true;
+}
+
+
+/**
+ * Decrypts one part of a large file and appends it to the file in the temp folder.
+ * The file on disk tells which part is expected next, so a transfer continues across pulls and restarts,
+ * a part that was sent again by a resumed upload is skipped. path is set once the last part was written.
+ */
+bool Communication::storeFilePart(const PendingMessageRecord& record, const ClientID& senderId,
+    const SymmetricKey& key, std::string& path, std::string& error)
+{
+    const size_t partHeaderSize = WireCodec::size<FilePartHeader>();
+    if (record.content.size < partHeaderSize)
+    {
+        error = "Invalid file part.";
+        return false;
+    }
+    FilePartHeader part;
+    WireCodec::decode(record.content.data, part);
+    if (part.partCount == 0 || part.partIndex >= part.partCount)
+    {
+        error = "Invalid file part.";
+        return false;
+    }
+
+    const std::string filePath = (boost::filesystem::path(fileHandler->getTempFolder()) /
+        (Encoder::bytesToHex(senderId.uuid, CLIENT_ID_SIZE) + "_" + std::to_string(part.transferId))).string();
+
+    // Look at the file before opening it: opening for writing without append truncates.
+    boost::system::error_code ec;
+    const bool exists = boost::filesystem::exists(filePath, ec);
+    const uint64_t storedBytes = exists ? boost::filesystem::file_size(filePath, ec) : 0;
+    if (ec)
+    {
+        error = "Couldn't read the size of " + filePath;
+        return false;
+    }
+    const uint64_t expectedOffset = static_cast<uint64_t>(part.partIndex) * FILE_PART_SIZE;
+    if (storedBytes > expectedOffset)
+        return true;  // already have this part
+    if (storedBytes < expectedOffset)
+    {
+        error = "File part " + std::to_string(part.partIndex) + " arrived before the parts preceding it.";
+        return false;
+    }
+
+    FileOperations file;
+    if (!file.open(filePath, true, exists))
+    {
+        error = "Couldn't open " + filePath;
+        return false;
+    }
+
+    std::vector<uint8_t> plain(record.content.size - partHeaderSize);
+    size_t plainSize = 0;
+    try {
+        plainSize = aesCiphers->decrypt(senderId, key, record.content.data + partHeaderSize,
+            plain.size(), plain.data());
+    }
+    catch (...) {
+        error = "Decryption failed.";
+        return false;
+    }
+    if (plainSize > 0 && !file.write(plain.data(), plainSize))
+    {
+        error = "Couldn't write " + filePath;
+        return false;
+    }
+    file.close();
+
+    if (part.partIndex + 1 == part.partCount)
+        path = filePath;
     return true;
 }
 
@@ -523,11 +915,14 @@ bool Communication::sendRegistrationRequest(const std::string& username, const s
     }
     memcpy(request.payload.clientPublicKey.publicKey, publicKey.data(), PUBLIC_KEY_SIZE);
 
-    if (!socketHandler->sendReceive(reinterpret_cast<uint8_t*>(&request), sizeof(request),
-        reinterpret_cast<uint8_t*>(&response), sizeof(response))) {
+    const auto requestBytes = WireCodec::encode(request);
+    uint8_t responseBytes[WireCodec::size<RESRegistration>()] = { 0 };
+    if (!socketHandler->sendReceive(requestBytes.data(), requestBytes.size(),
+        responseBytes, sizeof(responseBytes))) {
         error = "Communication with the server has failed in registration process.";
         return false;
     }
+    WireCodec::decode(responseBytes, response);
 
     if (!validateHeader(response.header, RESPONSE_REGISTRATION_SUCSSES, error)) {
         return false;
@@ -12,10 +12,18 @@
 #include "protocol.h"
 #include "MainLogic.h"
 #include "FileOperations.h"
+#include "FileSource.h"
 #include "RSAWrapper.h"
 #include "AESWrapper.h"
+#include "PendingMessageView.h"
 
 class SocketHandler;
+class AESCipherCache;
+class RSAEncryptorCache;
+class PendingMessageDecoder;
+
+const size_t STREAM_CHUNK_SIZE = 64 * 1024;  // how much payload is read before it is handed on
+const size_t FILE_CHUNK_SIZE = 1024 * 1024;  // how much of a file is read and encrypted while the previous chunk is sent
 
 /**
  * Responsible for communication between the client and the server.
@@ -23,7 +31,8 @@ class SocketHandler;
 class Communication {
 public:
 
-    Communication(SocketHandler* socketHandler, std::shared_ptr<FileOperations> fileHandler);
+    Communication(SocketHandler* socketHandler, std::shared_ptr<FileOperations> fileHandler,
+        AESCipherCache* aesCiphers, RSAEncryptorCache* rsaEncryptors);
 
 
     bool sendRegistrationRequest(const std::string& username,
@@ -45,6 +54,7 @@ public:
 
 
     bool requestAndParsePublicKey(const ClientID& selfId,
+        const ClientRoster& roster,
         const std::string& username,
         ClientID& clientId,
         PublicKey& publicKey,
@@ -52,15 +62,27 @@ public:
 
 
     bool requestAndParseClientsList(const ClientID& selfId,
-        std::vector<MainLogic::Client>& clients,
+        const RosterETag* ifNoneMatch,
+        ClientRoster& clients,
+        RosterETag& etag,
+        bool& notModified,
+        std::string& error);
+
+
+    // the users list payload goes into the roster, etag gets the tag of the payload
+    static bool parseClientsList(const uint8_t* payload,
+        size_t payloadSize,
+        ClientRoster& clients,
+        RosterETag& etag,
         std::string& error);
 
 
     bool requestAndParsePendingMessages(const ClientID& selfId,
         std::vector<MainLogic::Message>& messages,
-        std::vector<MainLogic::Client>& clients,
+        const ClientRoster& clients,
         RSAPrivateWrapper* rsaDecryptor,
         std::function<bool(const ClientID&, const SymmetricKey&)> setSymmetricKey,
+        std::function<void(const ClientID&, uint8_t)> setMessageVersion,
         std::string& error);
 
 
@@ -73,6 +95,17 @@ public:
         std::string& error);
 
 
+    bool sendFileContent(const ClientID& selfId,
+        const ClientID& targetId,
+        const MSGType type,
+        FileSource& source,
+        const uint64_t offset,
+        const uint64_t length,
+        const FilePartHeader* part,
+        const SymmetricKey& symmetricKey,
+        std::string& error);
+
+
     bool sendMessage(uint8_t* response,
         size_t responseSize,
         const uint8_t* msg,
@@ -85,10 +118,51 @@ public:
         const RSPCode expectedCode,
         uint8_t*& payload,
         size_t& size,
+        std::string& error,
+        code_t* responseCode = nullptr);
+
+
+    bool receiveStreamedPayload(const uint8_t* request,
+        size_t reqSize,
+        const RSPCode expectedCode,
+        const std::function<bool(const uint8_t*, size_t)>& onChunk,
+        size_t& size,
         std::string& error);
 
 private:
 
+    bool sendRequestAndReceiveHeader(const uint8_t* request,
+        size_t reqSize,
+        const RSPCode expectedCode,
+        RESHeader& response,
+        std::string& error);
+
+
+    bool handlePendingMessage(const PendingMessageRecord& record,
+        PendingMessageDecoder& decoder,
+        const ClientRoster& clients,
+        RSAPrivateWrapper* rsaDecryptor,
+        const std::function<bool(const ClientID&, const SymmetricKey&)>& setSymmetricKey,
+        const std::function<void(const ClientID&, uint8_t)>& setMessageVersion,
+        std::string& error);
+
+
+    bool handleFilePiece(const PendingMessage& header,
+        const ByteView& piece,
+        const uint64_t offset,
+        const bool last,
+        PendingMessageDecoder& decoder,
+        const ClientRoster& clients,
+        const std::function<void(const ClientID&, uint8_t)>& setMessageVersion);
+
+
+    bool storeFilePart(const PendingMessageRecord& record,
+        const ClientID& senderId,
+        const SymmetricKey& key,
+        std::string& path,
+        std::string& error);
+
+
     bool sendRequestAndGetPayload(const void* request,
         size_t requestSize,
         RSPCode expectedCode,
@@ -103,8 +177,8 @@ private:
 private:
     SocketHandler* socketHandler;
     std::shared_ptr<FileOperations> fileHandler;
-
-    std::vector<MainLogic::Client> usersList;
+    AESCipherCache* aesCiphers;  // owned by MainLogic
+    RSAEncryptorCache* rsaEncryptors;  // owned by MainLogic
 };
 
 #endif
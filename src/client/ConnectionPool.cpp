@@ -0,0 +1,188 @@
+#include "ConnectionPool.h"
+#include <boost/asio.hpp>
+
+// Constructor
+ConnectionPool::ConnectionPool(io_context& ioContext, const size_t maxIdle)
+    : _ioContext(ioContext)
+    , _resolved(false)
+    , _maxIdle(maxIdle)
+{
+}
+
+
+ConnectionPool::~ConnectionPool()
+{
+    if (_warming.valid())
+        _warming.wait();
+    clear();
+}
+
+// Set a new endpoint, the cached resolve and the idle sockets belong to the old one
+void ConnectionPool::setEndpoint(const std::string& address, const std::string& port)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (address == _address && port == _port)
+        return;
+    _address = address;
+    _port = port;
+    _resolved = false;
+    _endpoints = tcp::resolver::results_type();
+    _idle.clear();
+}
+
+// Resolve the server name once and keep the results for the next connections
+bool ConnectionPool::resolve()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_resolved)
+        return true;
+    try
+    {
+        tcp::resolver resolver(_ioContext);
+        _endpoints = resolver.resolve(_address, _port);
+        _resolved = !_endpoints.empty();
+    }
+    catch (...)
+    {
+        _resolved = false;
+    }
+    return _resolved;
+}
+
+// Open a new connection on the cached endpoints, resolve again once if they went stale
+std::unique_ptr<tcp::socket> ConnectionPool::open()
+{
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (!resolve())
+            return nullptr;
+
+        tcp::resolver::results_type endpoints;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            endpoints = _endpoints;
+        }
+        try
+        {
+            std::unique_ptr<tcp::socket> socket(new tcp::socket(_ioContext));
+            boost::asio::connect(*socket, endpoints);
+            socket->non_blocking(false);
+            socket->set_option(tcp::no_delay(true));
+            return socket;
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _resolved = false;
+        }
+    }
+    return nullptr;
+}
+
+// A pooled socket is healthy if the peer did not close it and no stray bytes are waiting on it
+bool ConnectionPool::isHealthy(tcp::socket& socket)
+{
+    if (!socket.is_open())
+        return false;
+
+    boost::system::error_code errorCode;
+    if (socket.available(errorCode) > 0 || errorCode)
+        return false;
+
+    uint8_t probe = 0;
+    socket.non_blocking(true, errorCode);
+    if (errorCode)
+        return false;
+    socket.receive(boost::asio::buffer(&probe, sizeof(probe)), tcp::socket::message_peek, errorCode);
+    const bool healthy = (errorCode == boost::asio::error::would_block);
+    socket.non_blocking(false, errorCode);
+    return healthy && !errorCode;
+}
+
+// Borrow a connection, a healthy idle one if we have it otherwise a new one
+std::unique_ptr<tcp::socket> ConnectionPool::acquire()
+{
+    while (true)
+    {
+        std::unique_ptr<tcp::socket> socket;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_idle.empty())
+                break;
+            socket = std::move(_idle.front());
+            _idle.pop_front();
+        }
+        if (isHealthy(*socket))
+            return socket;
+        boost::system::error_code errorCode;
+        socket->close(errorCode);
+    }
+    return open();
+}
+
+// Return a borrowed connection, the server may close its side after every response so we check it
+void ConnectionPool::release(std::unique_ptr<tcp::socket> socket, const bool reusable)
+{
+    if (socket == nullptr)
+        return;
+
+    if (reusable && isHealthy(*socket))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_idle.size() < _maxIdle)
+        {
+            _idle.push_back(std::move(socket));
+            return;
+        }
+    }
+    boost::system::error_code errorCode;
+    socket->close(errorCode);
+}
+
+// Open connections ahead of time so the next request finds one ready
+bool ConnectionPool::warm(const size_t count)
+{
+    const size_t target = std::min(count, _maxIdle);
+    while (idleCount() < target)
+    {
+        std::unique_ptr<tcp::socket> socket = open();
+        if (socket == nullptr)
+            return false;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _idle.push_back(std::move(socket));
+    }
+    return true;
+}
+
+// Open connections on a background thread so the handshake overlaps whatever the user does next.
+// Only one warm-up is pending at a time and none is started while enough connections are idle.
+void ConnectionPool::warmAsync(const size_t count)
+{
+    if (_warming.valid())
+    {
+        if (_warming.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;  // previous warm-up still running
+        _warming.get();
+    }
+    if (idleCount() >= std::min(count, _maxIdle))
+        return;
+    _warming = std::async(std::launch::async, [this, count]() { return warm(count); });
+}
+
+// Close every idle connection
+void ConnectionPool::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& socket : _idle)
+    {
+        boost::system::error_code errorCode;
+        socket->close(errorCode);
+    }
+    _idle.clear();
+}
+
+size_t ConnectionPool::idleCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _idle.size();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <cstdint>
+#include <boost/asio/ip/tcp.hpp>
+
+using boost::asio::ip::tcp;
+using boost::asio::io_context;
+
+const size_t POOL_MAX_IDLE = 4;
+
+//This class keeps warm connections to the server so a request does not pay for resolve + handshake every time.
+class ConnectionPool
+{
+public:
+
+    ConnectionPool(io_context& ioContext, const size_t maxIdle = POOL_MAX_IDLE);
+    virtual ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool& other)                = delete;
+    ConnectionPool(ConnectionPool&& other) noexcept            = delete;
+    ConnectionPool& operator=(const ConnectionPool& other)     = delete;
+    ConnectionPool& operator=(ConnectionPool&& other) noexcept = delete;
+
+    void setEndpoint(const std::string& address, const std::string& port);
+    std::unique_ptr<tcp::socket> acquire();
+    void release(std::unique_ptr<tcp::socket> socket, const bool reusable);
+    bool warm(const size_t count = 1);
+    void warmAsync(const size_t count = 1);
+    void clear();
+    size_t idleCount() const;
+
+private:
+
+    bool resolve();
+    std::unique_ptr<tcp::socket> open();
+    static bool isHealthy(tcp::socket& socket);
+
+    io_context&                              _ioContext;
+    std::string                              _address;
+    std::string                              _port;
+    tcp::resolver::results_type              _endpoints;   // cached resolver results
+    bool                                     _resolved;
+    const size_t                             _maxIdle;
+    std::deque<std::unique_ptr<tcp::socket>> _idle;        // connected sockets waiting to be borrowed
+    mutable std::mutex                       _mutex;
+    std::future<bool>                        _warming;     // background warm() started by warmAsync()
+};
@@ -0,0 +1,74 @@
+#include "CpuFeatures.h"
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef CPU_X86
+    void cpuid(const unsigned leaf, const unsigned subleaf, unsigned registers[4])
+    {
+#ifdef _MSC_VER
+        int values[4];
+        __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for (int i = 0; i < 4; ++i)
+            registers[i] = static_cast<unsigned>(values[i]);
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    // the OS saves the SSE and AVX registers on a context switch
+    bool avxStateEnabled()
+    {
+#ifdef _MSC_VER
+        return (_xgetbv(0) & 0x6) == 0x6;
+#else
+        unsigned low = 0;
+        unsigned high = 0;
+        __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        return (low & 0x6) == 0x6;
+#endif
+    }
+#endif
+}
+
+const CpuFeatures& CpuFeatures::get()
+{
+    static const CpuFeatures features;
+    return features;
+}
+
+CpuFeatures::CpuFeatures()
+    : _ssse3(false)
+    , _aesni(false)
+    , _avx2(false)
+    , _vaes(false)
+    , _rdrand(false)
+{
+#ifdef CPU_X86
+    unsigned registers[4] = { 0 };
+    cpuid(0, 0, registers);
+    const unsigned maxLeaf = registers[0];
+    if (maxLeaf < 1)
+        return;
+
+    cpuid(1, 0, registers);
+    const unsigned ecx1 = registers[2];
+    _ssse3 = (ecx1 & (1u << 9)) != 0;
+    _aesni = (ecx1 & (1u << 25)) != 0 && (ecx1 & (1u << 19)) != 0;     // AES, SSE4.1
+    _rdrand = (ecx1 & (1u << 30)) != 0;
+    const bool avx = (ecx1 & (1u << 28)) != 0 && (ecx1 & (1u << 27)) != 0 && avxStateEnabled();    // AVX, OSXSAVE
+
+    if (maxLeaf >= 7 && avx)
+    {
+        cpuid(7, 0, registers);
+        _avx2 = (registers[1] & (1u << 5)) != 0;
+        _vaes = _avx2 && _aesni && (registers[2] & (1u << 9)) != 0;
+    }
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Functions that use instructions beyond the build's baseline are compiled for them one by one and only
+// called after CpuFeatures said the processor has them. MSVC needs nothing for that, GCC and Clang do.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSSE3  __attribute__((target("ssse3")))
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_AESNI  __attribute__((target("aes,sse4.1")))
+#define TARGET_VAES   __attribute__((target("vaes,avx2,aes,sse4.1")))
+#define TARGET_RDRAND __attribute__((target("rdrnd")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#define TARGET_AESNI
+#define TARGET_VAES
+#define TARGET_RDRAND
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+//This class tells which instruction set extensions the processor (and the OS, for the AVX registers) supports,
+//read once with cpuid.
+class CpuFeatures
+{
+public:
+    static const CpuFeatures& get();
+
+    bool ssse3() const { return _ssse3; }
+    bool aesni() const { return _aesni; }
+    bool avx2() const { return _avx2; }
+    bool vaes() const { return _vaes; }     // 256 bit AES rounds, implies avx2
+    bool rdrand() const { return _rdrand; }
+
+private:
+    CpuFeatures();
+
+    bool _ssse3;
+    bool _aesni;
+    bool _avx2;
+    bool _vaes;
+    bool _rdrand;
+};
@@ -1,5 +1,344 @@
 
 #include "Encoder.h"
+#include "CpuFeatures.h"
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    constexpr char HEX_DIGITS[] = "0123456789ABCDEF";
+    constexpr char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // the value of every char in hex (of either case) or in Base64, -1 for the other chars
+    struct CharValues
+    {
+        int8_t hex[256];
+        int8_t base64[256];
+
+        constexpr CharValues() : hex(), base64()
+        {
+            for (int c = 0; c < 256; ++c)
+            {
+                hex[c] = -1;
+                base64[c] = -1;
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+                hex[static_cast<uint8_t>(HEX_DIGITS[i])] = static_cast<int8_t>(i);
+                hex[static_cast<uint8_t>(HEX_DIGITS[i] | 0x20)] = static_cast<int8_t>(i);
+            }
+            for (int i = 0; i < 64; ++i)
+                base64[static_cast<uint8_t>(BASE64_ALPHABET[i])] = static_cast<int8_t>(i);
+        }
+    };
+    constexpr CharValues CHAR_VALUES;
+
+    // The scalar codecs do the whole input when the processor has no SIMD, and the tail after the SIMD ones otherwise.
+
+    void bytesToHexScalar(const uint8_t* buffer, const size_t size, char* hex)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            hex[2 * i] = HEX_DIGITS[buffer[i] >> 4];
+            hex[2 * i + 1] = HEX_DIGITS[buffer[i] & 0x0f];
+        }
+    }
+
+    bool hexToBytesScalar(const char* hex, const size_t length, uint8_t* bytes)
+    {
+        for (size_t i = 0; i + 1 < length; i += 2)
+        {
+            const int high = CHAR_VALUES.hex[static_cast<uint8_t>(hex[i])];
+            const int low = CHAR_VALUES.hex[static_cast<uint8_t>(hex[i + 1])];
+            if (high < 0 || low < 0)
+                return false;
+            bytes[i / 2] = static_cast<uint8_t>(high << 4 | low);
+        }
+        return true;
+    }
+
+    void encodeScalar(const uint8_t* input, const size_t size, char* base64)
+    {
+        size_t i = 0;
+        for (; i + 3 <= size; i += 3, base64 += 4)
+        {
+            const uint32_t group = static_cast<uint32_t>(input[i]) << 16 | input[i + 1] << 8 | input[i + 2];
+            base64[0] = BASE64_ALPHABET[group >> 18];
+            base64[1] = BASE64_ALPHABET[(group >> 12) & 0x3f];
+            base64[2] = BASE64_ALPHABET[(group >> 6) & 0x3f];
+            base64[3] = BASE64_ALPHABET[group & 0x3f];
+        }
+        if (i == size)
+            return;
+
+        const bool two = i + 2 == size;
+        const uint32_t group = static_cast<uint32_t>(input[i]) << 16 | (two ? input[i + 1] << 8 : 0);
+        base64[0] = BASE64_ALPHABET[group >> 18];
+        base64[1] = BASE64_ALPHABET[(group >> 12) & 0x3f];
+        base64[2] = two ? BASE64_ALPHABET[(group >> 6) & 0x3f] : '=';
+        base64[3] = '=';
+    }
+
+    // 4 chars make 3 bytes, 3 left over make 2 and 2 make 1
+    size_t decodeScalar(const char* base64, const size_t length, uint8_t* output)
+    {
+        uint32_t group = 0;
+        int chars = 0;
+        size_t written = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            const int8_t value = CHAR_VALUES.base64[static_cast<uint8_t>(base64[i])];
+            if (value < 0)
+                continue;
+            group = group << 6 | static_cast<uint32_t>(value);
+            if (++chars == 4)
+            {
+                output[written++] = static_cast<uint8_t>(group >> 16);
+                output[written++] = static_cast<uint8_t>(group >> 8);
+                output[written++] = static_cast<uint8_t>(group);
+                group = 0;
+                chars = 0;
+            }
+        }
+        if (chars == 2)
+            output[written++] = static_cast<uint8_t>(group >> 4);
+        else if (chars == 3)
+        {
+            output[written++] = static_cast<uint8_t>(group >> 10);
+            output[written++] = static_cast<uint8_t>(group >> 2);
+        }
+        return written;
+    }
+
+#ifdef CPU_X86
+    // The SIMD kernels do whole blocks from the start of the input and return how much of it they did.
+    // The decoders stop at the first block with a char they don't take, the scalar ones go on from there.
+
+    TARGET_SSSE3 size_t bytesToHexSsse3(const uint8_t* buffer, const size_t size, char* hex)
+    {
+        const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS));
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer + i));
+            const __m128i high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+            const __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, nibble));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 2 * i), _mm_unpacklo_epi8(high, low));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+        }
+        return i;
+    }
+
+    TARGET_AVX2 size_t bytesToHexAvx2(const uint8_t* buffer, const size_t size, char* hex)
+    {
+        const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS)));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer + i));
+            const __m256i high = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+            const __m256i low = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, nibble));
+            // unpack works inside the 128 bit lanes, the lanes are put back in order
+            const __m256i first = _mm256_unpacklo_epi8(high, low);
+            const __m256i second = _mm256_unpackhi_epi8(high, low);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(hex + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(hex + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+        }
+        return i;
+    }
+
+    // the values of 16 hex digits, false if one of them isn't
+    TARGET_SSSE3 inline bool hexValues(const __m128i chars, __m128i& values)
+    {
+        const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+        const __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+        const __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+        values = _mm_or_si128(_mm_and_si128(isDigit, digit),
+            _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+        return _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == 0xffff;
+    }
+
+    TARGET_AVX2 inline bool hexValues(const __m256i chars, __m256i& values)
+    {
+        const __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+        const __m256i letter = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        const __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+        const __m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+        values = _mm256_or_si256(_mm256_and_si256(isDigit, digit),
+            _mm256_and_si256(isLetter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+        return _mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)) == -1;
+    }
+
+    TARGET_SSSE3 size_t hexToBytesSsse3(const char* hex, const size_t length, uint8_t* bytes)
+    {
+        // every high nibble times 16 plus the low one after it
+        const __m128i weights = _mm_set1_epi16(0x0110);
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            __m128i first, second;
+            if (!hexValues(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i)), first) ||
+                !hexValues(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i + 16)), second))
+                break;
+            const __m128i packed = _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + i / 2), packed);
+        }
+        return i;
+    }
+
+    TARGET_AVX2 size_t hexToBytesAvx2(const char* hex, const size_t length, uint8_t* bytes)
+    {
+        const __m256i weights = _mm256_set1_epi16(0x0110);
+        size_t i = 0;
+        for (; i + 64 <= length; i += 64)
+        {
+            __m256i first, second;
+            if (!hexValues(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + i)), first) ||
+                !hexValues(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + i + 32)), second))
+                break;
+            // pack works inside the lanes as well
+            const __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(first, weights), _mm256_maddubs_epi16(second, weights));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(bytes + i / 2), _mm256_permute4x64_epi64(packed, 0xd8));
+        }
+        return i;
+    }
+
+    // The Base64 kernels follow Mula and Lemire, "Faster Base64 Encoding and Decoding using AVX2 Instructions".
+
+    // 12 bytes, at 0..11 of a 128 bit lane, to the 6 bit values of their 16 chars
+    TARGET_SSSE3 inline __m128i base64Values(const __m128i bytes)
+    {
+        const __m128i spread = _mm_shuffle_epi8(bytes, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        const __m128i first = _mm_mulhi_epu16(_mm_and_si128(spread, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        const __m128i second = _mm_mullo_epi16(_mm_and_si128(spread, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(first, second);
+    }
+
+    // the value of a char is a range of the alphabet (A-Z, a-z, 0-9, +, /) plus the offset of that range
+    TARGET_SSSE3 inline __m128i base64Chars(const __m128i values)
+    {
+        const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), values), _mm_set1_epi8(13)));
+        return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), values);
+    }
+
+    TARGET_AVX2 inline __m256i base64Values(const __m256i bytes)
+    {
+        const __m256i spread = _mm256_shuffle_epi8(bytes, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        const __m256i first = _mm256_mulhi_epu16(_mm256_and_si256(spread, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        const __m256i second = _mm256_mullo_epi16(_mm256_and_si256(spread, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        return _mm256_or_si256(first, second);
+    }
+
+    TARGET_AVX2 inline __m256i base64Chars(const __m256i values)
+    {
+        const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        __m256i range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), values), _mm256_set1_epi8(13)));
+        return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), values);
+    }
+
+    TARGET_SSSE3 size_t encodeSsse3(const uint8_t* input, const size_t size, char* base64)
+    {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 12, base64 += 16)
+        {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(base64), base64Chars(base64Values(bytes)));
+        }
+        return i;
+    }
+
+    TARGET_AVX2 size_t encodeAvx2(const uint8_t* input, const size_t size, char* base64)
+    {
+        size_t i = 0;
+        for (; i + 28 <= size; i += 24, base64 += 32)
+        {
+            // 12 bytes to each lane
+            const __m256i bytes = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 12)), 1);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(base64), base64Chars(base64Values(bytes)));
+        }
+        return i;
+    }
+
+    // A char is in the alphabet if the bit of its high nibble is set in the mask of its low nibble,
+    // its value is the char plus the offset of its high nibble ('/' is 3 less than '+').
+    const int8_t HIGH_NIBBLE_OFFSETS[16] = { 0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 };
+    const uint8_t LOW_NIBBLE_MASKS[16] = { 0xa8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf0,
+        0x54, 0x50, 0x50, 0x50, 0x54 };
+    const uint8_t HIGH_NIBBLE_BITS[16] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    TARGET_SSSE3 size_t decodeSsse3(const char* base64, const size_t length, uint8_t* output)
+    {
+        const __m128i offsets = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HIGH_NIBBLE_OFFSETS));
+        const __m128i masks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(LOW_NIBBLE_MASKS));
+        const __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HIGH_NIBBLE_BITS));
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        size_t i = 0;
+        // 12 bytes are written with a 16 byte store, the next 8 chars make room for the other 4
+        for (; i + 24 <= length; i += 16, output += 12)
+        {
+            const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base64 + i));
+            const __m128i high = _mm_and_si128(_mm_srli_epi32(chars, 4), nibble);
+            const __m128i low = _mm_and_si128(chars, nibble);
+            const __m128i matched = _mm_and_si128(_mm_shuffle_epi8(masks, low), _mm_shuffle_epi8(bits, high));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(matched, _mm_setzero_si128())) != 0)
+                break;
+            const __m128i slash = _mm_and_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('/')), _mm_set1_epi8(3));
+            const __m128i values = _mm_add_epi8(chars, _mm_sub_epi8(_mm_shuffle_epi8(offsets, high), slash));
+
+            // 6 bit values to 12 bit pairs to 24 bit groups, then the 3 bytes of every group high byte first
+            const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            const __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+            const __m128i bytes = _mm_shuffle_epi8(groups, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output), bytes);
+        }
+        return i;
+    }
+
+    TARGET_AVX2 size_t decodeAvx2(const char* base64, const size_t length, uint8_t* output)
+    {
+        const __m256i offsets = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(HIGH_NIBBLE_OFFSETS)));
+        const __m256i masks = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(LOW_NIBBLE_MASKS)));
+        const __m256i bits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(HIGH_NIBBLE_BITS)));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        size_t i = 0;
+        // 24 bytes are written with a 32 byte store, the next 12 chars make room for the other 8
+        for (; i + 44 <= length; i += 32, output += 24)
+        {
+            const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base64 + i));
+            const __m256i high = _mm256_and_si256(_mm256_srli_epi32(chars, 4), nibble);
+            const __m256i low = _mm256_and_si256(chars, nibble);
+            const __m256i matched = _mm256_and_si256(_mm256_shuffle_epi8(masks, low), _mm256_shuffle_epi8(bits, high));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(matched, _mm256_setzero_si256())) != 0)
+                break;
+            const __m256i slash = _mm256_and_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/')), _mm256_set1_epi8(3));
+            const __m256i values = _mm256_add_epi8(chars, _mm256_sub_epi8(_mm256_shuffle_epi8(offsets, high), slash));
+
+            const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            const __m256i groups = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+            const __m256i lanes = _mm256_shuffle_epi8(groups, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            // the 12 bytes of the second lane right after the ones of the first
+            const __m256i bytes = _mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output), bytes);
+        }
+        return i;
+    }
+#endif
+}
 
 
 //This function Trims leading and trailing whitespace from the string
@@ -26,16 +365,9 @@ std::string Encoder::bytesToHex(const uint8_t* buffer, const size_t size)
     if (size == 0 || buffer == nullptr)
         return "";
 
-    // Construct a string from the byte buffer.
-    const std::string byteString(buffer, buffer + size);
-    try
-    {
-        return boost::algorithm::hex(byteString);
-    }
-    catch (const std::exception&)
-    {
-        return "";
-    }
+    std::string hex(2 * size, '\0');
+    bytesToHex(buffer, size, &hex[0]);
+    return hex;
 }
 
 
@@ -45,14 +377,11 @@ std::string Encoder::hexToBytes(const std::string& hexString)
 {
     if (hexString.empty())
         return "";
-    try
-    {
-        return boost::algorithm::unhex(hexString);
-    }
-    catch (const std::exception&)
-    {
+
+    std::string bytes(hexString.size() / 2, '\0');
+    if (!hexToBytes(hexString.data(), hexString.size(), reinterpret_cast<uint8_t*>(&bytes[0])))
         return "";
-    }
+    return bytes;
 }
 
 
@@ -60,23 +389,77 @@ std::string Encoder::hexToBytes(const std::string& hexString)
 
 std::string Encoder::encode(const std::string& input)
 {
-    std::string encoded;
-    // Create a StringSink for  capturing the encoded output.
-    CryptoPP::StringSink* sink = new CryptoPP::StringSink(encoded);
-    CryptoPP::Base64Encoder* encoder = new CryptoPP::Base64Encoder(sink, false);
-   
-    CryptoPP::StringSource ss(input, true, encoder);
+    std::string encoded(base64Size(input.size()), '\0');
+    encode(reinterpret_cast<const uint8_t*>(input.data()), input.size(), &encoded[0]);
     return encoded;
 }
 
 
-//This function uses CryptoPP's Base64Decoder to convert the input string.
+//This function decodes the given Base64 string.
 
 std::string Encoder::decode(const std::string& input)
 {
-    std::string decoded;
-    CryptoPP::StringSink* sink = new CryptoPP::StringSink(decoded);
-    CryptoPP::Base64Decoder* decoder = new CryptoPP::Base64Decoder(sink);
-    CryptoPP::StringSource ss(input, true, decoder);
+    std::string decoded(decodedSize(input.size()), '\0');
+    decoded.resize(decode(input.data(), input.size(), reinterpret_cast<uint8_t*>(&decoded[0])));
     return decoded;
 }
+
+
+void Encoder::bytesToHex(const uint8_t* buffer, const size_t size, char* hex)
+{
+    size_t done = 0;
+#ifdef CPU_X86
+    const CpuFeatures& cpu = CpuFeatures::get();
+    if (cpu.avx2())
+        done = bytesToHexAvx2(buffer, size, hex);
+    if (cpu.ssse3())
+        done += bytesToHexSsse3(buffer + done, size - done, hex + 2 * done);
+#endif
+    bytesToHexScalar(buffer + done, size - done, hex + 2 * done);
+}
+
+
+bool Encoder::hexToBytes(const char* hex, const size_t length, uint8_t* bytes)
+{
+    if (length % 2 != 0)
+        return false;
+
+    size_t done = 0;
+#ifdef CPU_X86
+    const CpuFeatures& cpu = CpuFeatures::get();
+    if (cpu.avx2())
+        done = hexToBytesAvx2(hex, length, bytes);
+    if (cpu.ssse3())
+        done += hexToBytesSsse3(hex + done, length - done, bytes + done / 2);
+#endif
+    return hexToBytesScalar(hex + done, length - done, bytes + done / 2);
+}
+
+
+size_t Encoder::encode(const uint8_t* input, const size_t size, char* base64)
+{
+    size_t done = 0;
+#ifdef CPU_X86
+    const CpuFeatures& cpu = CpuFeatures::get();
+    if (cpu.avx2())
+        done = encodeAvx2(input, size, base64);
+    if (cpu.ssse3())
+        done += encodeSsse3(input + done, size - done, base64 + done / 3 * 4);
+#endif
+    encodeScalar(input + done, size - done, base64 + done / 3 * 4);
+    return base64Size(size);
+}
+
+
+size_t Encoder::decode(const char* base64, const size_t length, uint8_t* output)
+{
+    size_t done = 0;
+#ifdef CPU_X86
+    const CpuFeatures& cpu = CpuFeatures::get();
+    if (cpu.avx2())
+        done = decodeAvx2(base64, length, output);
+    if (cpu.ssse3())
+        done += decodeSsse3(base64 + done, length - done, output + done / 4 * 3);
+#endif
+    return done / 4 * 3 + decodeScalar(base64 + done, length - done, output + done / 4 * 3);
+}
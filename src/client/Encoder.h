@@ -2,8 +2,6 @@
 #pragma once
 #include <string>
 #include <cstdint>
-#include <base64.h>                   
-#include <boost/algorithm/hex.hpp>    
 #include <boost/algorithm/string/trim.hpp> 
 #include <chrono>
 #include <sstream>
@@ -22,4 +20,17 @@ public:
     static std::string hexToBytes(const std::string& hexString);
     static std::string encode(const std::string& str);
     static std::string decode(const std::string& str);
+
+    // The same codecs on the caller's buffers, run on SSSE3 or AVX2 when the processor has them.
+    // hex gets 2 * size upper case chars
+    static void bytesToHex(const uint8_t* buffer, const size_t size, char* hex);
+    // bytes gets length / 2 bytes, false if length is odd or a char isn't a hex digit (of either case)
+    static bool hexToBytes(const char* hex, const size_t length, uint8_t* bytes);
+    // Base64 with padding and without line breaks
+    static size_t base64Size(const size_t size) { return (size + 2) / 3 * 4; }
+    static size_t encode(const uint8_t* input, const size_t size, char* base64);
+    // chars outside the Base64 alphabet (padding, line breaks) are skipped, like Crypto++ does.
+    // Writes at most decodedSize(length) bytes and returns how many
+    static size_t decodedSize(const size_t length) { return length / 4 * 3 + 2; }
+    static size_t decode(const char* base64, const size_t length, uint8_t* output);
 };
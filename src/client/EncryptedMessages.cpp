@@ -0,0 +1,167 @@
+#include "EncryptedMessages.h"
+#include "AESWrapper.h"
+#include "AEADMessage.h"
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace
+{
+    // shared by every pull, the texts of one read and the history writer's batches are spread over it
+    boost::asio::thread_pool& workers()
+    {
+        static boost::asio::thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+        return pool;
+    }
+}
+
+size_t EncryptedMessages::add(std::shared_ptr<const AESWrapper> aes, const uint8_t* cipher, const size_t size, const bool aead)
+{
+    Slice slice;
+    slice.offset = _cipher.size();
+    slice.size = size;
+    slice.aes = std::move(aes);
+    slice.aead = aead;
+    _cipher.insert(_cipher.end(), cipher, cipher + size);
+    _slices.push_back(std::move(slice));
+    return _slices.size() - 1;
+}
+
+//This function decrypts the messages of slots, split by cipher bytes into ranges for the worker pool when there is
+//enough of it, the calling thread takes the last range
+void EncryptedMessages::decryptSlots(const std::vector<size_t>& slots, std::vector<std::string>& texts) const
+{
+    texts.assign(slots.size(), std::string());
+    size_t bytes = 0;
+    for (const size_t slot : slots)
+        bytes += _slices[slot].size;
+    const size_t threads = std::min<size_t>({ std::max(1u, std::thread::hardware_concurrency()),
+        bytes / DECRYPT_BYTES_PER_THREAD, slots.size() });
+    if (threads <= 1)
+    {
+        decryptRange(slots, 0, slots.size(), texts);
+        return;
+    }
+
+    std::vector<std::future<void>> ranges;
+    size_t begin = 0;
+    size_t taken = 0;
+    for (size_t t = 1; t < threads; ++t)
+    {
+        // up to the t-th share of the bytes, at least one message each
+        size_t end = begin + 1;
+        taken += _slices[slots[begin]].size;
+        while (end + (threads - t) < slots.size() && taken + _slices[slots[end]].size <= bytes / threads * t)
+            taken += _slices[slots[end++]].size;
+        auto range = std::make_shared<std::packaged_task<void()>>([this, &slots, &texts, begin, end]() {
+            decryptRange(slots, begin, end, texts);
+        });
+        ranges.push_back(range->get_future());
+        boost::asio::post(workers(), [range]() { (*range)(); });
+        begin = end;
+    }
+    decryptRange(slots, begin, slots.size(), texts);
+    for (auto& range : ranges)
+        range.get();
+}
+
+//This function decrypts the messages slots[begin, end) together, the blocks of all the CBC ones share the AES units
+void EncryptedMessages::decryptRange(const std::vector<size_t>& slots, const size_t begin, const size_t end,
+    std::vector<std::string>& texts) const
+{
+    std::vector<AESDecryptJob> jobs;
+    std::vector<size_t> batched;     // index in slots of every job
+    jobs.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+        const Slice& slice = _slices[slots[i]];
+        if (slice.aead)
+        {
+            if (!AEADMessage::open(slice.aes->getKey(), _cipher.data() + slice.offset, slice.size, texts[i]))
+                texts[i] = "Decryption failed.";
+            continue;
+        }
+        texts[i].resize(slice.size);
+        AESDecryptJob job;
+        job.aes = slice.aes.get();
+        job.cipher = _cipher.data() + slice.offset;
+        job.length = slice.size;
+        job.plain = reinterpret_cast<uint8_t*>(&texts[i][0]);
+        jobs.push_back(job);
+        batched.push_back(i);
+    }
+    AESWrapper::decryptBatch(jobs.data(), jobs.size());
+    for (size_t j = 0; j < jobs.size(); ++j)
+    {
+        std::string& text = texts[batched[j]];
+        if (jobs[j].ok)
+            text.resize(jobs[j].plainSize);
+        else
+            text = "Decryption failed.";
+    }
+}
+
+//This function hands out the texts decrypted ahead for the reader, the next ones are decrypted when it runs out
+std::string EncryptedMessages::decrypt(const size_t slot)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (slot < _aheadFirst || slot >= _aheadFirst + _ahead.size())
+    {
+        std::vector<size_t> slots;
+        for (size_t next = slot; next < _slices.size() && slots.size() < DECRYPT_AHEAD_MESSAGES; ++next)
+            slots.push_back(next);
+        decryptSlots(slots, _ahead);
+        _aheadFirst = slot;
+    }
+    return _ahead[slot - _aheadFirst];  // a copy, the slot may be read again while it is ahead
+}
+
+//This function returns the text from the cache, on a miss it decrypts the messages after it that aren't cached
+//along with it outside the lock and adds them, dropping the texts read longest ago
+std::string EncryptedMessages::content(const size_t slot)
+{
+    std::vector<size_t> slots;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _cache.find(slot);
+        if (it != _cache.end())
+        {
+            _recent.splice(_recent.begin(), _recent, it->second.recent);
+            return it->second.text;
+        }
+        slots.push_back(slot);
+        for (size_t next = slot + 1; next < _slices.size() && slots.size() < DECRYPT_AHEAD_MESSAGES; ++next)
+        {
+            if (_cache.count(next) == 0)
+                slots.push_back(next);
+        }
+    }
+
+    std::vector<std::string> texts;
+    decryptSlots(slots, texts);
+    std::string text = texts[0];
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    // the ones after it first, the text asked for ends up as the one read last
+    for (size_t i = slots.size(); i-- > 0;)
+        cache(slots[i], std::move(texts[i]));
+    return text;
+}
+
+void EncryptedMessages::cache(const size_t slot, std::string text)
+{
+    if (text.size() > PLAINTEXT_CACHE_SIZE || _cache.count(slot) != 0)
+        return;     // too big to keep, or another reader got there first
+    while (_cachedBytes + text.size() > PLAINTEXT_CACHE_SIZE)
+    {
+        const auto oldest = _cache.find(_recent.back());
+        _cachedBytes -= oldest->second.text.size();
+        _cache.erase(oldest);
+        _recent.pop_back();
+    }
+    _recent.push_front(slot);
+    _cachedBytes += text.size();
+    _cache.emplace(slot, Cached{ std::move(text), _recent.begin() });
+}
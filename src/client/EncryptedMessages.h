@@ -0,0 +1,69 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+class AESWrapper;
+
+const size_t PLAINTEXT_CACHE_SIZE = 4 * 1024 * 1024;  // decrypted texts kept for messages read again
+const size_t DECRYPT_AHEAD_MESSAGES = 16;             // messages decrypted together, readers go through them in order
+const size_t DECRYPT_BYTES_PER_THREAD = 256 * 1024;   // less cipher than this per worker is decrypted on the caller's thread
+
+//This class holds the ciphertext of the messages of one pull in one buffer and decrypts a message when it is read,
+//so a big backlog costs no decryption until it is looked at. Every message keeps the cipher of the key that was
+//in effect at its position in the queue. The texts read last are kept decrypted, up to PLAINTEXT_CACHE_SIZE bytes.
+//A read decrypts the messages after it as well, the CBC ones in one AESWrapper::decryptBatch() call per worker,
+//a batch with enough cipher is split over a pool of one thread per core.
+class EncryptedMessages
+{
+public:
+    EncryptedMessages() : _cachedBytes(0), _aheadFirst(0) {}
+    virtual ~EncryptedMessages() = default;
+    EncryptedMessages(const EncryptedMessages& other) = delete;
+    EncryptedMessages(EncryptedMessages&& other) noexcept = delete;
+    EncryptedMessages& operator=(const EncryptedMessages& other) = delete;
+    EncryptedMessages& operator=(EncryptedMessages&& other) noexcept = delete;
+
+    // cipher is copied, returns the slot of the message, aead messages are AEADMessage ones under the key of aes
+    size_t add(std::shared_ptr<const AESWrapper> aes, const uint8_t* cipher, const size_t size, const bool aead);
+    // the text of the message, through the cache
+    std::string content(const size_t slot);
+    // the text of the message, not kept in the cache, for a reader that goes over every message once
+    std::string decrypt(const size_t slot);
+
+    size_t size() const { return _slices.size(); }
+    size_t cipherBytes() const { return _cipher.size(); }
+
+private:
+    struct Slice
+    {
+        size_t offset;
+        size_t size;
+        std::shared_ptr<const AESWrapper> aes;
+        bool aead;
+    };
+
+    struct Cached
+    {
+        std::string text;
+        std::list<size_t>::iterator recent;
+    };
+
+    void decryptSlots(const std::vector<size_t>& slots, std::vector<std::string>& texts) const;
+    void decryptRange(const std::vector<size_t>& slots, const size_t begin, const size_t end, std::vector<std::string>& texts) const;
+    void cache(const size_t slot, std::string text);
+
+    std::vector<uint8_t> _cipher;
+    std::vector<Slice> _slices;
+
+    std::mutex _mutex;
+    std::list<size_t> _recent;      // slots in the cache, the one read last first
+    std::unordered_map<size_t, Cached> _cache;
+    size_t _cachedBytes;
+    size_t _aheadFirst;             // decrypt()'s texts for the slots from here on
+    std::vector<std::string> _ahead;
+};
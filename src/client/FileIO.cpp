@@ -1,5 +1,7 @@
 ﻿#include "FileIO.h"
 #include <fstream>
+#include <functional>
+#include <boost/filesystem.hpp>
 
 // Constructs
 
@@ -108,16 +110,23 @@ bool FileIO::parseClientInfo(std::string& username, std::string& hexUuid, std::s
 // this function Stores the client's information into the CLIENT_INFO file.
 bool FileIO::storeClientInfo( const std::string& uuid, const std::string& username, const std::string& privateKey, std::string& error)
 {
-    if (!_fileHandler->open(CLIENT_INFO, true))
+    return storeClientInfo(CLIENT_INFO, uuid, username, privateKey, error);
+}
+
+
+// this function Stores the client's information in the CLIENT_INFO format into path.
+bool FileIO::storeClientInfo(const std::string& path, const std::string& uuid, const std::string& username, const std::string& privateKey, std::string& error)
+{
+    if (!_fileHandler->open(path, true))
     {
-        error = "Couldn't open " + std::string(CLIENT_INFO);
+        error = "Couldn't open " + path;
         return false;
     }
 
     // Write the username on 1st line.
     if (!_fileHandler->writeLine(username))
     {
-        error = "Couldn't write username to " + std::string(CLIENT_INFO);
+        error = "Couldn't write username to " + path;
         _fileHandler->close();
         return false;
     }
@@ -125,7 +134,7 @@ bool FileIO::storeClientInfo( const std::string& uuid, const std::string& userna
     // Write  UUID on 2nd line.
     if (!_fileHandler->writeLine(uuid))
     {
-        error = "Couldn't write UUID to " + std::string(CLIENT_INFO);
+        error = "Couldn't write UUID to " + path;
         _fileHandler->close();
         return false;
     }
@@ -134,7 +143,7 @@ bool FileIO::storeClientInfo( const std::string& uuid, const std::string& userna
     std::string encodedKey = Encoder::encode(privateKey);
     if (!_fileHandler->write(reinterpret_cast<const uint8_t*>(encodedKey.data()), encodedKey.size()))
     {
-        error = "Error writing private key to " + std::string(CLIENT_INFO);
+        error = "Error writing private key to " + path;
         _fileHandler->close();
         return false;
     }
@@ -142,3 +151,78 @@ bool FileIO::storeClientInfo( const std::string& uuid, const std::string& userna
     _fileHandler->close();
     return true;
 }
+
+
+// this function returns the path a file is known by in the upload journal, the same from any working directory.
+std::string FileIO::canonicalPath(const std::string& filePath)
+{
+    boost::system::error_code ec;
+    boost::filesystem::path path = boost::filesystem::canonical(filePath, ec);
+    if (ec)
+        path = boost::filesystem::absolute(filePath).lexically_normal();
+    return path.string();
+}
+
+// this function returns where the progress of sending filePath to targetId is kept, one journal per file and receiver.
+// filePath is expected to be canonical already (see canonicalPath).
+std::string FileIO::uploadJournalPath(const ClientID& targetId, const std::string& filePath) const
+{
+    const std::string name = "upload_" + Encoder::bytesToHex(targetId.uuid, CLIENT_ID_SIZE) + "_" +
+        std::to_string(std::hash<std::string>()(filePath)) + ".journal";
+    return (boost::filesystem::path(_fileHandler->getTempFolder()) / name).string();
+}
+
+// this function reads an upload journal, false if there is none or it belongs to another version of the file.
+bool FileIO::loadUploadJournal(const std::string& journalPath, const std::string& filePath, const uint64_t fileSize,
+    uint32_t& transferId, uint32_t& nextPart)
+{
+    if (!_fileHandler->open(journalPath, false))
+        return false;
+
+    std::string path, size, id, part;
+    const bool complete = _fileHandler->readLine(path) && _fileHandler->readLine(size) &&
+        _fileHandler->readLine(id) && _fileHandler->readLine(part);
+    _fileHandler->close();
+    if (!complete || path != filePath)
+        return false;
+
+    try
+    {
+        if (std::stoull(size) != fileSize)
+            return false;
+        transferId = static_cast<uint32_t>(std::stoul(id));
+        nextPart = static_cast<uint32_t>(std::stoul(part));
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    return true;
+}
+
+// this function records that every part before nextPart was acknowledged by the server.
+bool FileIO::storeUploadJournal(const std::string& journalPath, const std::string& filePath, const uint64_t fileSize,
+    const uint32_t transferId, const uint32_t nextPart, std::string& error)
+{
+    if (!_fileHandler->open(journalPath, true))
+    {
+        error = "Couldn't open " + journalPath;
+        return false;
+    }
+
+    const bool written = _fileHandler->writeLine(filePath) && _fileHandler->writeLine(std::to_string(fileSize)) &&
+        _fileHandler->writeLine(std::to_string(transferId)) && _fileHandler->writeLine(std::to_string(nextPart));
+    _fileHandler->close();
+    if (!written)
+    {
+        error = "Couldn't write upload progress to " + journalPath;
+        return false;
+    }
+    return true;
+}
+
+// this function deletes the journal once the whole file was sent.
+void FileIO::removeUploadJournal(const std::string& journalPath)
+{
+    _fileHandler->remove(journalPath);
+}
@@ -28,6 +28,26 @@ public:
 
     bool storeClientInfo( const std::string& uuid, const std::string& username, const std::string& privateKey, std::string& error);
 
+
+    bool storeClientInfo(const std::string& path, const std::string& uuid, const std::string& username, const std::string& privateKey, std::string& error);
+
+
+    static std::string canonicalPath(const std::string& filePath);
+
+
+    std::string uploadJournalPath(const ClientID& targetId, const std::string& filePath) const;
+
+
+    bool loadUploadJournal(const std::string& journalPath, const std::string& filePath, const uint64_t fileSize,
+        uint32_t& transferId, uint32_t& nextPart);
+
+
+    bool storeUploadJournal(const std::string& journalPath, const std::string& filePath, const uint64_t fileSize,
+        const uint32_t transferId, const uint32_t nextPart, std::string& error);
+
+
+    void removeUploadJournal(const std::string& journalPath);
+
 private:
     std::shared_ptr<FileOperations> _fileHandler;
 };
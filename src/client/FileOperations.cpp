@@ -4,7 +4,9 @@
 #include <memory>
 #include <cstdio>
 #include <vector>
+#include <cstring>
 #include <boost/filesystem.hpp>
+#include "FileSource.h"
 
 // Constructor
 FileOperations::FileOperations() : fileIsOpen(false) {}
@@ -16,7 +18,8 @@ FileOperations::~FileOperations()
 }
 
 //This function Opens a file for reading / writing. and  Creates directories if there is a need.
-bool FileOperations::open(const std::string& filePath, bool write)
+//append keeps the content of an existing file and writes at its end.
+bool FileOperations::open(const std::string& filePath, bool write, bool append)
 {
     if (filePath.empty())
         return false;
@@ -25,6 +28,8 @@ bool FileOperations::open(const std::string& filePath, bool write)
     if (write)
     {
         mode = std::ios::binary | std::ios::out;
+        if (append)
+            mode |= std::ios::app;
     }
     else
     {
@@ -94,8 +99,8 @@ size_t FileOperations::size(const std::string& filePath) const
         return 0;
     try
     {
-        boost::filesystem::path fullPath = boost::filesystem::current_path() / filePath;
-        return boost::filesystem::file_size(fullPath);
+        // relative paths resolve against the working directory, absolute ones (temp folder) are used as is
+        return static_cast<size_t>(boost::filesystem::file_size(filePath));
     }
     catch (const boost::filesystem::filesystem_error&)
     {
@@ -158,31 +163,25 @@ bool FileOperations::writeLine(const std::string& line) const
     return write(reinterpret_cast<const uint8_t*>(newline.data()), newline.size());
 }
 
-// This function read all of the file content into a buffer.
+// This function read all of the file content into a buffer, through the mapping (or pread) instead of the stream buffer.
 bool FileOperations::readFromFile(const std::string& filePath, uint8_t*& file, size_t& bytes)
 {
-    bool write = false;
-    if (!open(filePath, write))
+    FileSource source;
+    if (!source.open(filePath) || source.size() == 0)
         return false;
 
-    bytes = size(filePath);
-    if (bytes == 0)
-    {
-        close();
-        return false;
-    }
-
+    bytes = static_cast<size_t>(source.size());
     file = new uint8_t[bytes];
 
-    if (!read(file, bytes))
+    const uint8_t* content = source.read(0, bytes, file);
+    if (content == nullptr)
     {
         delete[] file;
         file = nullptr;
-        close();
         return false;
     }
-
-    close();
+    if (content != file)
+        memcpy(file, content, bytes);
     return true;
 }
 
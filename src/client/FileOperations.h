@@ -14,7 +14,7 @@ public:
     FileOperations(FileOperations&& other) noexcept = delete;
     FileOperations& operator=(const FileOperations& other) = delete;
     FileOperations& operator=(FileOperations&& other) noexcept = delete;
-    bool open(const std::string& filePath, bool write);
+    bool open(const std::string& filePath, bool write, bool append = false);
     void close();
     bool read(uint8_t* const dest, const size_t bytes) const;
     bool write(const uint8_t* const src, const size_t bytes) const;
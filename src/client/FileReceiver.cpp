@@ -0,0 +1,293 @@
+#include "FileReceiver.h"
+#include "AESWrapper.h"
+#include "AEADMessage.h"
+#include "LocalStorage.h"
+#include "WireCodec.h"
+#include <boost/filesystem.hpp>
+
+// Constructor, starts the writer
+FileReceiver::FileReceiver()
+    : _inFlightBytes(0)
+    , _files(0)
+    , _stop(false)
+    , _file(nullptr)
+    , _current(0)
+    , _aead(false)
+    , _nextChunk(0)
+{
+    _writer = std::thread(&FileReceiver::run, this);
+}
+
+// Destructor, a receiver dropped on an error still waits for its writer
+FileReceiver::~FileReceiver()
+{
+    if (_writer.joinable())
+    {
+        std::vector<std::string> errors;
+        finish(errors);
+    }
+}
+
+size_t FileReceiver::begin(std::shared_ptr<const AESWrapper> aes, const std::string& path, const bool aead)
+{
+    Job job;
+    job.type = JOB_BEGIN;
+    job.aes = std::move(aes);
+    job.aead = aead;
+    job.path = path;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        job.file = _files++;
+        _errors.emplace_back();
+    }
+    const size_t file = job.file;
+    push(std::move(job));
+    return file;
+}
+
+void FileReceiver::write(const uint8_t* cipher, const size_t size)
+{
+    if (size == 0)
+        return;
+    Job job;
+    job.type = JOB_DATA;
+    job.file = _files - 1;
+    job.cipher.assign(cipher, cipher + size);
+    push(std::move(job));
+}
+
+void FileReceiver::end()
+{
+    Job job;
+    job.type = JOB_END;
+    job.file = _files - 1;
+    push(std::move(job));
+}
+
+void FileReceiver::finish(std::vector<std::string>& errors)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+    if (_writer.joinable())
+        _writer.join();
+    errors = _errors;
+}
+
+//This function queues a job for the writer, it blocks while too much ciphertext is waiting
+void FileReceiver::push(Job job)
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const size_t size = job.cipher.size();
+        _drained.wait(lock, [this, size]() { return _inFlightBytes == 0 || _inFlightBytes + size <= FILE_RECEIVE_IN_FLIGHT_BYTES; });
+        _inFlightBytes += size;
+        _jobs.push_back(std::move(job));
+    }
+    _wake.notify_one();
+}
+
+//The writer thread: takes the jobs in order and does the decryption and the disk work without the lock
+void FileReceiver::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _wake.wait(lock, [this] { return _stop || !_jobs.empty(); });
+        if (_jobs.empty())
+            break;  // stopped and everything is written
+        Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        const size_t size = job.cipher.size();
+        lock.unlock();
+
+        switch (job.type)
+        {
+        case JOB_BEGIN:
+            open(job);
+            break;
+        case JOB_DATA:
+            if (_aead)
+                openChunks(job);
+            else
+                decrypt(job);
+            break;
+        case JOB_END:
+            complete(job.file);
+            break;
+        }
+
+        lock.lock();
+        _inFlightBytes -= size;
+        _drained.notify_all();
+    }
+    lock.unlock();
+    if (_file != nullptr)
+        fail(_current, "The file transfer was cut off.");
+}
+
+void FileReceiver::open(Job& job)
+{
+    if (_file != nullptr)
+        fail(_current, "The file transfer was cut off.");
+    _current = job.file;
+    _path = job.path;
+    _aes = std::move(job.aes);
+    _decryptor.reset(new AESStreamDecryptor(*_aes));
+    _aead = job.aead;
+    _opener.reset();
+    _nextChunk = 0;
+    _carry.clear();
+    _file = LocalStorage::openFile(_path + ".part", "wb");
+    if (_file == nullptr)
+        fail(_current, "Couldn't open " + _path);
+}
+
+//This function decrypts the whole blocks it has and writes them, the last block is held back for the padding
+void FileReceiver::decrypt(Job& job)
+{
+    if (_file == nullptr || job.file != _current)
+        return;
+    std::vector<uint8_t>& cipher = job.cipher;
+    if (!_carry.empty())
+    {
+        _carry.insert(_carry.end(), cipher.begin(), cipher.end());
+        cipher.swap(_carry);
+    }
+    size_t whole = cipher.size() - cipher.size() % AESWrapper::BLOCK_SIZE;
+    if (whole == cipher.size() && whole > 0)
+        whole -= AESWrapper::BLOCK_SIZE;
+
+    if (whole > 0)
+    {
+        _plain.resize(whole);
+        _decryptor->update(cipher.data(), whole, _plain.data());
+        if (fwrite(_plain.data(), 1, whole, _file) != whole)
+        {
+            fail(_current, "Couldn't write " + _path);
+            return;
+        }
+    }
+    _carry.assign(cipher.begin() + whole, cipher.end());
+}
+
+//This function opens the AEAD chunks that are in whole and writes them, the rest waits for the next piece
+void FileReceiver::openChunks(Job& job)
+{
+    if (_file == nullptr || job.file != _current)
+        return;
+    std::vector<uint8_t>& sealed = job.cipher;
+    if (!_carry.empty())
+    {
+        _carry.insert(_carry.end(), sealed.begin(), sealed.end());
+        sealed.swap(_carry);
+    }
+
+    size_t used = 0;
+    if (!_opener)
+    {
+        if (sealed.size() < WireCodec::size<AEADHeader>())
+        {
+            _carry.swap(sealed);
+            return;
+        }
+        AEADHeader header;
+        WireCodec::decode(sealed.data(), header);
+        if (!AEADMessage::valid(header))
+        {
+            fail(_current, "Decryption failed.");
+            return;
+        }
+        _opener.reset(new AEADMessage(_aes->getKey(), header));
+        used = WireCodec::size<AEADHeader>();
+    }
+
+    uint64_t count = 0;
+    size_t bytes = 0;
+    while (_nextChunk + count < _opener->chunkCount() &&
+        sealed.size() - used - bytes >= _opener->sealedChunkSize(_nextChunk + count))
+    {
+        bytes += _opener->sealedChunkSize(_nextChunk + count);
+        ++count;
+    }
+    if (count > 0)
+    {
+        const size_t plainBytes = bytes - static_cast<size_t>(count) * AEADMessage::TAG_SIZE;
+        _plain.resize(plainBytes);
+        if (!_opener->openChunks(_nextChunk, count, sealed.data() + used, _plain.data()))
+        {
+            fail(_current, "Decryption failed.");
+            return;
+        }
+        if (plainBytes > 0 && fwrite(_plain.data(), 1, plainBytes, _file) != plainBytes)
+        {
+            fail(_current, "Couldn't write " + _path);
+            return;
+        }
+        _nextChunk += count;
+        used += bytes;
+    }
+    _carry.assign(sealed.begin() + used, sealed.end());
+}
+
+//This function writes the last block, syncs the file and gives it its name
+void FileReceiver::complete(const size_t file)
+{
+    if (_file == nullptr || file != _current)
+        return;
+    size_t plainSize = 0;
+    if (_aead)
+    {
+        // every chunk the header announced and nothing after them
+        if (!_opener || _nextChunk != _opener->chunkCount() || !_carry.empty())
+        {
+            fail(_current, "Decryption failed.");
+            return;
+        }
+    }
+    else
+    {
+        _plain.resize(_carry.size());
+        try {
+            plainSize = _decryptor->final(_carry.data(), _carry.size(), _plain.data());
+        }
+        catch (...) {
+            fail(_current, "Decryption failed.");
+            return;
+        }
+    }
+    if ((plainSize > 0 && fwrite(_plain.data(), 1, plainSize, _file) != plainSize) || !LocalStorage::syncToDisk(_file))
+    {
+        fail(_current, "Couldn't write " + _path);
+        return;
+    }
+    fclose(_file);
+    _file = nullptr;
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(_path + ".part", _path, ec);
+    if (ec)
+    {
+        boost::filesystem::remove(_path + ".part", ec);
+        fail(_current, "Couldn't write " + _path);
+        return;
+    }
+    // the rename itself is only durable once the directory is
+    if (!LocalStorage::syncDirectory(boost::filesystem::path(_path).parent_path().string()))
+        fail(_current, "Couldn't sync the directory of " + _path);
+}
+
+void FileReceiver::fail(const size_t file, const std::string& error)
+{
+    if (_file != nullptr && file == _current)
+    {
+        fclose(_file);
+        _file = nullptr;
+        boost::system::error_code ec;
+        boost::filesystem::remove(_path + ".part", ec);
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _errors[file] = error;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <condition_variable>
+
+class AESWrapper;
+class AESStreamDecryptor;
+class AEADMessage;
+
+const size_t FILE_RECEIVE_IN_FLIGHT_BYTES = 16 * 1024 * 1024;  // ciphertext waiting for the writer, bounds the memory of a big file
+
+//This class writes received files to disk on its own thread. The ciphertext is handed over in pieces as it comes
+//off the socket, the writer decrypts it into a temporary file next to the final one that is synced to disk
+//and renamed once the last piece is in, so a file under its final name is always complete.
+//A MSG_SEND_FILE_AEAD file is opened chunk by chunk, every chunk is checked against its tag before it is written.
+class FileReceiver
+{
+public:
+    FileReceiver();
+    virtual ~FileReceiver();
+    FileReceiver(const FileReceiver& other) = delete;
+    FileReceiver(FileReceiver&& other) noexcept = delete;
+    FileReceiver& operator=(const FileReceiver& other) = delete;
+    FileReceiver& operator=(FileReceiver&& other) noexcept = delete;
+
+    // starts the next file, returns its number, aead if the ciphertext is an AEADMessage under the key of aes
+    size_t begin(std::shared_ptr<const AESWrapper> aes, const std::string& path, const bool aead);
+    // next piece of the current file, cipher is copied, blocks while too much is waiting for the writer
+    void write(const uint8_t* cipher, const size_t size);
+    // the current file is complete
+    void end();
+    // waits for the writer, errors[number] is empty if that file was written, a file that was not ended is dropped
+    void finish(std::vector<std::string>& errors);
+
+private:
+    enum JobType { JOB_BEGIN, JOB_DATA, JOB_END };
+
+    struct Job
+    {
+        JobType type;
+        size_t file;
+        std::shared_ptr<const AESWrapper> aes;
+        bool aead;
+        std::string path;
+        std::vector<uint8_t> cipher;
+    };
+
+    void push(Job job);
+    void run();
+    void open(Job& job);
+    void decrypt(Job& job);
+    void openChunks(Job& job);
+    void complete(const size_t file);
+    void fail(const size_t file, const std::string& error);
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _drained;
+    std::deque<Job> _jobs;
+    size_t _inFlightBytes;
+    size_t _files;
+    bool _stop;
+    std::vector<std::string> _errors;
+    std::thread _writer;
+
+    // the writer's file
+    FILE* _file;
+    size_t _current;
+    std::string _path;
+    std::shared_ptr<const AESWrapper> _aes;
+    std::unique_ptr<AESStreamDecryptor> _decryptor;
+    bool _aead;
+    std::unique_ptr<AEADMessage> _opener;   // AEAD files, made once the header is in
+    uint64_t _nextChunk;
+    std::vector<uint8_t> _carry;    // blocks held back, the last one carries the padding, or the start of the next AEAD chunk
+    std::vector<uint8_t> _plain;
+};
@@ -0,0 +1,166 @@
+#include "FileSource.h"
+#include <algorithm>
+#include <cstring>
+#include <boost/filesystem.hpp>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::read_only;
+
+// Constructor
+FileSource::FileSource()
+    : _size(0)
+    , _open(false)
+    , _regionOffset(0)
+#ifndef _WIN32
+    , _fd(-1)
+#endif
+{
+}
+
+// Destructor
+FileSource::~FileSource()
+{
+    close();
+}
+
+//This function opens the file for reading, it is mapped if the file system allows it.
+bool FileSource::open(const std::string& filePath)
+{
+    close();
+    try
+    {
+        _size = boost::filesystem::file_size(filePath);
+    }
+    catch (const boost::filesystem::filesystem_error&)
+    {
+        return false;
+    }
+    _path = filePath;
+
+    if (_size > 0)
+    {
+        try
+        {
+            _mapping.reset(new file_mapping(filePath.c_str(), read_only));
+        }
+        catch (const std::exception&)
+        {
+            _mapping.reset();
+        }
+    }
+
+    if (_mapping == nullptr)
+    {
+#ifdef _WIN32
+        _stream.reset(new std::ifstream(filePath, std::ios::binary | std::ios::in));
+        if (!_stream->is_open())
+        {
+            _stream.reset();
+            return false;
+        }
+#else
+        _fd = ::open(filePath.c_str(), O_RDONLY);
+        if (_fd < 0)
+            return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+    }
+    _open = true;
+    return true;
+}
+
+//this function closes the file and drops the mapping
+void FileSource::close()
+{
+    _region.reset();
+    _mapping.reset();
+    _regionOffset = 0;
+#ifdef _WIN32
+    _stream.reset();
+#else
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+#endif
+    _size = 0;
+    _open = false;
+    _path.clear();
+}
+
+//This function maps the window of the file that holds [offset, offset + length), the kernel reads it ahead sequentially
+bool FileSource::mapWindow(const uint64_t offset, const size_t length)
+{
+    if (_region != nullptr && offset >= _regionOffset && offset + length <= _regionOffset + _region->get_size())
+        return true;
+
+    _region.reset();
+    const size_t windowSize = static_cast<size_t>(std::min<uint64_t>(std::max(length, MAP_WINDOW_SIZE), _size - offset));
+    try
+    {
+        _region.reset(new mapped_region(*_mapping, read_only, static_cast<boost::interprocess::offset_t>(offset), windowSize));
+        _region->advise(mapped_region::advice_sequential);
+        _regionOffset = offset;
+    }
+    catch (const std::exception&)
+    {
+        _region.reset();
+        return false;
+    }
+    return true;
+}
+
+//This function reads with the file position given explicitly, used when the file could not be mapped
+bool FileSource::readFallback(const uint64_t offset, const size_t length, uint8_t* const scratch)
+{
+#ifdef _WIN32
+    if (_stream == nullptr && !_path.empty())
+        _stream.reset(new std::ifstream(_path, std::ios::binary | std::ios::in));
+    if (_stream == nullptr || !_stream->is_open())
+        return false;
+    _stream->clear();
+    _stream->seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    _stream->read(reinterpret_cast<char*>(scratch), length);
+    return _stream->gcount() == static_cast<std::streamsize>(length);
+#else
+    if (_fd < 0 && !_path.empty())
+        _fd = ::open(_path.c_str(), O_RDONLY);
+    if (_fd < 0)
+        return false;
+    size_t done = 0;
+    while (done < length)
+    {
+        const ssize_t bytes = ::pread(_fd, scratch + done, length - done, static_cast<off_t>(offset + done));
+        if (bytes <= 0)
+            return false;
+        done += static_cast<size_t>(bytes);
+    }
+    return true;
+#endif
+}
+
+//This function returns the requested bytes, in place from the mapping when possible otherwise copied into scratch
+const uint8_t* FileSource::read(const uint64_t offset, const size_t length, uint8_t* const scratch)
+{
+    if (!_open || offset > _size || length > _size - offset)
+        return nullptr;
+    if (length == 0)
+        return scratch;
+
+    if (_mapping != nullptr)
+    {
+        if (mapWindow(offset, length))
+            return static_cast<const uint8_t*>(_region->get_address()) + (offset - _regionOffset);
+        _mapping.reset();  // mapping the window failed, read the rest of the file instead
+    }
+
+    if (scratch == nullptr || !readFallback(offset, length, scratch))
+        return nullptr;
+    return scratch;
+}
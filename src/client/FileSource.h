@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+const size_t MAP_WINDOW_SIZE = 64 * 1024 * 1024;  // how much of the file is mapped at a time, keeps 32-bit builds in address space
+
+//This class gives read-only access to a file through a memory mapping, the bytes are used in place.
+//Files that can't be mapped (network shares, pipes, empty files) are read with pread / a stream instead.
+class FileSource
+{
+public:
+    FileSource();
+    virtual ~FileSource();
+    FileSource(const FileSource& other) = delete;
+    FileSource(FileSource&& other) noexcept = delete;
+    FileSource& operator=(const FileSource& other) = delete;
+    FileSource& operator=(FileSource&& other) noexcept = delete;
+
+    bool open(const std::string& filePath);
+    void close();
+    uint64_t size() const { return _size; }
+    bool isOpen() const { return _open; }
+    bool isMapped() const { return _mapping != nullptr; }
+
+    // bytes [offset, offset + length) of the file, points into the mapping or into scratch, nullptr on error
+    const uint8_t* read(const uint64_t offset, const size_t length, uint8_t* const scratch);
+
+private:
+    bool mapWindow(const uint64_t offset, const size_t length);
+    bool readFallback(const uint64_t offset, const size_t length, uint8_t* const scratch);
+
+private:
+    std::string _path;
+    uint64_t    _size;
+    bool        _open;
+    std::unique_ptr<boost::interprocess::file_mapping>  _mapping;
+    std::unique_ptr<boost::interprocess::mapped_region> _region;   // current window of the mapping
+    uint64_t    _regionOffset;
+#ifdef _WIN32
+    std::unique_ptr<std::ifstream> _stream;
+#else
+    int         _fd;
+#endif
+};
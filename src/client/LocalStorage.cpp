@@ -0,0 +1,110 @@
+#include "LocalStorage.h"
+#include "AESWrapper.h"
+#include "FileSource.h"
+#include <cstring>
+#include <sha.h>
+#include <hkdf.h>
+#include <boost/crc.hpp>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+SymmetricKey LocalStorage::deriveKey(const ClientID& self, const std::string& privateKey, const std::string& purpose)
+{
+    SymmetricKey key;
+    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+    hkdf.DeriveKey(key.symmetricKey, sizeof(key.symmetricKey),
+        reinterpret_cast<const CryptoPP::byte*>(privateKey.data()), privateKey.size(),
+        self.uuid, sizeof(self.uuid),
+        reinterpret_cast<const CryptoPP::byte*>(purpose.data()), purpose.size());
+    return key;
+}
+
+std::vector<uint8_t> LocalStorage::seal(const AESWrapper& aes, const uint8_t* plain, const size_t size)
+{
+    std::vector<uint8_t> block(AESWrapper::BLOCK_SIZE + size);
+    AESWrapper::GenerateKey(block.data(), AESWrapper::BLOCK_SIZE);
+    if (size > 0)
+        memcpy(block.data() + AESWrapper::BLOCK_SIZE, plain, size);
+
+    std::vector<uint8_t> cipher(AESWrapper::cipherSize(block.size()));
+    cipher.resize(aes.encrypt(block.data(), block.size(), cipher.data()));
+    return cipher;
+}
+
+bool LocalStorage::unseal(const AESWrapper& aes, const uint8_t* cipher, const size_t size, std::vector<uint8_t>& plain)
+{
+    if (size < 2 * AESWrapper::BLOCK_SIZE || size % AESWrapper::BLOCK_SIZE != 0)
+        return false;
+    std::vector<uint8_t> block(size);
+    size_t plainSize = 0;
+    try
+    {
+        plainSize = aes.decrypt(cipher, size, block.data());
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    if (plainSize < AESWrapper::BLOCK_SIZE)
+        return false;
+    plain.assign(block.begin() + AESWrapper::BLOCK_SIZE, block.begin() + plainSize);
+    return true;
+}
+
+FILE* LocalStorage::openFile(const std::string& path, const char* mode)
+{
+#ifdef _WIN32
+    FILE* file = nullptr;
+    return fopen_s(&file, path.c_str(), mode) == 0 ? file : nullptr;
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+bool LocalStorage::syncToDisk(FILE* file)
+{
+    if (fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool LocalStorage::syncDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    const int directory = open(path.empty() ? "." : path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directory < 0)
+        return false;
+    const bool synced = fsync(directory) == 0;
+    close(directory);
+    return synced;
+#endif
+}
+
+uint32_t LocalStorage::checksum(const uint8_t* data, const size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+bool LocalStorage::readWhole(FileSource& source, std::vector<uint8_t>& scratch, const uint8_t*& data)
+{
+    data = nullptr;
+    if (source.size() == 0)
+        return true;
+    if (!source.isMapped())
+        scratch.resize(static_cast<size_t>(source.size()));
+    data = source.read(0, static_cast<size_t>(source.size()), scratch.data());
+    return data != nullptr;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include "protocol.h"
+
+class AESWrapper;
+class FileSource;
+
+//This class holds what the files the client keeps for itself (peer directory, message history) have in common:
+//the key they are encrypted under, sealing of a block of data and writing it safely.
+class LocalStorage
+{
+public:
+    // key for one kind of file, derived with HKDF-SHA256 from the private key and the client id
+    static SymmetricKey deriveKey(const ClientID& self, const std::string& privateKey, const std::string& purpose);
+
+    // plaintext behind one random block (the zero IV then only ever meets random data), encrypted
+    static std::vector<uint8_t> seal(const AESWrapper& aes, const uint8_t* plain, const size_t size);
+    // false if the data was written with another key or is damaged
+    static bool unseal(const AESWrapper& aes, const uint8_t* cipher, const size_t size, std::vector<uint8_t>& plain);
+
+    static FILE* openFile(const std::string& path, const char* mode);
+    // the data is on the disk, not only in the OS cache
+    static bool syncToDisk(FILE* file);
+    // a file created or renamed in the directory survives a power cut, nothing to do on Windows
+    static bool syncDirectory(const std::string& path);
+    static uint32_t checksum(const uint8_t* data, const size_t size);
+    // the whole file, in place from the mapping when possible
+    static bool readWhole(FileSource& source, std::vector<uint8_t>& scratch, const uint8_t*& data);
+};
@@ -1,11 +1,21 @@
 ﻿#include "MainLogic.h"
 #include "FileOperations.h"
+#include "FileSource.h"
 #include "SocketHandler.h"
 #include "FileIO.h"
 #include "Communication.h"
 #include "Encoder.h"
 #include "RSAWrapper.h"
 #include "AESWrapper.h"
+#include "AESCipherCache.h"
+#include "RSAEncryptorCache.h"
+#include "PeerDirectory.h"
+#include "MessageLog.h"
+#include "EncryptedMessages.h"
+#include "RSAKeyPool.h"
+#include <atomic>
+#include <thread>
+#include <boost/filesystem.hpp>
 
 
 
@@ -15,7 +25,11 @@ MainLogic::MainLogic()
     _socketHandler(std::make_unique<SocketHandler>()),
     _rsaDecryptor(nullptr),
     _fileIO(std::make_unique<FileIO>(_fileHandler)),
-    _communication(std::make_unique<Communication>(_socketHandler.get(), _fileHandler))
+    _aesCiphers(std::make_unique<AESCipherCache>()),
+    _rsaEncryptors(std::make_unique<RSAEncryptorCache>()),
+    _communication(std::make_unique<Communication>(_socketHandler.get(), _fileHandler, _aesCiphers.get(), _rsaEncryptors.get())),
+    _peerDirectory(std::make_unique<PeerDirectory>()),
+    _messageLog(std::make_unique<MessageLog>())
 {
 }
 
@@ -52,10 +66,27 @@ bool MainLogic::parseServeInfo()
         setError("Invalid server address or port.");
         return false;
     }
+    _socketHandler->warmUp();  // first request will not wait for the handshake, failure is not fatal here
     return true;
 }
 
 
+//This function makes every message fill whole PACKET_SIZE packets, for servers that read fixed packets
+
+void MainLogic::setPaddedFraming(const bool enabled)
+{
+    _socketHandler->setFraming(enabled ? SocketHandler::Framing::Padded : SocketHandler::Framing::Exact);
+}
+
+
+//This function pools connections after a response, for servers that keep them open (server.py closes them)
+
+void MainLogic::setKeepAlive(const bool enabled)
+{
+    _socketHandler->setKeepAlive(enabled);
+}
+
+
 // this Reads client(username, UUID, private key and validates & sets them.
 bool MainLogic::parseClientInfo()
 {
@@ -127,13 +158,13 @@ bool MainLogic::clientInputCorrectness(const std::string& username)
  */
 bool MainLogic::validateAndSetClientData(const std::string& hexUuid, const std::string& base64PrivateKey)
 {
-    std::string uuidBin = Encoder::hexToBytes(hexUuid);
-    if (uuidBin.size() != CLIENT_ID_SIZE)
+    uint8_t uuid[CLIENT_ID_SIZE];
+    if (hexUuid.size() != 2 * CLIENT_ID_SIZE || !Encoder::hexToBytes(hexUuid.data(), hexUuid.size(), uuid))
     {
         setError("Invalid UUID size in CLIENT_INFO");
         return false;
     }
-    std::copy_n(uuidBin.data(), CLIENT_ID_SIZE, _self.id.uuid);
+    std::copy_n(uuid, CLIENT_ID_SIZE, _self.id.uuid);
 
     std::string decodedPrivateKey = Encoder::decode(base64PrivateKey);
     if (decodedPrivateKey.empty())
@@ -156,12 +187,24 @@ bool MainLogic::validateAndSetClientData(const std::string& hexUuid, const std::
 
 bool MainLogic::initializeRSAKeys(std::string& pubKey)
 {
-    try {
-        _rsaDecryptor.reset(new RSAPrivateWrapper());
+    if (_keyPool)
+    {
+        std::string errorMsg;
+        if (!_keyPool->take(_rsaDecryptor, errorMsg))
+        {
+            setError(errorMsg);
+            return false;
+        }
     }
-    catch (const std::exception& ex) {
-        setError("RSA Error: " + std::string(ex.what()));
-        return false;
+    else
+    {
+        try {
+            _rsaDecryptor.reset(new RSAPrivateWrapper());
+        }
+        catch (const std::exception& ex) {
+            setError("RSA Error: " + std::string(ex.what()));
+            return false;
+        }
     }
     pubKey = _rsaDecryptor->getPublicKey();
     if (pubKey.size() != PUBLIC_KEY_SIZE)
@@ -173,6 +216,16 @@ bool MainLogic::initializeRSAKeys(std::string& pubKey)
 }
 
 
+//This function starts generating the key pair of the registration in the background, so registering
+//waits only for the server
+
+void MainLogic::prepareRegistration()
+{
+    if (!_keyPool)
+        _keyPool.reset(new RSAKeyPool());
+}
+
+
 //this function Registers the client in the server.
 
 bool MainLogic::registerUser(const std::string& username)
@@ -201,6 +254,77 @@ bool MainLogic::registerUser(const std::string& username)
         setError("Failed storeClientInfo after registration.");
         return false;
     }
+    // a directory left by an earlier registration is replaced by the first users list
+    openLocalStorage();
+    _keyPool.reset();
+    return true;
+}
+
+
+/**
+ * This function registers every username with its own key pair and writes its identity, in the CLIENT_INFO
+ * format, to folder/<username>/CLIENT_INFO. Key pairs are generated on every processor ahead of the
+ * registrations, which go out BULK_REGISTER_CONNECTIONS at a time, each on its own connection.
+ * errors[i] is empty if usernames[i] was registered, returns true if all of them were.
+ */
+bool MainLogic::bulkRegister(const std::vector<std::string>& usernames, const std::string& folder, std::vector<std::string>& errors)
+{
+    errors.assign(usernames.size(), std::string());
+    std::string address, port, errorMsg;
+    if (!_fileIO->parseServeInfo(address, port, errorMsg))
+    {
+        setError(errorMsg);
+        return false;
+    }
+    for (size_t i = 0; i < usernames.size(); ++i)
+    {
+        if (!clientInputCorrectness(usernames[i]))
+            errors[i] = getCurrentError();
+    }
+    clearcurrentError();
+
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    RSAKeyPool keys(2 * threads, threads);
+    std::atomic<size_t> next(0);
+    auto registerNext = [&]() {
+        SocketHandler socketHandler;
+        socketHandler.setSocketInfo(port, address);
+        socketHandler.setFraming(_socketHandler->getFraming());
+        socketHandler.setKeepAlive(_socketHandler->getKeepAlive());
+        auto fileHandler = std::make_shared<FileOperations>();
+        Communication communication(&socketHandler, fileHandler, _aesCiphers.get(), _rsaEncryptors.get());
+        FileIO fileIO(fileHandler);
+        for (size_t i = next++; i < usernames.size(); i = next++)
+        {
+            std::unique_ptr<RSAPrivateWrapper> key;
+            if (!errors[i].empty() || !keys.take(key, errors[i]))
+                continue;
+            RESRegistration response;
+            if (!communication.sendRegistrationRequest(usernames[i], key->getPublicKey(), response, errors[i]))
+                continue;
+
+            const boost::filesystem::path identity = boost::filesystem::path(folder) / usernames[i];
+            boost::system::error_code ec;
+            boost::filesystem::create_directories(identity, ec);
+            fileIO.storeClientInfo((identity / CLIENT_INFO).string(), Encoder::bytesToHex(response.payload.uuid, CLIENT_ID_SIZE),
+                usernames[i], key->getPrivateKey(), errors[i]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(BULK_REGISTER_CONNECTIONS, usernames.size()); ++i)
+        workers.emplace_back(registerNext);
+    registerNext();
+    for (auto& worker : workers)
+        worker.join();
+
+    const size_t failed = static_cast<size_t>(std::count_if(errors.begin(), errors.end(),
+        [](const std::string& error) { return !error.empty(); }));
+    if (failed > 0)
+    {
+        setError(std::to_string(failed) + " of " + std::to_string(usernames.size()) + " users were not registered.");
+        return false;
+    }
     return true;
 }
 
@@ -209,19 +333,42 @@ bool MainLogic::registerUser(const std::string& username)
  
 bool MainLogic::requestClientsList()
 {
-    std::vector<Client> tempClients;
+    ClientRoster tempClients;
+    RosterETag etag;
+    bool notModified = false;
     std::string errorMsg;
-    if (!_communication->requestAndParseClientsList(_self.id, tempClients, errorMsg))
+    const RosterETag* ifNoneMatch = (_conditionalUsersList && _rosterETagSet) ? &_rosterETag : nullptr;
+    if (!_communication->requestAndParseClientsList(_self.id, ifNoneMatch, tempClients, etag, notModified, errorMsg))
     {
         setError(errorMsg);
         return false;
     }
+    _rosterChanges = ClientRoster::MergeResult();
+    if (notModified)
+        return true;
     if (tempClients.empty())
     {
         setError("Server has no users registered. Empty Clients list.");
         return false;
     }
-    this->clients = tempClients; 
+
+    // users that stay keep their keys, the caches of the ones that left are dropped
+    _rosterChanges = _roster.merge(std::move(tempClients));
+    for (const auto& removed : _rosterChanges.removed)
+    {
+        _aesCiphers->invalidate(removed.id);
+        _rsaEncryptors->invalidate(removed.id);
+    }
+    _rosterETag = etag;
+    _rosterETagSet = true;
+
+    // a few changes go to the journal, a list that mostly changed is written as a new snapshot
+    if (_rosterChanges.initial || (_rosterChanges.added.size() + _rosterChanges.removed.size()) * 4 > _roster.size())
+        storePeerDirectory();
+    else
+        savePeerChange([this](PeerDirectory& directory, std::string& error) {
+            return directory.recordChanges(_rosterChanges, &_rosterETag, error);
+        });
     return true;
 }
 
@@ -233,19 +380,23 @@ bool MainLogic::requestClientPublicKey(const std::string& username)
     ClientID clientId;
     PublicKey publicKey;
     std::string errorMsg;
-    if (!_communication->requestAndParsePublicKey(_self.id, username, clientId, publicKey, errorMsg))
+    if (!_communication->requestAndParsePublicKey(_self.id, _roster, username, clientId, publicKey, errorMsg))
     {
         setError(errorMsg);
         return false;
     }
-    for (auto& client : clients)
+    const ClientRoster::Handle client = _roster.handle(clientId);
+    if (client != ClientRoster::INVALID_HANDLE)
     {
-        if (client.id == clientId)
-        {
-            client.publicKey = publicKey;
-            client.publicKeySet = true;
-            return true;
-        }
+        // the cached encryptor was built from the old key
+        const PublicKey* previous = _roster.publicKey(client);
+        if (previous != nullptr && memcmp(previous->publicKey, publicKey.publicKey, PUBLIC_KEY_SIZE) != 0)
+            _rsaEncryptors->invalidate(clientId);
+        _roster.setPublicKey(client, publicKey);
+        savePeerChange([&](PeerDirectory& directory, std::string& error) {
+            return directory.recordPublicKey(clientId, publicKey, error);
+        });
+        return true;
     }
     setError("Client was not found after fetching public key.");
     return false;
@@ -261,85 +412,242 @@ bool MainLogic::requestPendingMessages(std::vector<Message>& messages)
     if (!_communication->requestAndParsePendingMessages(
         _self.id,
         messages,
-        clients,
+        _roster,
         _rsaDecryptor.get(),
         [this](const ClientID& clientId, const SymmetricKey& symKey) {
             return setClientSymmetricKey(clientId, symKey);
         },
+        [this](const ClientID& clientId, const uint8_t version) {
+            setClientMessageVersion(clientId, version);
+        },
         errorMsg))
     {
         setError(errorMsg);
+        logMessages(messages);
         return false;
     }
+    logMessages(messages);
     return true;
 }
 
 
+//This function hands the received messages to the history log, the server has deleted them by now
 
-//This function Sets the symmetric key for a given client.
+void MainLogic::logMessages(const std::vector<Message>& messages)
+{
+    for (const auto& message : messages)
+    {
+        if (!message.encrypted)
+        {
+            _messageLog->append(message.senderId, message.username, message.content);
+            continue;
+        }
+        // decrypted by the log's writer, not while the user waits for the messages
+        const std::shared_ptr<EncryptedMessages> encrypted = message.encrypted;
+        const size_t slot = message.slot;
+        _messageLog->append(message.senderId, message.username, [encrypted, slot]() { return encrypted->decrypt(slot); });
+    }
+}
 
-bool MainLogic::setClientSymmetricKey(const ClientID& clientID, const SymmetricKey& symmetricKey)
+
+std::string MainLogic::Message::text() const
 {
-    for (auto& client : clients)
+    return encrypted ? encrypted->content(slot) : content;
+}
+
+
+//This function returns the last messages received from username, or from everyone if username is empty
+
+bool MainLogic::getHistory(const std::string& username, const size_t limit, std::vector<LoggedMessage>& messages)
+{
+    clearcurrentError();
+    ClientID peer;
+    if (!username.empty())
     {
-        if (client.id == clientID)
+        const ClientRoster::Handle client = _roster.handle(username);
+        if (client == ClientRoster::INVALID_HANDLE)
         {
-            client.symmetricKey = symmetricKey;
-            client.symmetricKeySet = true;
-            return true;
+            setError("The user name '" + username + "' has not found.");
+            return false;
         }
+        peer = _roster.id(client);
     }
-    return false;
+    std::string errorMsg;
+    if (!_messageLog->query(username.empty() ? nullptr : &peer, 0, UINT64_MAX, limit, messages, errorMsg))
+    {
+        setError(errorMsg);
+        return false;
+    }
+    return true;
+}
+
+
+//This function returns the last messages that hold every word of text
+
+bool MainLogic::searchHistory(const std::string& text, const size_t limit, std::vector<LoggedMessage>& messages)
+{
+    clearcurrentError();
+    std::string errorMsg;
+    if (!_messageLog->search(text, limit, messages, errorMsg))
+    {
+        setError(errorMsg);
+        return false;
+    }
+    return true;
+}
+
+
+//This function limits the size of the history, past it the oldest messages are deleted. The history keeps
+//everything unless this is called, MESSAGE_LOG_UNLIMITED turns the limit off again
+
+void MainLogic::setHistoryLimit(const uint64_t bytes)
+{
+    _messageLog->setMaxSize(bytes);
+}
+
+uint64_t MainLogic::getHistoryLimit() const
+{
+    return _messageLog->maxSize();
+}
+
+uint64_t MainLogic::getDroppedHistory() const
+{
+    return _messageLog->droppedMessages();
+}
+
+
+
+//This function Sets the symmetric key for a given client.
+
+bool MainLogic::setClientSymmetricKey(const ClientID& clientID, const SymmetricKey& symmetricKey)
+{
+    const ClientRoster::Handle client = _roster.handle(clientID);
+    if (client == ClientRoster::INVALID_HANDLE)
+        return false;
+    storeSymmetricKey(client, symmetricKey);
+    return true;
+}
+
+
+//This function stores the symmetric key of a user already looked up, the AES cache and the peer directory follow it
+
+void MainLogic::storeSymmetricKey(const ClientRoster::Handle client, const SymmetricKey& symmetricKey)
+{
+    const ClientID clientID = _roster.id(client);
+    _roster.setSymmetricKey(client, symmetricKey);
+    _aesCiphers->invalidate(clientID);
+    savePeerChange([&](PeerDirectory& directory, std::string& error) {
+        return directory.recordSymmetricKey(clientID, symmetricKey, error);
+    });
+}
+
+
+//This function Sets the newest message format a client reads, what it announced with a key request or used itself
+
+void MainLogic::setClientMessageVersion(const ClientID& clientID, const uint8_t version)
+{
+    const ClientRoster::Handle client = _roster.handle(clientID);
+    if (client == ClientRoster::INVALID_HANDLE || _roster.messageVersion(client) == std::min(version, MESSAGE_VERSION))
+        return;
+    _roster.setMessageVersion(client, version);
+    savePeerChange([&](PeerDirectory& directory, std::string& error) {
+        return directory.recordMessageVersion(clientID, version, error);
+    });
+}
+
+
+//This function loads the users and keys saved by the previous session, having none saved is not an error
+
+bool MainLogic::loadPeerDirectory()
+{
+    openLocalStorage();
+    std::string errorMsg;
+    if (!_peerDirectory->load(_roster, _rosterETag, _rosterETagSet, errorMsg))
+    {
+        setError("Couldn't load the saved users list: " + errorMsg);
+        return false;
+    }
+    return true;
+}
+
+
+//This function binds the peer directory and the message history to the client's id and private key
+
+void MainLogic::openLocalStorage()
+{
+    if (!_rsaDecryptor)
+        return;
+    const std::string privateKey = _rsaDecryptor->getPrivateKey();
+    _peerDirectory->open(_self.id, privateKey);
+    std::string errorMsg;
+    if (!_messageLog->open(_self.id, privateKey, errorMsg))
+        setError(errorMsg);   // the client works without a history
+}
+
+
+//This function writes the whole roster as a new snapshot, saving is best effort and never fails the request
+
+void MainLogic::storePeerDirectory()
+{
+    std::string errorMsg;
+    if (_peerDirectory->isOpen())
+        _peerDirectory->store(_roster, _rosterETagSet ? &_rosterETag : nullptr, errorMsg);
+}
+
+
+//This function appends one change to the peer directory, without a snapshot to apply it to or when the
+//journal got long the whole roster is written instead
+
+void MainLogic::savePeerChange(const std::function<bool(PeerDirectory&, std::string&)>& record)
+{
+    if (!_peerDirectory->isOpen())
+        return;
+    std::string errorMsg;
+    if (!_peerDirectory->hasSnapshot() || !record(*_peerDirectory, errorMsg) || _peerDirectory->needsCompaction())
+        storePeerDirectory();
 }
 
 //This function is respondible of sending types of messages to the user.
 bool MainLogic::sendMessage(const std::string& username, const MSGType type, const std::string& data)
 {
-    Client client;
-    if (!validateAndGetClient(username, client))
+    const ClientRoster::Handle client = validateAndGetClient(username);
+    if (client == ClientRoster::INVALID_HANDLE)
         return false;
+    const ClientID& clientId = _roster.id(client);
 
     // במקרים של MSG_SYMMETRIC_KEY_SEND נדרשת גם העברת המפתח הסימטרי
-    const PublicKey* pubKeyPtr = (type == MSG_SYMMETRIC_KEY_SEND ? &client.publicKey : nullptr);
     SymmetricKey symKeyForMessage;
     const SymmetricKey* symKeyPtr = nullptr;
+    MSGType sendType = type;
 
     std::string payload;
     if (type == MSG_SEND_FILE)
     {
-        uint8_t* fileContent = nullptr;
-        size_t fileSize = 0;
-        if (!_fileHandler->readFromFile(data, fileContent, fileSize))
-        {
-            setError("Failed reading file \"" + data + "\"");
-            return false;
-        }
-        payload.assign(reinterpret_cast<char*>(fileContent), fileSize);
-        delete[] fileContent;
-        symKeyPtr = &client.symmetricKey;
+        // files are streamed from disk, they never go through payload
+        return sendFile(client, data);
     }
     else if (type == MSG_SEND_TEXT)
     {
         payload = data;
-        symKeyPtr = &client.symmetricKey;
+        symKeyPtr = _roster.symmetricKey(client);
+        // peers that announced it get the AEAD format, everyone else the original one
+        if (_roster.messageVersion(client) >= MESSAGE_VERSION_AEAD)
+            sendType = MSG_SEND_TEXT_AEAD;
     }
     else if (type == MSG_SYMMETRIC_KEY_SEND)
     {
-        AESWrapper aes;
-        symKeyForMessage = aes.getKey(); 
-        if (!setClientSymmetricKey(client.id, symKeyForMessage))
-        {
-            setError("Failed storing symmetric key for client " + client.username);
-            return false;
-        }
+        AESWrapper::GenerateKey(symKeyForMessage.symmetricKey, sizeof(symKeyForMessage.symmetricKey));
+        storeSymmetricKey(client, symKeyForMessage);
         symKeyPtr = &symKeyForMessage;
     }
+    // taken after the key was stored, storing may move the roster's keys
+    const PublicKey* pubKeyPtr = (type == MSG_SYMMETRIC_KEY_SEND ? _roster.publicKey(client) : nullptr);
 
 
     std::string errorMsg;
 
 
-    bool response = _communication->sendAndEncryptMessage( _self.id,client.id,type,payload,pubKeyPtr,symKeyPtr,errorMsg );
+    bool response = _communication->sendAndEncryptMessage( _self.id,clientId,sendType,payload,pubKeyPtr,symKeyPtr,errorMsg );
 
     if (!response)
         setError(errorMsg);
@@ -349,47 +657,120 @@ bool MainLogic::sendMessage(const std::string& username, const MSGType type, con
 
 
 
-//This function Checks if you  ask for yourself or if a client exist
-
-bool MainLogic::validateAndGetClient(const std::string& username, Client& client)
+//This function sends a file in chunks, a file larger than FILE_PART_SIZE goes as several parts
+//and an interrupted upload continues from the last part the server has acknowledged.
+//Parts are always CBC, a file that fits in one message is sealed with AES-GCM if the peer reads that.
+bool MainLogic::sendFile(const ClientRoster::Handle client, const std::string& filePath)
 {
-    if (username == _self.username)
+    const SymmetricKey* symmetricKey = _roster.symmetricKey(client);
+    if (symmetricKey == nullptr)
     {
-        setError("You cant send message to yourself.");
+        setError("Missing symmetric key.");
         return false;
     }
-    if (!getViaUserName(username, client))
+    const ClientID& clientId = _roster.id(client);
+
+    FileSource source;
+    const uint64_t fileSize = source.open(filePath) ? source.size() : 0;
+    if (fileSize == 0)
     {
-        setError("The user name '" + username + "' has not found.");
+        setError("Failed reading file \"" + filePath + "\"");
         return false;
     }
+
+    std::string errorMsg;
+    if (fileSize <= FILE_PART_SIZE)
+    {
+        const MSGType type = (_roster.messageVersion(client) >= MESSAGE_VERSION_AEAD) ? MSG_SEND_FILE_AEAD : MSG_SEND_FILE;
+        if (!_communication->sendFileContent(_self.id, clientId, type, source, 0, fileSize, nullptr, *symmetricKey, errorMsg))
+        {
+            setError(errorMsg);
+            return false;
+        }
+        return true;
+    }
+
+    FilePartHeader part;
+    part.fileSize = fileSize;
+    part.partCount = static_cast<uint32_t>((fileSize + FILE_PART_SIZE - 1) / FILE_PART_SIZE);
+
+    // a journal of the same file to the same client means an earlier upload was cut off
+    const std::string journalFilePath = FileIO::canonicalPath(filePath);
+    const std::string journal = _fileIO->uploadJournalPath(clientId, journalFilePath);
+    uint32_t nextPart = 0;
+    if (!_fileIO->loadUploadJournal(journal, journalFilePath, fileSize, part.transferId, nextPart))
+        AESWrapper::GenerateKey(reinterpret_cast<uint8_t*>(&part.transferId), sizeof(part.transferId));
+
+    for (part.partIndex = nextPart; part.partIndex < part.partCount; ++part.partIndex)
+    {
+        const uint64_t offset = static_cast<uint64_t>(part.partIndex) * FILE_PART_SIZE;
+        const uint64_t length = std::min(FILE_PART_SIZE, fileSize - offset);
+        if (!_communication->sendFileContent(_self.id, clientId, MSG_SEND_FILE_PART, source, offset, length, &part, *symmetricKey, errorMsg))
+        {
+            setError(errorMsg + " " + std::to_string(part.partIndex) + " of " + std::to_string(part.partCount) +
+                " parts were sent, sending the file again continues from there.");
+            return false;
+        }
+        if (!_fileIO->storeUploadJournal(journal, journalFilePath, fileSize, part.transferId, part.partIndex + 1, errorMsg))
+        {
+            setError(errorMsg);
+            return false;
+        }
+    }
+    _fileIO->removeUploadJournal(journal);
     return true;
 }
 
 
+//This function Checks if you  ask for yourself or if a client exist
+
+ClientRoster::Handle MainLogic::validateAndGetClient(const std::string& username)
+{
+    if (username == _self.username)
+    {
+        setError("You cant send message to yourself.");
+        return ClientRoster::INVALID_HANDLE;
+    }
+    const ClientRoster::Handle client = _roster.handle(username);
+    if (client == ClientRoster::INVALID_HANDLE)
+        setError("The user name '" + username + "' has not found.");
+    return client;
+}
+
+
  //This function returns the list of user names from the current clients list.
 
 std::vector<std::string> MainLogic::getUsernames() const
 {
     std::vector<std::string> userNames;
-    for (const auto& client : clients)
-        userNames.push_back(client.username);
+    userNames.reserve(_roster.size());
+    for (ClientRoster::Handle client = 0; client < _roster.size(); ++client)
+        userNames.emplace_back(_roster.username(client));
+    return userNames;
+}
+
+
+//This function returns one page of the user names starting with prefix in name order, total is the number of matches
+
+std::vector<std::string> MainLogic::getUsernames(const std::string& prefix, const size_t offset, const size_t limit, size_t& total) const
+{
+    const std::pair<size_t, size_t> range = _roster.prefixRange(prefix);
+    total = range.second - range.first;
+    std::vector<std::string> userNames;
+    if (offset >= total)
+        return userNames;
+    const size_t count = std::min(limit, total - offset);
+    userNames.reserve(count);
+    for (size_t position = range.first + offset; position < range.first + offset + count; ++position)
+        userNames.emplace_back(_roster.username(_roster.sortedAt(position)));
     return userNames;
 }
 
 
 //This function checks the name of the user name the client gave exist
 
-bool MainLogic::getViaUserName(const std::string& username, Client& client) const
+ClientRoster::Handle MainLogic::getViaUserName(const std::string& username) const
 {
-    for (const auto& c : clients)
-    {
-        if (c.username == username)
-        {
-            client = c;
-            return true;
-        }
-    }
-    return false;
+    return _roster.handle(username);
 }
 
@@ -11,30 +11,41 @@
 #include <stdexcept>
 #include <cstring>
 #include <cctype>
+#include <functional>
 #include "protocol.h"       
 #include "RSAWrapper.h"    
 #include "AESWrapper.h"    
+#include "ClientRoster.h"
 
 class FileOperations;
 class SocketHandler;
 class RSAPrivateWrapper;
 class FileIO;
 class Communication;
+class AESCipherCache;
+class RSAEncryptorCache;
+class PeerDirectory;
+class EncryptedMessages;
+class MessageLog;
+class RSAKeyPool;
+struct LoggedMessage;
+
+const size_t BULK_REGISTER_CONNECTIONS = 8;   // registrations in flight at once during a bulk registration
 
 class MainLogic {
 public:
-    struct Client {
-        ClientID id;
-        std::string username;
-        PublicKey publicKey;
-        bool publicKeySet = false;
-        SymmetricKey symmetricKey;
-        bool symmetricKeySet = false;
-    };
+    typedef RosterClient Client;
 
     struct Message {
         std::string username;
-        std::string content;
+        std::string content;        // text of a message that came without encryption
+        ClientID senderId;
+        std::string filePath;       // where a received file was written
+        std::shared_ptr<EncryptedMessages> encrypted;   // set while the text is still encrypted
+        size_t slot = 0;
+
+        // the text, an encrypted message is decrypted when this is first called
+        std::string text() const;
     };
 
     MainLogic();
@@ -51,40 +62,72 @@ public:
     bool storeClientInfo();
     bool initializeRSAKeys(std::string& pubKey);
     // Client registration and communication
+    void prepareRegistration();
     bool registerUser(const std::string& username);
+    bool bulkRegister(const std::vector<std::string>& usernames, const std::string& folder, std::vector<std::string>& errors);
     bool requestClientsList();
+    bool loadPeerDirectory();
+    void setConditionalUsersList(const bool enabled) { _conditionalUsersList = enabled; }
+    void setPaddedFraming(const bool enabled);
+    void setKeepAlive(const bool enabled);
+    const ClientRoster::MergeResult& getRosterChanges() const { return _rosterChanges; }
     bool validateAndSetClientData(const std::string& hexUuid, const std::string& base64PrivateKey);
     bool requestClientPublicKey(const std::string& username);
     bool requestPendingMessages(std::vector<Message>& messages);
+    bool getHistory(const std::string& username, const size_t limit, std::vector<LoggedMessage>& messages);
+    bool searchHistory(const std::string& text, const size_t limit, std::vector<LoggedMessage>& messages);
+    void setHistoryLimit(const uint64_t bytes);
+    uint64_t getHistoryLimit() const;
+    uint64_t getDroppedHistory() const;
     bool sendMessage(const std::string& username, const MSGType type, const std::string& data = "");
     bool validateHeader(const RESHeader& header, const RSPCode expectedCode);
     bool setClientSymmetricKey(const ClientID& clientID, const SymmetricKey& symmetricKey);
+    void setClientMessageVersion(const ClientID& clientID, const uint8_t version);
     bool clientInputCorrectness(const std::string& username);
 
     // Client management
     std::vector<std::string> getUsernames() const;
-    bool getViaUserName(const std::string& username, Client& client) const;
-    bool validateAndGetClient(const std::string& username, Client& client);
+    std::vector<std::string> getUsernames(const std::string& prefix, const size_t offset, const size_t limit, size_t& total) const;
+    std::string completeUsername(const std::string& prefix) const { return _roster.complete(prefix); }
+    // INVALID_HANDLE if there is no such user, keys are read through the roster
+    ClientRoster::Handle getViaUserName(const std::string& username) const;
+    ClientRoster::Handle validateAndGetClient(const std::string& username);
 
     // Error handling and self data
     std::string getCurrentError() const { return currentError.str(); }
     std::string getSelfUsername() const { return _self.username; }
     ClientID getSelfClientID() const { return _self.id; }
+    RSAEncryptorCache& getRSAEncryptorCache() const { return *_rsaEncryptors; }
 
 private:
     void clearcurrentError();
     void setError(const std::string& msg);
+    bool sendFile(const ClientRoster::Handle client, const std::string& filePath);
+    void storeSymmetricKey(const ClientRoster::Handle client, const SymmetricKey& symmetricKey);
+    void openLocalStorage();
+    void logMessages(const std::vector<Message>& messages);
+    void storePeerDirectory();
+    void savePeerChange(const std::function<bool(PeerDirectory&, std::string&)>& record);
 
 private:
     Client _self;
-    std::vector<Client> clients;
+    ClientRoster _roster;   // users list in columns, looked up by id and by name
+    ClientRoster::MergeResult _rosterChanges;   // what the last users list refresh changed
+    RosterETag _rosterETag;     // tag of the users list we have
+    bool _rosterETagSet = false;
+    bool _conditionalUsersList = false;   // opt in: send the tag and skip the transfer if the list did not change
     std::stringstream currentError;
 
     std::shared_ptr<FileOperations> _fileHandler;
     std::unique_ptr<SocketHandler> _socketHandler;
     std::unique_ptr<RSAPrivateWrapper> _rsaDecryptor;
+    std::unique_ptr<RSAKeyPool> _keyPool;   // key pair generated ahead while the user is not registered yet
     std::unique_ptr<FileIO> _fileIO;
+    std::unique_ptr<AESCipherCache> _aesCiphers;  // key schedules of the clients' symmetric keys
+    std::unique_ptr<RSAEncryptorCache> _rsaEncryptors;  // parsed public keys of the recently used clients
     std::unique_ptr<Communication> _communication;
+    std::unique_ptr<PeerDirectory> _peerDirectory;  // the roster and its keys saved across restarts
+    std::unique_ptr<MessageLog> _messageLog;        // every message received, the server keeps none once delivered
 };
 
 #endif 
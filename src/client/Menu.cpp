@@ -10,9 +10,14 @@ cryptopp
 
 
 #include "Menu.h"
+#include "MessageLog.h"
 #include <iostream>
+#include <fstream>
 #include <iomanip>
 #include <cstdlib>
+#include <ctime>
+#include <cctype>
+#include <algorithm>
 #include <boost/algorithm/string/trim.hpp>
 
 //In the constcructor we initialize the menu options and their corresponding functions.
@@ -22,6 +27,8 @@ Menu::Menu() {
         { CMenuOption::EOption::REQ_CLIENT_LIST,   [this]() { showClientList(); }},
         { CMenuOption::EOption::REQ_PUBLIC_KEY,    [this]() { requestPublicKey(); }},
         { CMenuOption::EOption::REQ_PENDING_MSG,   [this]() { showPendingMessages(); }},
+        { CMenuOption::EOption::REQ_HISTORY,       [this]() { showHistory(); }},
+        { CMenuOption::EOption::SEARCH_HISTORY,    [this]() { searchHistory(); }},
         { CMenuOption::EOption::SEND_MSG,          [this]() { sendMessage(); }},
         { CMenuOption::EOption::REQ_SYM_KEY,       [this]() { requestSymmetricKey(); }},
         { CMenuOption::EOption::SEND_SYM_KEY,      [this]() { sendSymmetricKey(); }},
@@ -42,6 +49,42 @@ void Menu::initialize() {
         exit(1);
     }
     isRegistered = logicController.parseClientInfo();
+    // the key pair is generated while the user gets to the registration
+    if (!isRegistered)
+        logicController.prepareRegistration();
+    // users and keys known from the previous session, the client works without them
+    if (isRegistered && !logicController.loadPeerDirectory()) {
+        std::cout << logicController.getCurrentError() << std::endl;
+    }
+}
+
+//this function registers the user names listed in a file, one per line, for provisioning test environments
+bool Menu::bulkRegister(const std::string& usernamesPath, const std::string& folder) {
+    std::ifstream file(usernamesPath);
+    if (!file) {
+        std::cout << "Couldn't open " << usernamesPath << std::endl;
+        return false;
+    }
+    std::vector<std::string> usernames;
+    std::string line;
+    while (std::getline(file, line)) {
+        boost::algorithm::trim(line);
+        if (!line.empty())
+            usernames.push_back(line);
+    }
+
+    std::vector<std::string> errors;
+    const bool registered = logicController.bulkRegister(usernames, folder, errors);
+    for (size_t i = 0; i < errors.size(); ++i) {
+        if (!errors[i].empty())
+            std::cout << usernames[i] << ": " << errors[i] << std::endl;
+    }
+    if (!registered) {
+        std::cout << logicController.getCurrentError() << std::endl;
+        return false;
+    }
+    std::cout << usernames.size() << " users registered into " << folder << std::endl;
+    return true;
 }
 
 //This function displays the client menu with the welcoming message and the menu options
@@ -101,6 +144,33 @@ std::string Menu::readInput(const std::string& description) const {
     return input;
 }
 
+//this function reads a username, a name ending with '*' lists the users starting with it and completes a single match
+std::string Menu::readUsername(const std::string& description) const {
+    std::string username = readInput(description);
+    while (username.back() == '*') {
+        const std::string prefix = username.substr(0, username.size() - 1);
+        size_t total = 0;
+        const std::vector<std::string> matches = logicController.getUsernames(prefix, 0, USERS_PAGE_SIZE, total);
+        if (total == 1) {
+            std::cout << matches.front() << std::endl;
+            return matches.front();
+        }
+        if (total == 0) {
+            std::cout << "No user name starts with '" << prefix << "'." << std::endl;
+        }
+        else {
+            for (const auto& match : matches) {
+                std::cout << match << std::endl;
+            }
+            if (total > matches.size()) {
+                std::cout << "... and " << (total - matches.size()) << " more" << std::endl;
+            }
+        }
+        username = readInput(USERNAME_OPENING + " (all the matches start with '" + logicController.completeUsername(prefix) + "')");
+    }
+    return username;
+}
+
 
 
 
@@ -158,14 +228,47 @@ void Menu::registerUser() {
 //this function shows the client list
 void Menu::showClientList() {
     if (logicController.requestClientsList()) {
-        std::vector<std::string> usernames = logicController.getUsernames();
-        if (usernames.empty()) {
+        // one page at a time, in name order
+        std::string prefix;
+        size_t offset = 0;
+        size_t total = 0;
+        std::vector<std::string> usernames = logicController.getUsernames(prefix, offset, USERS_PAGE_SIZE, total);
+        if (total == 0) {
             std::cout << "No useres in the server" << std::endl;
             return;
         }
         std::cout << "Registered users:" << std::endl;
-        for (const auto& username : usernames) {
-            std::cout << username << std::endl;
+        while (true) {
+            for (const auto& username : usernames) {
+                std::cout << username << std::endl;
+            }
+            offset += usernames.size();
+            if (offset >= total) {
+                break;
+            }
+            const std::string answer = readInput(std::to_string(total - offset) +
+                " more. Type n for the next page, a prefix followed by * to filter, anything else to stop");
+            if (answer.back() == '*') {
+                prefix = answer.substr(0, answer.size() - 1);
+                offset = 0;
+            }
+            else if (answer != "n") {
+                break;
+            }
+            usernames = logicController.getUsernames(prefix, offset, USERS_PAGE_SIZE, total);
+            if (total == 0) {
+                std::cout << "No user name starts with '" << prefix << "'." << std::endl;
+                break;
+            }
+        }
+
+        // only what changed since the previous refresh
+        const auto& changes = logicController.getRosterChanges();
+        if (!changes.initial) {
+            for (const auto& added : changes.added)
+                std::cout << "+ " << added.username << " joined" << std::endl;
+            for (const auto& removed : changes.removed)
+                std::cout << "- " << removed.username << " left" << std::endl;
         }
     }
     else {
@@ -175,7 +278,7 @@ void Menu::showClientList() {
 
 //this function requests the public key
 void Menu::requestPublicKey() {
-    const std::string username = readInput(USERNAME_OPENING);
+    const std::string username = readUsername(USERNAME_OPENING);
     if (logicController.requestClientPublicKey(username)) {
         std::cout << "Public key has been returned from the server successfully." << std::endl;
     }
@@ -193,7 +296,7 @@ void Menu::showPendingMessages() {
         for (const auto& msg : messages) {
             std::cout << "From: " << msg.username << std::endl;
             std::cout << "Content:" << std::endl;
-            std::cout << msg.content << std::endl;
+            std::cout << msg.text() << std::endl;
             std::cout << std::endl;
         }
         const std::string lastErr = logicController.getCurrentError();
@@ -207,9 +310,82 @@ void Menu::showPendingMessages() {
 }
 
 
+//This function shows the last messages received from a user, or from all users, as kept by the local history
+void Menu::showHistory() {
+    std::string username = readUsername(USERNAME_OPENING + " to show the history with, or all..");
+    if (username == "all")
+        username.clear();
+
+    std::vector<LoggedMessage> messages;
+    if (!logicController.getHistory(username, HISTORY_PAGE_SIZE, messages)) {
+        std::cout << logicController.getCurrentError() << std::endl;
+        return;
+    }
+    if (messages.empty()) {
+        std::cout << "No messages in the history." << std::endl;
+        return;
+    }
+    printHistory(messages);
+}
+
+
+//This function shows the last messages holding all the words typed
+void Menu::searchHistory() {
+    const std::string text = readInput("Enter words to search for: ");
+    std::vector<LoggedMessage> messages;
+    if (!logicController.searchHistory(text, HISTORY_PAGE_SIZE, messages)) {
+        std::cout << logicController.getCurrentError() << std::endl;
+        return;
+    }
+    if (messages.empty()) {
+        std::cout << "No messages found." << std::endl;
+        return;
+    }
+    printHistory(messages);
+}
+
+
+void Menu::printHistory(const std::vector<LoggedMessage>& messages) const {
+    std::cout << std::endl;
+    for (const auto& msg : messages) {
+        const std::time_t seconds = static_cast<std::time_t>(msg.timestamp / 1000);
+        std::tm local{};
+#ifdef _WIN32
+        localtime_s(&local, &seconds);
+#else
+        localtime_r(&seconds, &local);
+#endif
+        std::cout << "From: " << msg.username << std::endl;
+        std::cout << "Time: " << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << std::endl;
+        std::cout << "Content:" << std::endl;
+        std::cout << msg.content << std::endl;
+        std::cout << std::endl;
+    }
+    const uint64_t dropped = logicController.getDroppedHistory();
+    if (dropped > 0) {
+        std::cout << dropped << " older messages were deleted, the history is limited to "
+            << logicController.getHistoryLimit() / HISTORY_LIMIT_UNIT << " MB." << std::endl;
+    }
+}
+
+
+//this function limits the history to megabytes, the oldest messages are deleted once it grows past that
+bool Menu::setHistoryLimit(const std::string& megabytes) {
+    if (megabytes.empty() || megabytes.size() > 9 || !std::all_of(megabytes.begin(), megabytes.end(), ::isdigit)
+        || std::stoul(megabytes) == 0) {
+        std::cout << "--history-limit needs a size in MB, the history keeps every message." << std::endl;
+        return false;
+    }
+    const uint64_t bytes = std::stoull(megabytes) * HISTORY_LIMIT_UNIT;
+    logicController.setHistoryLimit(bytes);
+    std::cout << "The history is limited to " << megabytes << " MB, older messages will be deleted." << std::endl;
+    return true;
+}
+
+
 //this function handles with sending a message to other user
 void Menu::sendMessage() {
-    const std::string username = readInput(USERNAME_OPENING + " to send message to..");
+    const std::string username = readUsername(USERNAME_OPENING + " to send message to..");
     const std::string message = readInput("Enter message: ");
     if (logicController.sendMessage(username, MSG_SEND_TEXT, message)) {
         std::cout << "message has been sent to the server sucssefully" << std::endl;
@@ -221,7 +397,7 @@ void Menu::sendMessage() {
 
 //this function handles request for a symmetric key
 void Menu::requestSymmetricKey() {
-    const std::string username = readInput(USERNAME_OPENING + " to request symmetric key from..");
+    const std::string username = readUsername(USERNAME_OPENING + " to request symmetric key from..");
     if (logicController.sendMessage(username, MSG_SYMMETRIC_KEY_REQUEST)) {
         std::cout << "A request for a Symmetric key been sent sucssefully to the server" << std::endl;
     }
@@ -232,7 +408,7 @@ void Menu::requestSymmetricKey() {
 
 //this function handles with seding a symmetric key
 void Menu::sendSymmetricKey() {
-    const std::string username = readInput(USERNAME_OPENING + " to send symmetric key to..");
+    const std::string username = readUsername(USERNAME_OPENING + " to send symmetric key to..");
     if (logicController.sendMessage(username, MSG_SYMMETRIC_KEY_SEND)) {
         std::cout << "a request for sending your private Symmetric key to the server passed sucssefully" << std::endl;
     }
@@ -243,7 +419,7 @@ void Menu::sendSymmetricKey() {
 
 //this fucntio nhandles with sending a file
 void Menu::sendFile() {
-    const std::string username = readInput(USERNAME_OPENING + " to send file to..");
+    const std::string username = readUsername(USERNAME_OPENING + " to send file to..");
     const std::string message = readInput("Enter file name with extention (e.g. : file.txt): ");
     if (logicController.sendMessage(username, MSG_SEND_FILE, message)) {
         std::cout << "a request for sending file sucssefully issued" << std::endl;
@@ -265,6 +441,23 @@ void Menu::exitMessageU() {
 int main(int argc, char* argv[])
 {
     Menu menu;
+    // --cache-users-list: ask the server for the users list only if it changed since the last request
+    // --padded-framing: fill every request up to PACKET_SIZE, for servers that read whole packets
+    // --keep-alive: reuse a connection for the next request, for servers that keep it open after a response
+    // --history-limit <MB>: delete the oldest messages of the history once it is bigger, by default nothing is deleted
+    // --bulk-register <file> <folder>: registers the user names in file, each identity goes to folder/<name>/me.info
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--cache-users-list")
+            menu.setConditionalUsersList(true);
+        else if (std::string(argv[i]) == "--padded-framing")
+            menu.setPaddedFraming(true);
+        else if (std::string(argv[i]) == "--keep-alive")
+            menu.setKeepAlive(true);
+        else if (std::string(argv[i]) == "--history-limit" && i + 1 < argc)
+            menu.setHistoryLimit(argv[++i]);
+        else if (std::string(argv[i]) == "--bulk-register" && i + 2 < argc)
+            return menu.bulkRegister(argv[i + 1], argv[i + 2]) ? 0 : 1;
+    }
     menu.initialize();
 
     while (true)
@@ -13,11 +13,19 @@ class Menu
 {
 public:
     const std::string USERNAME_OPENING = "Please type a username";
+    static const size_t USERS_PAGE_SIZE = 20;   // user names shown at a time
+    static const size_t HISTORY_PAGE_SIZE = 20; // newest messages shown from the history
+    static const uint64_t HISTORY_LIMIT_UNIT = 1024 * 1024;    // --history-limit is in MB
     Menu();
 
     void initialize();
     void display() const;
     void handleClientChoice();
+    void setConditionalUsersList(const bool enabled) { logicController.setConditionalUsersList(enabled); }
+    void setPaddedFraming(const bool enabled) { logicController.setPaddedFraming(enabled); }
+    void setKeepAlive(const bool enabled) { logicController.setKeepAlive(enabled); }
+    bool setHistoryLimit(const std::string& megabytes);
+    bool bulkRegister(const std::string& usernamesPath, const std::string& folder);
 
 
     friend std::ostream& operator<<(std::ostream& os, const Menu* menu) {
@@ -45,6 +53,8 @@ private:
             REQ_CLIENT_LIST = 120,
             REQ_PUBLIC_KEY = 130,
             REQ_PENDING_MSG = 140,
+            REQ_HISTORY = 141,
+            SEARCH_HISTORY = 142,
             SEND_MSG = 150,
             REQ_SYM_KEY = 151,
             SEND_SYM_KEY = 152,
@@ -78,17 +88,21 @@ private:
     };
 
     std::string readInput(const std::string& description = "") const;
+    std::string readUsername(const std::string& description) const;
     bool getMenuOption(CMenuOption& menuOption) const;
 
     void registerUser();
     void showClientList();
     void requestPublicKey();
     void showPendingMessages();
+    void showHistory();
+    void searchHistory();
     void sendMessage();
     void requestSymmetricKey();
     void sendSymmetricKey();
     void sendFile();
     void exitMessageU();
+    void printHistory(const std::vector<LoggedMessage>& messages) const;
 
     MainLogic logicController;
     bool isRegistered = false;
@@ -98,6 +112,8 @@ private:
         { CMenuOption::EOption::REQ_CLIENT_LIST,   true,  "Request client list",              "" },
         { CMenuOption::EOption::REQ_PUBLIC_KEY,    true,  "Request public key",               "Public key retrieved." },
         { CMenuOption::EOption::REQ_PENDING_MSG,   true,  "Request pending messages",         "" },
+        { CMenuOption::EOption::REQ_HISTORY,       true,  "Show message history",             "" },
+        { CMenuOption::EOption::SEARCH_HISTORY,    true,  "Search message history",           "" },
         { CMenuOption::EOption::SEND_MSG,          true,  "Send text message",                "Message sent." },
         { CMenuOption::EOption::REQ_SYM_KEY,       true,  "Request symmetric key",            "Symmetric key requested." },
         { CMenuOption::EOption::SEND_SYM_KEY,      true,  "Send symmetric key",               "Symmetric key sent." },
@@ -0,0 +1,719 @@
+#include "MessageLog.h"
+#include "AESWrapper.h"
+#include "FileSource.h"
+#include "LocalStorage.h"
+#include "WireCodec.h"
+#include <chrono>
+#include <cctype>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+
+namespace
+{
+    const size_t RECORD_HEADER_SIZE = 8;    // size of the sealed record, CRC of the sealed record
+
+    uint64_t nowMilliseconds()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+}
+
+// Constructor
+MessageLog::MessageLog(const std::string& folder)
+    : _folder(folder)
+    , _writing(false)
+    , _stop(false)
+    , _lastTimestamp(0)
+    , _active(nullptr)
+    , _firstSequence(0)
+    , _searchCovered(0)
+    , _searchChanged(false)
+    , _maxSize(MESSAGE_LOG_UNLIMITED)
+    , _dropped(0)
+{
+}
+
+// Destructor
+MessageLog::~MessageLog()
+{
+    close();
+}
+
+std::string MessageLog::segmentPath(const uint32_t number, const char* extension) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%08u%s", number, extension);
+    return (boost::filesystem::path(_folder) / name).string();
+}
+
+std::string MessageLog::searchPath() const
+{
+    return (boost::filesystem::path(_folder) / MESSAGE_SEARCH_INDEX).string();
+}
+
+//This function reads what the log holds and starts the writer, messages go to the last segment if it has room
+bool MessageLog::open(const ClientID& self, const std::string& privateKey, std::string& error)
+{
+    close();
+    _aes.reset(new AESWrapper(LocalStorage::deriveKey(self, privateKey, "MessageU message history")));
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(_folder, ec);
+    if (ec)
+    {
+        error = "Couldn't create " + _folder + ": " + ec.message();
+        return false;
+    }
+
+    std::vector<uint32_t> numbers;
+    for (boost::filesystem::directory_iterator it(_folder, ec), end; !ec && it != end; it.increment(ec))
+    {
+        const boost::filesystem::path& path = it->path();
+        const std::string stem = path.stem().string();
+        if (path.extension() == ".seg" && !stem.empty() && std::all_of(stem.begin(), stem.end(), ::isdigit))
+            numbers.push_back(static_cast<uint32_t>(std::stoul(stem)));
+    }
+    std::sort(numbers.begin(), numbers.end());
+
+    for (const uint32_t number : numbers)
+    {
+        Segment segment;
+        segment.number = number;
+        segment.size = boost::filesystem::file_size(segmentPath(number, ".seg"), ec);
+        segment.firstEntry = _firstSequence + _entries.size();
+        segment.indexed = false;
+        segment.foreign = false;
+        if (ec || !loadSegment(segment))
+        {
+            error = "Couldn't read " + segmentPath(number, ".seg");
+            close();
+            return false;
+        }
+        _segments.push_back(segment);
+    }
+    if (!_entries.empty())
+        _lastTimestamp = _entries.back().timestamp;
+    loadSearchIndex();
+    compact();
+
+    bool started = false;
+    if (!_segments.empty() && _segments.back().size < MESSAGE_SEGMENT_SIZE && !_segments.back().foreign)
+    {
+        _active = LocalStorage::openFile(segmentPath(_segments.back().number, ".seg"), "ab");
+        started = (_active != nullptr);
+    }
+    else
+    {
+        started = startSegment(_segments.empty() ? 0 : _segments.back().number + 1);
+    }
+    if (!started)
+    {
+        error = "Couldn't open the message history in " + _folder;
+        close();
+        return false;
+    }
+
+    _stop = false;
+    _writer = std::thread(&MessageLog::run, this);
+    return true;
+}
+
+//This function stops the writer once the queue is written and forgets the indexes
+void MessageLog::close()
+{
+    if (_writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        _writer.join();
+        if (_searchChanged)
+            storeSearchIndex();
+    }
+    if (_active != nullptr)
+        fclose(_active);
+    _active = nullptr;
+    _mapped.clear();
+    _segments.clear();
+    _entries.clear();
+    _firstSequence = 0;
+    _peers.clear();
+    _peerNumbers.clear();
+    _byPeer.clear();
+    _lastTimestamp = 0;
+    _search.clear();
+    _searchCovered = 0;
+    _searchChanged = false;
+    _dropped = 0;
+}
+
+void MessageLog::append(const ClientID& sender, const std::string& username, const std::string& content)
+{
+    Queued queued;
+    queued.message.content = content;
+    enqueue(sender, username, std::move(queued));
+}
+
+void MessageLog::append(const ClientID& sender, const std::string& username, std::function<std::string()> content)
+{
+    Queued queued;
+    queued.content = std::move(content);
+    enqueue(sender, username, std::move(queued));
+}
+
+//This function queues a message for the writer, nothing is done on disk here
+void MessageLog::enqueue(const ClientID& sender, const std::string& username, Queued queued)
+{
+    if (!isOpen())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        LoggedMessage& message = queued.message;
+        // the clock may step back, the time index relies on the log being in time order
+        message.timestamp = std::max(nowMilliseconds(), _lastTimestamp);
+        message.sender = sender;
+        message.username = username;
+        _lastTimestamp = message.timestamp;
+        _queue.push_back(std::move(queued));
+    }
+    _wake.notify_one();
+}
+
+void MessageLog::flush()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _drained.wait(lock, [this] { return (_queue.empty() && !_writing) || !_writer.joinable(); });
+}
+
+size_t MessageLog::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+void MessageLog::setMaxSize(const uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxSize = bytes;
+}
+
+uint64_t MessageLog::maxSize() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _maxSize;
+}
+
+uint64_t MessageLog::droppedMessages() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _dropped;
+}
+
+//The writer thread: decrypts and encrypts queued messages without the lock, appends them to the log with it, compacts when idle
+void MessageLog::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        const bool woken = _wake.wait_for(lock, std::chrono::seconds(MESSAGE_LOG_COMPACT_SECONDS),
+            [this] { return _stop || !_queue.empty(); });
+        if (!woken)
+        {
+            compact();
+            continue;
+        }
+        if (_queue.empty())
+            break;  // stopped and everything is written
+
+        std::deque<Queued> batch;
+        batch.swap(_queue);
+        _writing = true;
+        lock.unlock();
+
+        std::vector<std::vector<uint8_t>> ciphers;
+        std::vector<std::vector<std::string>> terms(batch.size());
+        ciphers.reserve(batch.size());
+        std::vector<uint8_t> plain;
+        for (Queued& queued : batch)
+        {
+            LoggedMessage& message = queued.message;
+            if (queued.content)
+                message.content = queued.content();
+            plain.clear();
+            WireWriter writer(plain);
+            const size_t nameLength = std::min(message.username.size(), CLIENT_NAME_SIZE - 1);
+            writer.put(message.timestamp);
+            writer.put(message.sender);
+            writer.put(static_cast<uint8_t>(nameLength));
+            writer.bytes(message.username.data(), nameLength);
+            writer.bytes(message.content.data(), message.content.size());
+            ciphers.push_back(LocalStorage::seal(*_aes, plain.data(), plain.size()));
+            SearchIndex::tokenize(message.content, terms[ciphers.size() - 1]);
+        }
+
+        lock.lock();
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (!writeRecord(batch[i].message.timestamp, batch[i].message.sender, ciphers[i]))
+                continue;
+            const uint64_t written = locator(_entries.back().segment, _entries.back().offset);
+            _search.add(written, terms[i]);
+            _searchCovered = written + 1;
+            _searchChanged = true;
+        }
+        if (_active != nullptr)
+            fflush(_active);
+        _writing = false;
+        _drained.notify_all();
+    }
+    _writing = false;
+    _drained.notify_all();
+}
+
+//This function appends one record to the last segment, a full segment gets its index file and the next one is started
+bool MessageLog::writeRecord(const uint64_t timestamp, const ClientID& sender, const std::vector<uint8_t>& cipher)
+{
+    const size_t recordSize = RECORD_HEADER_SIZE + cipher.size();
+    if (_segments.back().size > 0 && _segments.back().size + recordSize > MESSAGE_SEGMENT_SIZE)
+    {
+        if (_active != nullptr)
+            fclose(_active);
+        _active = nullptr;
+        storeSegmentIndex(_segments.back());
+        if (!startSegment(_segments.back().number + 1))
+            return false;
+        compact();
+    }
+    if (_active == nullptr)
+        return false;
+
+    uint8_t header[RECORD_HEADER_SIZE];
+    WireField<uint32_t>::encode(static_cast<uint32_t>(cipher.size()), header);
+    WireField<uint32_t>::encode(LocalStorage::checksum(cipher.data(), cipher.size()), header + 4);
+    Segment& segment = _segments.back();
+    if (fwrite(header, 1, sizeof(header), _active) != sizeof(header) ||
+        fwrite(cipher.data(), 1, cipher.size(), _active) != cipher.size())
+    {
+        // what was written of it is cut off when the segment is scanned next time
+        fclose(_active);
+        _active = nullptr;
+        return false;
+    }
+    addEntry(timestamp, sender, segment.number, static_cast<uint32_t>(segment.size));
+    segment.size += recordSize;
+    return true;
+}
+
+bool MessageLog::startSegment(const uint32_t number)
+{
+    _active = LocalStorage::openFile(segmentPath(number, ".seg"), "ab");
+    if (_active == nullptr)
+        return false;
+    Segment segment;
+    segment.number = number;
+    segment.size = 0;
+    segment.firstEntry = _firstSequence + _entries.size();
+    segment.indexed = false;
+    segment.foreign = false;
+    _segments.push_back(segment);
+    return true;
+}
+
+void MessageLog::addEntry(const uint64_t timestamp, const ClientID& sender, const uint32_t segment, const uint32_t offset)
+{
+    auto it = _peerNumbers.find(sender);
+    if (it == _peerNumbers.end())
+    {
+        it = _peerNumbers.emplace(sender, static_cast<uint32_t>(_peers.size())).first;
+        _peers.push_back(sender);
+        _byPeer.emplace_back();
+    }
+    Entry entry;
+    entry.timestamp = timestamp;
+    entry.segment = segment;
+    entry.offset = offset;
+    entry.peer = it->second;
+    _byPeer[entry.peer].push_back(_firstSequence + _entries.size());
+    _entries.push_back(entry);
+}
+
+//This function indexes a segment from its index file, a segment without a matching one is scanned
+bool MessageLog::loadSegment(Segment& segment)
+{
+    const std::string indexPath = segmentPath(segment.number, ".idx");
+    if (boost::filesystem::exists(indexPath))
+    {
+        FileSource source;
+        std::vector<uint8_t> scratch;
+        std::vector<uint8_t> plain;
+        const uint8_t* file = nullptr;
+        if (source.open(indexPath) && LocalStorage::readWhole(source, scratch, file) &&
+            LocalStorage::unseal(*_aes, file, static_cast<size_t>(source.size()), plain))
+        {
+            WireReader reader(plain.data(), plain.size());
+            uint64_t coveredSize = 0;
+            uint32_t count = 0;
+            if (reader.get(coveredSize) && reader.get(count) && coveredSize == segment.size &&
+                reader.left() == static_cast<size_t>(count) * (4 + 8 + sizeof(ClientID)))
+            {
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    uint32_t offset = 0;
+                    uint64_t timestamp = 0;
+                    ClientID sender;
+                    reader.get(offset);
+                    reader.get(timestamp);
+                    reader.get(sender);
+                    addEntry(timestamp, sender, segment.number, offset);
+                }
+                segment.indexed = true;
+                return true;
+            }
+        }
+    }
+    return scanSegment(segment);
+}
+
+//This function indexes a segment by reading its records, a torn record at the end is cut off
+//(a record is torn if its CRC doesn't match, a record that only doesn't decrypt is kept)
+bool MessageLog::scanSegment(Segment& segment)
+{
+    const std::string path = segmentPath(segment.number, ".seg");
+    uint64_t goodSize = 0;
+    {
+        FileSource source;
+        std::vector<uint8_t> scratch;
+        std::vector<uint8_t> plain;
+        const uint8_t* file = nullptr;
+        if (!source.open(path) || !LocalStorage::readWhole(source, scratch, file))
+            return false;
+
+        WireReader records(file, static_cast<size_t>(source.size()));
+        while (records.left() > 0)
+        {
+            uint32_t size = 0;
+            uint32_t crc = 0;
+            const uint8_t* cipher = nullptr;
+            if (records.get(size) && records.get(crc))
+                cipher = records.bytes(size);
+            if (cipher == nullptr || LocalStorage::checksum(cipher, size) != crc)
+                break;
+            uint64_t timestamp = 0;
+            ClientID sender;
+            WireReader record(plain.data(), 0);
+            if (LocalStorage::unseal(*_aes, cipher, size, plain))
+                record = WireReader(plain.data(), plain.size());
+            if (!record.get(timestamp) || !record.get(sender))
+            {
+                // a whole record this key can't read (written before registering again), left as it is
+                segment.foreign = true;
+                return true;
+            }
+            addEntry(timestamp, sender, segment.number, static_cast<uint32_t>(goodSize));
+            goodSize += RECORD_HEADER_SIZE + size;
+        }
+    }
+
+    if (goodSize != segment.size)
+    {
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(path, goodSize, ec);
+        segment.size = goodSize;
+    }
+    return true;
+}
+
+//This function writes the index of a sealed segment, a temporary file renamed into place
+bool MessageLog::storeSegmentIndex(const Segment& segment)
+{
+    const uint64_t first = std::max(segment.firstEntry, _firstSequence);
+    uint64_t last = _firstSequence + _entries.size();
+    for (const Segment& other : _segments)
+    {
+        if (other.number > segment.number)
+        {
+            last = other.firstEntry;
+            break;
+        }
+    }
+
+    std::vector<uint8_t> plain;
+    WireWriter writer(plain);
+    writer.put(segment.size);
+    writer.put(static_cast<uint32_t>(last - first));
+    for (uint64_t sequence = first; sequence < last; ++sequence)
+    {
+        const Entry& indexed = entry(sequence);
+        writer.put(indexed.offset);
+        writer.put(indexed.timestamp);
+        writer.put(_peers[indexed.peer]);
+    }
+    if (!storeSealed(segmentPath(segment.number, ".idx"), plain))
+        return false;
+    for (Segment& stored : _segments)
+    {
+        if (stored.number == segment.number)
+            stored.indexed = true;
+    }
+    return true;
+}
+
+//This function writes the index files missing for sealed segments (segments that were scanned after a crash),
+//with a size limit set it also drops the oldest segments once the log is over it
+void MessageLog::compact()
+{
+    uint64_t total = 0;
+    for (const Segment& segment : _segments)
+        total += segment.size;
+
+    bool dropped = false;
+    while (_maxSize != MESSAGE_LOG_UNLIMITED && _segments.size() > 1 && total > _maxSize)
+    {
+        const Segment oldest = _segments.front();
+        _segments.pop_front();
+        boost::system::error_code ec;
+        _mapped.erase(oldest.number);
+        boost::filesystem::remove(segmentPath(oldest.number, ".seg"), ec);
+        boost::filesystem::remove(segmentPath(oldest.number, ".idx"), ec);
+        const uint64_t next = _segments.front().firstEntry;
+        while (_firstSequence < next && !_entries.empty())
+        {
+            _entries.pop_front();
+            ++_firstSequence;
+            ++_dropped;
+        }
+        total -= oldest.size;
+        dropped = true;
+    }
+    if (dropped)
+    {
+        for (auto& sequences : _byPeer)
+            sequences.erase(sequences.begin(), std::lower_bound(sequences.begin(), sequences.end(), _firstSequence));
+        _search.dropBefore(locator(_segments.front().number, 0));
+        _searchChanged = true;
+    }
+
+    for (size_t i = 0; i + 1 < _segments.size(); ++i)
+    {
+        if (!_segments[i].indexed)
+            storeSegmentIndex(_segments[i]);
+    }
+    if (_searchChanged)
+        storeSearchIndex();
+}
+
+
+//This function loads the saved search index and adds the messages written after it was saved,
+//an index that claims more than the log holds (the tail was cut off) is built again
+void MessageLog::loadSearchIndex()
+{
+    const uint64_t end = _segments.empty() ? 0 : locator(_segments.back().number, _segments.back().size);
+    const std::string path = searchPath();
+    FileSource source;
+    std::vector<uint8_t> scratch;
+    std::vector<uint8_t> plain;
+    const uint8_t* file = nullptr;
+    bool loaded = false;
+    if (boost::filesystem::exists(path) && source.open(path) && LocalStorage::readWhole(source, scratch, file) &&
+        LocalStorage::unseal(*_aes, file, static_cast<size_t>(source.size()), plain))
+    {
+        WireReader reader(plain.data(), plain.size());
+        loaded = reader.get(_searchCovered) && _searchCovered <= end && _search.load(reader);
+    }
+    if (!loaded)
+    {
+        _search.clear();
+        _searchCovered = 0;
+    }
+
+    std::vector<std::string> terms;
+    for (const Entry& indexed : _entries)
+    {
+        const uint64_t location = locator(indexed.segment, indexed.offset);
+        LoggedMessage message;
+        if (location < _searchCovered || !readEntry(indexed, message))
+            continue;
+        SearchIndex::tokenize(message.content, terms);
+        _search.add(location, terms);
+        _searchCovered = location + 1;
+        _searchChanged = true;
+    }
+}
+
+//This function saves the search index, a temporary file renamed into place
+bool MessageLog::storeSearchIndex()
+{
+    std::vector<uint8_t> plain;
+    WireWriter writer(plain);
+    writer.put(_searchCovered);
+    _search.save(writer);
+    if (!storeSealed(searchPath(), plain))
+        return false;
+    _searchChanged = false;
+    return true;
+}
+
+//This function writes plain encrypted to a temporary file and renames it over path
+bool MessageLog::storeSealed(const std::string& path, const std::vector<uint8_t>& plain) const
+{
+    const std::vector<uint8_t> cipher = LocalStorage::seal(*_aes, plain.data(), plain.size());
+    const std::string temporary = path + ".tmp";
+    FILE* file = LocalStorage::openFile(temporary, "wb");
+    if (file == nullptr)
+        return false;
+    const bool written = fwrite(cipher.data(), 1, cipher.size(), file) == cipher.size() && LocalStorage::syncToDisk(file);
+    fclose(file);
+    boost::system::error_code ec;
+    if (written)
+        boost::filesystem::rename(temporary, path, ec);
+    if (!written || ec)
+    {
+        boost::filesystem::remove(temporary, ec);
+        return false;
+    }
+    return true;
+}
+
+const MessageLog::Entry* MessageLog::findEntry(const uint64_t location) const
+{
+    const auto it = std::lower_bound(_entries.begin(), _entries.end(), location,
+        [](const Entry& indexed, uint64_t value) { return locator(indexed.segment, indexed.offset) < value; });
+    if (it == _entries.end() || locator(it->segment, it->offset) != location)
+        return nullptr;
+    return &*it;
+}
+
+//This function reads one message from its segment through the mapping
+bool MessageLog::readEntry(const Entry& indexed, LoggedMessage& message)
+{
+    std::unique_ptr<FileSource>& source = _mapped[indexed.segment];
+    if (source == nullptr || source->size() < indexed.offset + RECORD_HEADER_SIZE)
+    {
+        // the segment that is written to grows, it is mapped again to see the new records
+        source.reset(new FileSource());
+        if (!source->open(segmentPath(indexed.segment, ".seg")))
+            return false;
+    }
+
+    std::vector<uint8_t> scratch(RECORD_HEADER_SIZE);
+    const uint8_t* header = source->read(indexed.offset, RECORD_HEADER_SIZE, scratch.data());
+    if (header == nullptr)
+        return false;
+    uint32_t size = 0;
+    WireField<uint32_t>::decode(header, size);
+    scratch.resize(size);
+    const uint8_t* cipher = source->read(indexed.offset + RECORD_HEADER_SIZE, size, scratch.data());
+    std::vector<uint8_t> plain;
+    if (cipher == nullptr || !LocalStorage::unseal(*_aes, cipher, size, plain))
+        return false;
+
+    WireReader reader(plain.data(), plain.size());
+    uint8_t nameLength = 0;
+    const uint8_t* name = nullptr;
+    if (!reader.get(message.timestamp) || !reader.get(message.sender) || !reader.get(nameLength) ||
+        (name = reader.bytes(nameLength)) == nullptr)
+        return false;
+    message.username.assign(reinterpret_cast<const char*>(name), nameLength);
+    const size_t contentLength = reader.left();
+    message.content.assign(reinterpret_cast<const char*>(reader.bytes(contentLength)), contentLength);
+    return true;
+}
+
+//This function finds the messages with the time and peer indexes and reads only those
+bool MessageLog::query(const ClientID* peer, const uint64_t from, const uint64_t to, const size_t limit,
+    std::vector<LoggedMessage>& messages, std::string& error)
+{
+    messages.clear();
+    if (!isOpen())
+    {
+        error = "Message history is not open.";
+        return false;
+    }
+    flush();
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // newest first, then turned around
+    std::vector<uint64_t> found;
+    if (peer != nullptr)
+    {
+        const auto it = _peerNumbers.find(*peer);
+        if (it != _peerNumbers.end())
+        {
+            const std::vector<uint64_t>& sequences = _byPeer[it->second];
+            auto end = std::upper_bound(sequences.begin(), sequences.end(), to,
+                [this](uint64_t time, uint64_t sequence) { return time < entry(sequence).timestamp; });
+            while (end != sequences.begin() && found.size() < limit)
+            {
+                --end;
+                if (entry(*end).timestamp < from)
+                    break;
+                found.push_back(*end);
+            }
+        }
+    }
+    else
+    {
+        auto end = std::upper_bound(_entries.begin(), _entries.end(), to,
+            [](uint64_t time, const Entry& indexed) { return time < indexed.timestamp; });
+        while (end != _entries.begin() && found.size() < limit)
+        {
+            --end;
+            if (end->timestamp < from)
+                break;
+            found.push_back(_firstSequence + static_cast<uint64_t>(end - _entries.begin()));
+        }
+    }
+
+    messages.reserve(found.size());
+    for (auto it = found.rbegin(); it != found.rend(); ++it)
+    {
+        LoggedMessage message;
+        if (!readEntry(entry(*it), message))
+        {
+            error = "Couldn't read a message from the history.";
+            return false;
+        }
+        messages.push_back(std::move(message));
+    }
+    return true;
+}
+
+//This function looks the words up in the search index and reads only the newest limit messages found
+bool MessageLog::search(const std::string& text, const size_t limit, std::vector<LoggedMessage>& messages, std::string& error)
+{
+    messages.clear();
+    if (!isOpen())
+    {
+        error = "Message history is not open.";
+        return false;
+    }
+    flush();
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<uint64_t> documents;
+    _search.find(text, documents);
+    // newest first, then turned around
+    std::vector<const Entry*> found;
+    for (auto it = documents.rbegin(); it != documents.rend() && found.size() < limit; ++it)
+    {
+        const Entry* indexed = findEntry(*it);
+        if (indexed != nullptr)     // not dropped since the index was saved
+            found.push_back(indexed);
+    }
+
+    messages.reserve(found.size());
+    for (auto it = found.rbegin(); it != found.rend(); ++it)
+    {
+        LoggedMessage message;
+        if (!readEntry(**it, message))
+        {
+            error = "Couldn't read a message from the history.";
+            return false;
+        }
+        messages.push_back(std::move(message));
+    }
+    return true;
+}
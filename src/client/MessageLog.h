@@ -0,0 +1,142 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <unordered_map>
+#include <functional>
+#include <condition_variable>
+#include "protocol.h"
+#include "SearchIndex.h"
+
+class AESWrapper;
+class FileSource;
+
+const size_t   MESSAGE_SEGMENT_SIZE = 16 * 1024 * 1024;         // a segment is sealed and the next one started past this size
+const unsigned MESSAGE_LOG_COMPACT_SECONDS = 300;               // how often an idle writer compacts the log
+const uint64_t MESSAGE_LOG_UNLIMITED = 0;                       // setMaxSize() value that keeps every message
+const char* const MESSAGE_SEARCH_INDEX = "search.idx";         // the saved search index, in the log folder
+
+// A message as it was received, timestamp is milliseconds since the epoch
+struct LoggedMessage
+{
+    uint64_t    timestamp = 0;
+    ClientID    sender;
+    std::string username;
+    std::string content;
+};
+
+//This class keeps the received messages in an append-only log of encrypted segment files.
+//append() only queues the message, a background thread writes it and indexes it by peer and by time.
+//A sealed segment gets an index file next to it so opening the log does not read the messages,
+//queries read the segments through a memory mapping. The words of the messages are kept in a search index
+//that is saved with the log, opening it only indexes the messages written after it was saved.
+//The log keeps every message unless a size limit is set, then the oldest segments are deleted past it.
+class MessageLog
+{
+public:
+    MessageLog(const std::string& folder = MESSAGE_LOG_FOLDER);
+    virtual ~MessageLog();
+    MessageLog(const MessageLog& other) = delete;
+    MessageLog(MessageLog&& other) noexcept = delete;
+    MessageLog& operator=(const MessageLog& other) = delete;
+    MessageLog& operator=(MessageLog&& other) noexcept = delete;
+
+    // reads the indexes of the log of this client and starts the writer
+    bool open(const ClientID& self, const std::string& privateKey, std::string& error);
+    void close();
+    bool isOpen() const { return _writer.joinable(); }
+
+    void append(const ClientID& sender, const std::string& username, const std::string& content);
+    // content is called on the writer thread, for a message that is still to be decrypted
+    void append(const ClientID& sender, const std::string& username, std::function<std::string()> content);
+    // waits until everything appended so far is written
+    void flush();
+
+    // the newest limit messages received in [from, to], from one peer or from everyone (peer nullptr), oldest first
+    bool query(const ClientID* peer, const uint64_t from, const uint64_t to, const size_t limit,
+        std::vector<LoggedMessage>& messages, std::string& error);
+    // the newest limit messages holding every word of text, oldest first
+    bool search(const std::string& text, const size_t limit, std::vector<LoggedMessage>& messages, std::string& error);
+    size_t size() const;
+    // bytes the segments may take before the oldest are deleted, takes effect at the next compaction
+    void setMaxSize(const uint64_t bytes);
+    uint64_t maxSize() const;
+    // messages deleted by the size limit since open()
+    uint64_t droppedMessages() const;
+
+private:
+    struct Entry
+    {
+        uint64_t timestamp;
+        uint32_t segment;
+        uint32_t offset;
+        uint32_t peer;      // index into _peers
+    };
+
+    struct Segment
+    {
+        uint32_t number;
+        uint64_t size;
+        uint64_t firstEntry;    // sequence number of its first message
+        bool     indexed;       // has an index file
+        bool     foreign;       // holds records written under another key, nothing is appended to it
+    };
+
+    struct Queued
+    {
+        LoggedMessage message;
+        std::function<std::string()> content;   // fills message.content, if set
+    };
+
+    void enqueue(const ClientID& sender, const std::string& username, Queued queued);
+    void run();
+    bool writeRecord(const uint64_t timestamp, const ClientID& sender, const std::vector<uint8_t>& cipher);
+    bool startSegment(const uint32_t number);
+    bool loadSegment(Segment& segment);
+    bool scanSegment(Segment& segment);
+    bool storeSegmentIndex(const Segment& segment);
+    void compact();
+    void addEntry(const uint64_t timestamp, const ClientID& sender, const uint32_t segment, const uint32_t offset);
+    const Entry& entry(const uint64_t sequence) const { return _entries[static_cast<size_t>(sequence - _firstSequence)]; }
+    bool readEntry(const Entry& entry, LoggedMessage& message);
+    std::string segmentPath(const uint32_t number, const char* extension) const;
+    std::string searchPath() const;
+    bool storeSealed(const std::string& path, const std::vector<uint8_t>& plain) const;
+    // where a record is, grows with every record written, used as its document number in the search index
+    static uint64_t locator(const uint32_t segment, const uint64_t offset) { return (static_cast<uint64_t>(segment) << 32) + offset; }
+    const Entry* findEntry(const uint64_t location) const;
+    void loadSearchIndex();
+    bool storeSearchIndex();
+
+private:
+    std::string _folder;
+    std::unique_ptr<AESWrapper> _aes;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _drained;
+    std::deque<Queued> _queue;
+    bool _writing;
+    bool _stop;
+    uint64_t _lastTimestamp;
+    std::thread _writer;
+
+    std::deque<Segment> _segments;          // oldest first, the last one is written to
+    FILE* _active;
+    std::deque<Entry> _entries;             // every message in the log in the order received, which is time order
+    uint64_t _firstSequence;                // sequence number of _entries.front()
+    std::vector<ClientID> _peers;
+    std::unordered_map<ClientID, uint32_t, ClientIDHash> _peerNumbers;
+    std::vector<std::vector<uint64_t>> _byPeer;     // sequence numbers of each peer's messages
+    std::unordered_map<uint32_t, std::unique_ptr<FileSource>> _mapped;   // segments opened by queries
+    SearchIndex _search;
+    uint64_t _searchCovered;                // locator past the last message in _search
+    bool _searchChanged;                    // _search has messages its file doesn't
+    uint64_t _maxSize;                      // MESSAGE_LOG_UNLIMITED or the size the oldest segments are dropped beyond
+    uint64_t _dropped;                      // messages deleted by _maxSize since open()
+};
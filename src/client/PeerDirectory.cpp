@@ -0,0 +1,496 @@
+#include "PeerDirectory.h"
+#include "AESWrapper.h"
+#include "FileSource.h"
+#include "LocalStorage.h"
+#include "WireCodec.h"
+#include <cstring>
+#include <unordered_set>
+#include <sha.h>
+#include <boost/filesystem.hpp>
+
+namespace
+{
+    const uint8_t  SNAPSHOT_MAGIC[4] = { 'M', 'U', 'P', 'D' };
+    const uint32_t SNAPSHOT_VERSION = 1;
+    const size_t   SNAPSHOT_HEADER_SIZE = 16;   // magic, version, size of the encrypted body
+    const size_t   DIGEST_SIZE = CryptoPP::SHA256::DIGESTSIZE;
+
+    //This function renames path to the first free <path>.damaged[.n], returns the new name or "" if it couldn't
+    std::string moveAside(const std::string& path)
+    {
+        std::string aside = path + ".damaged";
+        for (int n = 1; boost::filesystem::exists(aside); ++n)
+            aside = path + ".damaged." + std::to_string(n);
+        boost::system::error_code ec;
+        boost::filesystem::rename(path, aside, ec);
+        return ec ? std::string() : aside;
+    }
+}
+
+// Constructor
+PeerDirectory::PeerDirectory(const std::string& path)
+    : _path(path)
+    , _journalPath(path + ".log")
+    , _generation(0)
+    , _journalSize(0)
+    , _compact(false)
+    , _journal(nullptr)
+{
+}
+
+// Destructor
+PeerDirectory::~PeerDirectory()
+{
+    closeJournal();
+}
+
+//This function derives the storage key from the private key, another key pair can't read the directory
+void PeerDirectory::open(const ClientID& self, const std::string& privateKey)
+{
+    closeJournal();
+    _self = self;
+    _generation = 0;
+    _journalSize = 0;
+    _compact = false;
+
+    _aes.reset(new AESWrapper(LocalStorage::deriveKey(self, privateKey, "MessageU peer directory")));
+}
+
+//This function reads the snapshot and then the journal, a missing or foreign directory leaves the roster empty
+bool PeerDirectory::load(ClientRoster& roster, RosterETag& etag, bool& etagSet, std::string& error)
+{
+    roster.clear();
+    etagSet = false;
+    if (!isOpen())
+    {
+        error = "Peer directory is not open.";
+        return false;
+    }
+    closeJournal();
+    _generation = 0;
+    _journalSize = 0;
+    _compact = false;
+
+    if (!loadSnapshot(roster, etag, etagSet, error))
+    {
+        // nothing usable, the file is kept aside for whoever can read it and the next store starts over
+        roster.clear();
+        etagSet = false;
+        _generation = 0;
+        const std::string aside = moveAside(_path);
+        if (aside.empty())
+        {
+            // the next store would overwrite it, the directory stays closed for this session instead
+            error += " It was left in place and the users list won't be saved.";
+            _aes.reset();
+            return false;
+        }
+        error += " It was moved to " + aside + ".";
+        if (boost::filesystem::exists(_journalPath))
+            moveAside(_journalPath);
+        _compact = true;
+        return false;
+    }
+    replayJournal(roster, etag, etagSet);
+    return true;
+}
+
+bool PeerDirectory::loadSnapshot(ClientRoster& roster, RosterETag& etag, bool& etagSet, std::string& error)
+{
+    if (!boost::filesystem::exists(_path))
+        return true;
+
+    FileSource source;
+    std::vector<uint8_t> scratch;
+    const uint8_t* file = nullptr;
+    if (!source.open(_path) || !LocalStorage::readWhole(source, scratch, file))
+    {
+        error = "Couldn't read " + _path + ".";
+        return false;
+    }
+
+    WireReader header(file, static_cast<size_t>(source.size()));
+    const uint8_t* magic = header.bytes(sizeof(SNAPSHOT_MAGIC));
+    uint32_t version = 0;
+    uint64_t cipherSize = 0;
+    if (magic == nullptr || memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        !header.get(version) || version != SNAPSHOT_VERSION || !header.get(cipherSize) ||
+        cipherSize != header.left())
+    {
+        error = _path + " is not a peer directory.";
+        return false;
+    }
+
+    std::vector<uint8_t> body;
+    if (!LocalStorage::unseal(*_aes, file + SNAPSHOT_HEADER_SIZE, static_cast<size_t>(cipherSize), body) || body.size() < DIGEST_SIZE)
+    {
+        error = _path + " was written with another key or is damaged.";
+        return false;
+    }
+    uint8_t digest[DIGEST_SIZE];
+    CryptoPP::SHA256().CalculateDigest(digest, body.data() + DIGEST_SIZE, body.size() - DIGEST_SIZE);
+    if (memcmp(digest, body.data(), DIGEST_SIZE) != 0)
+    {
+        error = _path + " is damaged.";
+        return false;
+    }
+
+    WireReader reader(body.data() + DIGEST_SIZE, body.size() - DIGEST_SIZE);
+    ClientID owner;
+    uint64_t generation = 0;
+    uint32_t count = 0, nameBytes = 0, keyCount = 0;
+    uint8_t hasETag = 0;
+    if (!reader.get(owner) || !reader.get(generation) || !reader.get(count) || !reader.get(nameBytes) ||
+        !reader.get(keyCount) || !reader.get(hasETag) || !reader.get(etag))
+    {
+        error = _path + " is damaged.";
+        return false;
+    }
+    if (!(owner == _self))
+        return true;  // belongs to an earlier registration, starts over
+
+    const uint8_t* ids = reader.bytes(static_cast<size_t>(count) * sizeof(ClientID));
+    const uint8_t* lengths = reader.bytes(count);
+    const uint8_t* names = reader.bytes(nameBytes);
+    if (ids == nullptr || lengths == nullptr || names == nullptr)
+    {
+        error = _path + " is damaged.";
+        return false;
+    }
+
+    roster.reserve(count, nameBytes);
+    size_t nameOffset = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        ClientID id;
+        WireCodec::decode(ids + static_cast<size_t>(i) * sizeof(ClientID), id);
+        if (nameOffset + lengths[i] > nameBytes)
+        {
+            error = _path + " is damaged.";
+            return false;
+        }
+        roster.add(id, std::string_view(reinterpret_cast<const char*>(names + nameOffset), lengths[i]));
+        nameOffset += lengths[i];
+    }
+
+    for (uint32_t i = 0; i < keyCount; ++i)
+    {
+        uint32_t handle = 0;
+        uint8_t flags = 0;
+        PublicKey publicKey;
+        SymmetricKey symmetricKey;
+        if (!reader.get(handle) || !reader.get(flags) || !reader.get(publicKey) || !reader.get(symmetricKey) ||
+            handle >= roster.size())
+        {
+            error = _path + " is damaged.";
+            return false;
+        }
+        if (flags & 1)
+            roster.setPublicKey(handle, publicKey);
+        if (flags & 2)
+            roster.setSymmetricKey(handle, symmetricKey);
+        if (flags & 4)
+            roster.setMessageVersion(handle, MESSAGE_VERSION_AEAD);
+    }
+
+    etagSet = (hasETag != 0);
+    _generation = generation;
+    return true;
+}
+
+//This function applies the journal records of the current snapshot, a torn record at the end stops the replay
+void PeerDirectory::replayJournal(ClientRoster& roster, RosterETag& etag, bool& etagSet)
+{
+    if (!boost::filesystem::exists(_journalPath))
+        return;
+
+    FileSource source;
+    std::vector<uint8_t> scratch;
+    const uint8_t* file = nullptr;
+    if (!source.open(_journalPath) || !LocalStorage::readWhole(source, scratch, file))
+    {
+        _compact = true;
+        return;
+    }
+    _journalSize = source.size();
+
+    std::unordered_set<ClientID, ClientIDHash> removed;
+    WireReader records(file, static_cast<size_t>(source.size()));
+    std::vector<uint8_t> plain;
+    while (records.left() > 0)
+    {
+        uint32_t size = 0;
+        bool intact = records.get(size) && size <= records.left();
+        const uint8_t* cipher = intact ? records.bytes(size) : nullptr;
+        intact = cipher != nullptr && LocalStorage::unseal(*_aes, cipher, size, plain) && plain.size() >= sizeof(uint32_t);
+        if (intact)
+        {
+            uint32_t stored = 0;
+            WireField<uint32_t>::decode(plain.data(), stored);
+            intact = (stored == LocalStorage::checksum(plain.data() + sizeof(uint32_t), plain.size() - sizeof(uint32_t)));
+        }
+        if (!intact)
+        {
+            _compact = true;  // written when the process died, everything before it is good
+            break;
+        }
+
+        WireReader record(plain.data() + sizeof(uint32_t), plain.size() - sizeof(uint32_t));
+        uint64_t generation = 0;
+        uint8_t type = 0;
+        ClientID id;
+        if (!record.get(generation) || !record.get(type) || !record.get(id))
+            continue;
+        if (generation != _generation)
+        {
+            _compact = true;  // left over from before the snapshot was replaced
+            continue;
+        }
+
+        const ClientRoster::Handle handle = roster.handle(id);
+        switch (type)
+        {
+        case RECORD_ADD:
+        {
+            const size_t length = record.left();
+            const ClientRoster::Handle added = roster.add(id,
+                std::string_view(reinterpret_cast<const char*>(record.bytes(length)), length));
+            // a user that left and came back starts without keys, as the live merge had it
+            if (removed.erase(id) != 0)
+                roster.clearKeys(added);
+            break;
+        }
+        case RECORD_REMOVE:
+            removed.insert(id);
+            break;
+        case RECORD_PUBLIC_KEY:
+        {
+            PublicKey key;
+            if (handle != ClientRoster::INVALID_HANDLE && record.get(key))
+                roster.setPublicKey(handle, key);
+            break;
+        }
+        case RECORD_SYMMETRIC_KEY:
+        {
+            SymmetricKey key;
+            if (handle != ClientRoster::INVALID_HANDLE && record.get(key))
+                roster.setSymmetricKey(handle, key);
+            break;
+        }
+        case RECORD_MESSAGE_VERSION:
+        {
+            uint8_t version = 0;
+            if (handle != ClientRoster::INVALID_HANDLE && record.get(version))
+                roster.setMessageVersion(handle, version);
+            break;
+        }
+        case RECORD_ETAG:
+            etagSet = record.get(etag);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (removed.empty())
+        return;
+    // the roster only grows, users that left are dropped by building it again
+    ClientRoster kept;
+    kept.reserve(roster.size());
+    for (ClientRoster::Handle h = 0; h < roster.size(); ++h)
+    {
+        if (removed.count(roster.id(h)) != 0)
+            continue;
+        const ClientRoster::Handle handle = kept.add(roster.id(h), roster.username(h));
+        if (const PublicKey* key = roster.publicKey(h))
+            kept.setPublicKey(handle, *key);
+        if (const SymmetricKey* key = roster.symmetricKey(h))
+            kept.setSymmetricKey(handle, *key);
+        kept.setMessageVersion(handle, roster.messageVersion(h));
+    }
+    roster = std::move(kept);
+}
+
+//This function writes the roster to a temporary file and renames it over the snapshot, a crash leaves either version whole
+bool PeerDirectory::store(const ClientRoster& roster, const RosterETag* etag, std::string& error)
+{
+    if (!isOpen())
+    {
+        error = "Peer directory is not open.";
+        return false;
+    }
+
+    uint64_t generation = 0;
+    while (generation == 0)
+        AESWrapper::GenerateKey(reinterpret_cast<uint8_t*>(&generation), sizeof(generation));
+
+    size_t nameBytes = 0;
+    uint32_t keyCount = 0;
+    for (ClientRoster::Handle h = 0; h < roster.size(); ++h)
+    {
+        nameBytes += roster.username(h).size();
+        if (roster.publicKey(h) != nullptr || roster.symmetricKey(h) != nullptr || roster.messageVersion(h) != MESSAGE_VERSION_CBC)
+            ++keyCount;
+    }
+
+    std::vector<uint8_t> body(DIGEST_SIZE);
+    body.reserve(DIGEST_SIZE + 64 + roster.size() * (sizeof(ClientID) + 1) + nameBytes +
+        keyCount * (5 + sizeof(PublicKey) + sizeof(SymmetricKey)));
+    WireWriter writer(body);
+    writer.put(_self);
+    writer.put(generation);
+    writer.put(static_cast<uint32_t>(roster.size()));
+    writer.put(static_cast<uint32_t>(nameBytes));
+    writer.put(keyCount);
+    writer.put(static_cast<uint8_t>(etag != nullptr ? 1 : 0));
+    writer.put(etag != nullptr ? *etag : RosterETag());
+    for (ClientRoster::Handle h = 0; h < roster.size(); ++h)
+        writer.put(roster.id(h));
+    for (ClientRoster::Handle h = 0; h < roster.size(); ++h)
+        writer.put(static_cast<uint8_t>(roster.username(h).size()));
+    for (ClientRoster::Handle h = 0; h < roster.size(); ++h)
+        writer.bytes(roster.username(h).data(), roster.username(h).size());
+    for (ClientRoster::Handle h = 0; h < roster.size(); ++h)
+    {
+        const PublicKey* publicKey = roster.publicKey(h);
+        const SymmetricKey* symmetricKey = roster.symmetricKey(h);
+        const bool aead = roster.messageVersion(h) != MESSAGE_VERSION_CBC;
+        if (publicKey == nullptr && symmetricKey == nullptr && !aead)
+            continue;
+        writer.put(static_cast<uint32_t>(h));
+        writer.put(static_cast<uint8_t>((publicKey ? 1 : 0) | (symmetricKey ? 2 : 0) | (aead ? 4 : 0)));
+        writer.put(publicKey ? *publicKey : PublicKey());
+        writer.put(symmetricKey ? *symmetricKey : SymmetricKey());
+    }
+    CryptoPP::SHA256().CalculateDigest(body.data(), body.data() + DIGEST_SIZE, body.size() - DIGEST_SIZE);
+
+    const std::vector<uint8_t> cipher = LocalStorage::seal(*_aes, body.data(), body.size());
+    std::vector<uint8_t> header;
+    WireWriter headerWriter(header);
+    headerWriter.bytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    headerWriter.put(SNAPSHOT_VERSION);
+    headerWriter.put(static_cast<uint64_t>(cipher.size()));
+
+    const std::string temporary = _path + ".tmp";
+    FILE* file = LocalStorage::openFile(temporary, "wb");
+    if (file == nullptr)
+    {
+        error = "Couldn't open " + temporary;
+        return false;
+    }
+    const bool written = fwrite(header.data(), 1, header.size(), file) == header.size() &&
+        fwrite(cipher.data(), 1, cipher.size(), file) == cipher.size() && LocalStorage::syncToDisk(file);
+    fclose(file);
+    if (!written)
+    {
+        error = "Couldn't write " + temporary;
+        boost::system::error_code ignored;
+        boost::filesystem::remove(temporary, ignored);
+        return false;
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(temporary, _path, ec);
+    if (ec)
+    {
+        error = "Couldn't replace " + _path + ": " + ec.message();
+        return false;
+    }
+    // the rename itself is only durable once the directory is
+    if (!LocalStorage::syncDirectory(boost::filesystem::path(_path).parent_path().string()))
+    {
+        error = "Couldn't sync the directory of " + _path;
+        return false;
+    }
+
+    // the journal belongs to the previous snapshot now, its records would be skipped anyway
+    closeJournal();
+    boost::filesystem::remove(_journalPath, ec);
+    _generation = generation;
+    _journalSize = 0;
+    _compact = false;
+    return true;
+}
+
+//This function appends one sealed record, a record is [size][cipher] and its plaintext starts with a CRC of the rest
+bool PeerDirectory::append(const RecordType type, const ClientID& id, const uint8_t* data, const size_t size, std::string& error)
+{
+    if (!isOpen())
+    {
+        error = "Peer directory is not open.";
+        return false;
+    }
+    if (_journal == nullptr)
+    {
+        _journal = LocalStorage::openFile(_journalPath, "ab");
+        if (_journal == nullptr)
+        {
+            error = "Couldn't open " + _journalPath;
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> plain(sizeof(uint32_t));
+    WireWriter writer(plain);
+    writer.put(_generation);
+    writer.put(static_cast<uint8_t>(type));
+    writer.put(id);
+    writer.bytes(data, size);
+    WireField<uint32_t>::encode(LocalStorage::checksum(plain.data() + sizeof(uint32_t), plain.size() - sizeof(uint32_t)), plain.data());
+
+    const std::vector<uint8_t> cipher = LocalStorage::seal(*_aes, plain.data(), plain.size());
+    std::vector<uint8_t> record;
+    WireWriter recordWriter(record);
+    recordWriter.put(static_cast<uint32_t>(cipher.size()));
+    recordWriter.bytes(cipher.data(), cipher.size());
+
+    // flushed to the OS so a crash of the client loses nothing, only a power cut can tear the last record
+    if (fwrite(record.data(), 1, record.size(), _journal) != record.size() || fflush(_journal) != 0)
+    {
+        error = "Couldn't write " + _journalPath;
+        closeJournal();
+        _compact = true;
+        return false;
+    }
+    _journalSize += record.size();
+    return true;
+}
+
+bool PeerDirectory::recordChanges(const ClientRoster::MergeResult& changes, const RosterETag* etag, std::string& error)
+{
+    for (const auto& removed : changes.removed)
+    {
+        if (!append(RECORD_REMOVE, removed.id, nullptr, 0, error))
+            return false;
+    }
+    for (const auto& added : changes.added)
+    {
+        if (!append(RECORD_ADD, added.id, reinterpret_cast<const uint8_t*>(added.username.data()), added.username.size(), error))
+            return false;
+    }
+    if (etag != nullptr)
+        return append(RECORD_ETAG, _self, etag->tag, sizeof(etag->tag), error);
+    return true;
+}
+
+bool PeerDirectory::recordPublicKey(const ClientID& id, const PublicKey& key, std::string& error)
+{
+    return append(RECORD_PUBLIC_KEY, id, key.publicKey, sizeof(key.publicKey), error);
+}
+
+bool PeerDirectory::recordSymmetricKey(const ClientID& id, const SymmetricKey& key, std::string& error)
+{
+    return append(RECORD_SYMMETRIC_KEY, id, key.symmetricKey, sizeof(key.symmetricKey), error);
+}
+
+bool PeerDirectory::recordMessageVersion(const ClientID& id, const uint8_t version, std::string& error)
+{
+    return append(RECORD_MESSAGE_VERSION, id, &version, sizeof(version), error);
+}
+
+void PeerDirectory::closeJournal()
+{
+    if (_journal != nullptr)
+        fclose(_journal);
+    _journal = nullptr;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include "protocol.h"
+#include "ClientRoster.h"
+
+class AESWrapper;
+
+const size_t PEER_JOURNAL_COMPACT_SIZE = 1024 * 1024;  // journal size at which the directory is rewritten as one snapshot
+
+//This class keeps the users list and the keys exchanged with them on disk next to CLIENT_INFO, so a restart starts
+//with what the previous session knew. Everything is encrypted under a key derived from the private key.
+//A snapshot holds the whole roster and is replaced by renaming a finished temporary file over it,
+//changes made after it are appended to a journal that is replayed on load.
+class PeerDirectory
+{
+public:
+    PeerDirectory(const std::string& path = PEER_DIRECTORY);
+    virtual ~PeerDirectory();
+    PeerDirectory(const PeerDirectory& other) = delete;
+    PeerDirectory(PeerDirectory&& other) noexcept = delete;
+    PeerDirectory& operator=(const PeerDirectory& other) = delete;
+    PeerDirectory& operator=(PeerDirectory&& other) noexcept = delete;
+
+    // binds the directory to the client and derives the storage key, nothing is read or written before this
+    void open(const ClientID& self, const std::string& privateKey);
+    bool isOpen() const { return _aes != nullptr; }
+
+    // snapshot and journal into roster, returns true with an empty roster if nothing was stored for this client.
+    // A snapshot that can't be read is renamed to <path>.damaged, so the next store doesn't overwrite it
+    bool load(ClientRoster& roster, RosterETag& etag, bool& etagSet, std::string& error);
+
+    // writes the whole roster as a new snapshot and starts an empty journal
+    bool store(const ClientRoster& roster, const RosterETag* etag, std::string& error);
+
+    // journal records, applied on top of the snapshot by the next load
+    bool recordChanges(const ClientRoster::MergeResult& changes, const RosterETag* etag, std::string& error);
+    bool recordPublicKey(const ClientID& id, const PublicKey& key, std::string& error);
+    bool recordSymmetricKey(const ClientID& id, const SymmetricKey& key, std::string& error);
+    bool recordMessageVersion(const ClientID& id, const uint8_t version, std::string& error);
+
+    // the journal grew past PEER_JOURNAL_COMPACT_SIZE or ended in a torn record, time for store()
+    bool needsCompaction() const { return _compact || _journalSize >= PEER_JOURNAL_COMPACT_SIZE; }
+    bool hasSnapshot() const { return _generation != 0; }
+
+private:
+    enum RecordType : uint8_t
+    {
+        RECORD_ADD           = 1,
+        RECORD_REMOVE        = 2,
+        RECORD_PUBLIC_KEY    = 3,
+        RECORD_SYMMETRIC_KEY = 4,
+        RECORD_ETAG          = 5,
+        RECORD_MESSAGE_VERSION = 6
+    };
+
+    bool append(const RecordType type, const ClientID& id, const uint8_t* data, const size_t size, std::string& error);
+    bool loadSnapshot(ClientRoster& roster, RosterETag& etag, bool& etagSet, std::string& error);
+    void replayJournal(ClientRoster& roster, RosterETag& etag, bool& etagSet);
+    void closeJournal();
+
+private:
+    std::string _path;
+    std::string _journalPath;
+    ClientID    _self;
+    std::unique_ptr<AESWrapper> _aes;
+    uint64_t    _generation;    // random id of the current snapshot, journal records of an older one are ignored
+    uint64_t    _journalSize;
+    bool        _compact;
+    FILE*       _journal;
+};
@@ -0,0 +1,73 @@
+#include "PendingMessageDecoder.h"
+#include "AESCipherCache.h"
+#include "EncryptedMessages.h"
+#include "FileReceiver.h"
+#include <utility>
+
+// Constructor
+PendingMessageDecoder::PendingMessageDecoder(AESCipherCache& ciphers)
+    : _ciphers(ciphers)
+    , _encrypted(std::make_shared<EncryptedMessages>())
+    , _receiving(false)
+{
+}
+
+// Destructor, a decoder dropped on an error still waits for its files
+PendingMessageDecoder::~PendingMessageDecoder() = default;
+
+void PendingMessageDecoder::add(MainLogic::Message message)
+{
+    _messages.push_back(std::move(message));
+}
+
+//This function keeps the ciphertext with the cipher of the key, nothing is decrypted until the message is read
+void PendingMessageDecoder::decrypt(MainLogic::Message message, const ClientID& sender, const SymmetricKey& key,
+    const uint8_t* cipher, size_t size, bool aead)
+{
+    message.encrypted = _encrypted;
+    message.slot = _encrypted->add(_ciphers.get(sender, key), cipher, size, aead);
+    _messages.push_back(std::move(message));
+}
+
+void PendingMessageDecoder::receiveFile(MainLogic::Message message, const ClientID& sender, const SymmetricKey& key,
+    const std::string& path, bool aead)
+{
+    if (!_files)
+        _files.reset(new FileReceiver());
+    message.filePath = path;
+    message.content = "file received: " + path;
+    _fileMessages.emplace_back(_messages.size(), _files->begin(_ciphers.get(sender, key), path, aead));
+    _messages.push_back(std::move(message));
+    _receiving = true;
+}
+
+void PendingMessageDecoder::fileData(const uint8_t* cipher, size_t size, bool last)
+{
+    if (!_receiving)
+        return;
+    _files->write(cipher, size);
+    if (last)
+    {
+        _files->end();
+        _receiving = false;
+    }
+}
+
+//This function waits for the file writer, a file that wasn't written gets its error as content
+void PendingMessageDecoder::finish(std::vector<MainLogic::Message>& messages)
+{
+    if (_files)
+    {
+        std::vector<std::string> errors;
+        _files->finish(errors);
+        for (const auto& file : _fileMessages)
+        {
+            if (errors[file.second].empty())
+                continue;
+            _messages[file.first].content = errors[file.second];
+            _messages[file.first].filePath.clear();
+        }
+    }
+    messages = std::move(_messages);
+    _messages.clear();
+}
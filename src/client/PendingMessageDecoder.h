@@ -0,0 +1,53 @@
+/**
+ * Decrypt stage for pulled messages.
+ * Messages are queued in the order the server sent them, key messages are applied by the caller
+ * before the messages behind them are queued, so every encrypted message carries the cipher of the key
+ * that was in effect at its position. The ciphertext is kept and decrypted when the message is read,
+ * except for files, which are decrypted to disk by a FileReceiver while the rest of the pull comes in.
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <utility>
+#include "protocol.h"
+#include "MainLogic.h"
+
+class AESCipherCache;
+class EncryptedMessages;
+class FileReceiver;
+
+class PendingMessageDecoder
+{
+public:
+    PendingMessageDecoder(AESCipherCache& ciphers);
+    virtual ~PendingMessageDecoder();
+
+    PendingMessageDecoder(const PendingMessageDecoder& other)                = delete;
+    PendingMessageDecoder(PendingMessageDecoder&& other) noexcept            = delete;
+    PendingMessageDecoder& operator=(const PendingMessageDecoder& other)     = delete;
+    PendingMessageDecoder& operator=(PendingMessageDecoder&& other) noexcept = delete;
+
+    // a message that needs no decryption
+    void add(MainLogic::Message message);
+    // a message whose content is the decryption of cipher with the given key, cipher is copied,
+    // aead if it is a MSG_SEND_TEXT_AEAD message instead of a CBC one
+    void decrypt(MainLogic::Message message, const ClientID& sender, const SymmetricKey& key,
+        const uint8_t* cipher, size_t size, bool aead);
+    // a file message, its ciphertext follows through fileData() and is written to path
+    void receiveFile(MainLogic::Message message, const ClientID& sender, const SymmetricKey& key, const std::string& path,
+        bool aead);
+    // next piece of the file's ciphertext, ignored if the file is not received
+    void fileData(const uint8_t* cipher, size_t size, bool last);
+    // waits for the files and hands out the messages in queue order
+    void finish(std::vector<MainLogic::Message>& messages);
+
+private:
+    AESCipherCache& _ciphers;
+    std::vector<MainLogic::Message> _messages;
+    std::shared_ptr<EncryptedMessages> _encrypted;     // ciphertext of this pull, shared by its messages
+    std::unique_ptr<FileReceiver> _files;               // started with the first file
+    std::vector<std::pair<size_t, size_t>> _fileMessages;  // message index, file number
+    bool _receiving;
+};
@@ -0,0 +1,138 @@
+#include "PendingMessageParser.h"
+#include <algorithm>
+
+// a record buffer bigger than this is released once the record was handled
+static const size_t KEEP_PARTIAL_CAPACITY = 1 << 20;
+
+PendingMessageParser::PendingMessageParser(RecordHandler onRecord)
+    : _onRecord(std::move(onRecord))
+    , _streamLeft(0)
+    , _records(0)
+    , _peakBuffered(0)
+{
+}
+
+void PendingMessageParser::streamRecords(StreamFilter filter, PieceHandler onPiece)
+{
+    _streamFilter = std::move(filter);
+    _onPiece = std::move(onPiece);
+}
+
+// This function hands the next piece of the streamed record on, consuming from data
+bool PendingMessageParser::feedStream(const uint8_t*& data, size_t& size)
+{
+    const size_t piece = static_cast<size_t>(std::min<uint64_t>(size, _streamLeft));
+    const uint64_t offset = _streamed.messageSize - _streamLeft;
+    _streamLeft -= piece;
+    const bool last = (_streamLeft == 0);
+    if (last)
+        ++_records;
+    const ByteView content(data, piece);
+    data += piece;
+    size -= piece;
+    return _onPiece(_streamed, content, offset, last);
+}
+
+bool PendingMessageParser::dispatch(const PendingMessageRecord& record)
+{
+    ++_records;
+    return _onRecord(record);
+}
+
+// This function completes a record that started in an earlier chunk, consuming from data
+bool PendingMessageParser::feedPartial(const uint8_t*& data, size_t& size)
+{
+    const size_t headerSize = PendingMessageView::HEADER_SIZE;
+
+    // first the header, it tells how big the record is
+    if (_partial.size() < headerSize)
+    {
+        const size_t toCopy = std::min(size, headerSize - _partial.size());
+        _partial.insert(_partial.end(), data, data + toCopy);
+        data += toCopy;
+        size -= toCopy;
+        if (_partial.size() < headerSize)
+            return true;
+    }
+
+    PendingMessage header;
+    WireCodec::decode(_partial.data(), header);
+    if (isStreamed(header))
+    {
+        _partial.clear();
+        _streamed = header;
+        _streamLeft = header.messageSize;
+        if (_streamLeft == 0)
+            return feedStream(data, size);
+        return true;
+    }
+    const size_t recordSize = headerSize + header.messageSize;
+    if (_partial.capacity() < recordSize)
+        _partial.reserve(recordSize);
+
+    const size_t toCopy = std::min(size, recordSize - _partial.size());
+    _partial.insert(_partial.end(), data, data + toCopy);
+    data += toCopy;
+    size -= toCopy;
+    _peakBuffered = std::max(_peakBuffered, _partial.size());
+    if (_partial.size() < recordSize)
+        return true;
+
+    PendingMessageRecord record;
+    record.header = header;
+    record.content = ByteView(_partial.data() + headerSize, header.messageSize);
+    const bool keepGoing = dispatch(record);
+
+    _partial.clear();
+    if (_partial.capacity() > KEEP_PARTIAL_CAPACITY)
+        _partial.shrink_to_fit();
+    return keepGoing;
+}
+
+// This function parses the next chunk of the payload
+bool PendingMessageParser::feed(const uint8_t* data, size_t size)
+{
+    if (data == nullptr || size == 0)
+        return true;
+
+    while (size > 0 && (_streamLeft > 0 || !_partial.empty()))
+    {
+        if (_streamLeft > 0 && !feedStream(data, size))
+            return false;
+        if (!_partial.empty() && !feedPartial(data, size))
+            return false;
+    }
+    if (size == 0)
+        return true;
+
+    // whole records inside this chunk are handled in place
+    PendingMessageView view(data, size);
+    PendingMessageView::iterator it = view.begin();
+    const PendingMessageView::iterator end = view.end();
+    const uint8_t* consumed = data;
+    for (; it != end; ++it)
+    {
+        if (isStreamed(it->header))
+        {
+            // the record is here whole, it goes on as a single piece
+            _streamed = it->header;
+            _streamLeft = it->header.messageSize;
+            const uint8_t* content = it->content.data;
+            size_t contentSize = it->content.size;
+            if (!feedStream(content, contentSize))
+                return false;
+        }
+        else if (!dispatch(*it))
+            return false;
+        consumed = it->content.end();
+    }
+
+    // keep the tail, it is the start of a record that continues in the next chunk
+    size_t rest = static_cast<size_t>((data + size) - consumed);
+    while (rest > 0)
+    {
+        if (_streamLeft > 0 ? !feedStream(consumed, rest) : !feedPartial(consumed, rest))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+/**
+ * Push parser for the RESPONSE_PULL_PENDING_MSGS payload.
+ * Bytes are fed as they come off the socket and every complete record is handed to the
+ * callback right away. Records that arrive whole inside one chunk are passed without a copy,
+ * only a record split between chunks is assembled, so memory is bounded by the largest message.
+ * Records picked by streamRecords() are never assembled, their content is handed on piece by piece.
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include "PendingMessageView.h"
+
+class PendingMessageParser
+{
+public:
+    // return false to stop parsing
+    typedef std::function<bool(const PendingMessageRecord&)> RecordHandler;
+    // which records are streamed
+    typedef std::function<bool(const PendingMessage&)> StreamFilter;
+    // next piece of a streamed record, offset is where the piece starts in the content, return false to stop parsing
+    typedef std::function<bool(const PendingMessage&, const ByteView&, uint64_t offset, bool last)> PieceHandler;
+
+    explicit PendingMessageParser(RecordHandler onRecord);
+    void streamRecords(StreamFilter filter, PieceHandler onPiece);
+
+    virtual ~PendingMessageParser() = default;
+    PendingMessageParser(const PendingMessageParser& other)                = delete;
+    PendingMessageParser(PendingMessageParser&& other) noexcept            = delete;
+    PendingMessageParser& operator=(const PendingMessageParser& other)     = delete;
+    PendingMessageParser& operator=(PendingMessageParser&& other) noexcept = delete;
+
+    bool feed(const uint8_t* data, size_t size);
+    bool finish() const { return _partial.empty() && _streamLeft == 0; }   // true if the stream ended on a record boundary
+    size_t records() const { return _records; }
+    size_t peakBuffered() const { return _peakBuffered; }
+
+private:
+    bool feedPartial(const uint8_t*& data, size_t& size);
+    bool feedStream(const uint8_t*& data, size_t& size);
+    bool dispatch(const PendingMessageRecord& record);
+    bool isStreamed(const PendingMessage& header) const { return _streamFilter && _streamFilter(header); }
+
+    RecordHandler        _onRecord;
+    std::vector<uint8_t> _partial;       // record that started in an earlier chunk
+    StreamFilter         _streamFilter;
+    PieceHandler         _onPiece;
+    PendingMessage       _streamed;      // header of the streamed record being received
+    uint64_t             _streamLeft;    // its content bytes still to come
+    size_t               _records;
+    size_t               _peakBuffered;
+};
@@ -0,0 +1,134 @@
+/**
+ * Non-owning view over a RESPONSE_PULL_PENDING_MSGS payload.
+ * Iterating yields the decoded PendingMessage header of every record and a view of its
+ * ciphertext inside the received buffer, nothing is copied or allocated per message.
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include "protocol.h"
+#include "WireCodec.h"
+
+// Pointer + length into a buffer owned by somebody else
+struct ByteView
+{
+    const uint8_t* data = nullptr;
+    size_t         size = 0;
+
+    ByteView() = default;
+    ByteView(const uint8_t* bytes, size_t length) : data(bytes), size(length) {}
+
+    bool empty() const { return size == 0; }
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+};
+
+// One record of the pending messages payload
+struct PendingMessageRecord
+{
+    PendingMessage header;
+    ByteView       content;   // ciphertext, points into the payload
+};
+
+class PendingMessageView
+{
+public:
+    static const size_t HEADER_SIZE = WireCodec::size<PendingMessage>();
+
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag   iterator_category;
+        typedef PendingMessageRecord        value_type;
+        typedef std::ptrdiff_t              difference_type;
+        typedef const PendingMessageRecord* pointer;
+        typedef const PendingMessageRecord& reference;
+
+        iterator() : _position(nullptr), _end(nullptr) {}
+        iterator(const uint8_t* position, const uint8_t* end) : _position(position), _end(end) { load(); }
+
+        reference operator*() const { return _current; }
+        pointer operator->() const { return &_current; }
+
+        iterator& operator++()
+        {
+            _position = _current.content.end();
+            load();
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            iterator previous(*this);
+            ++(*this);
+            return previous;
+        }
+
+        bool operator==(const iterator& other) const { return _position == other._position; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+
+        // where the next record starts, equals the end of the payload after the last good record
+        const uint8_t* position() const { return _position; }
+
+    private:
+        // decode the record at _position, a truncated record ends the iteration
+        void load()
+        {
+            if (_position == nullptr || static_cast<size_t>(_end - _position) < HEADER_SIZE)
+            {
+                _position = _end;
+                return;
+            }
+            WireCodec::decode(_position, _current.header);
+            const size_t available = static_cast<size_t>(_end - _position) - HEADER_SIZE;
+            if (_current.header.messageSize > available)
+            {
+                _position = _end;
+                return;
+            }
+            _current.content = ByteView(_position + HEADER_SIZE, _current.header.messageSize);
+        }
+
+        const uint8_t*       _position;
+        const uint8_t*       _end;
+        PendingMessageRecord _current;
+    };
+
+    PendingMessageView(const uint8_t* payload, size_t size)
+        : _begin(payload)
+        , _end(payload == nullptr ? payload : payload + size)
+    {
+    }
+
+    iterator begin() const { return iterator(_begin, _end); }
+    iterator end() const { return iterator(_end, _end); }
+
+    // true if the payload splits into whole records with nothing left over
+    bool isWellFormed() const
+    {
+        const uint8_t* position = _begin;
+        while (position != _end)
+        {
+            if (static_cast<size_t>(_end - position) < HEADER_SIZE)
+                return false;
+            PendingMessage header;
+            WireCodec::decode(position, header);
+            if (header.messageSize > static_cast<size_t>(_end - position) - HEADER_SIZE)
+                return false;
+            position += HEADER_SIZE + header.messageSize;
+        }
+        return true;
+    }
+
+    size_t count() const
+    {
+        size_t records = 0;
+        for (auto it = begin(); it != end(); ++it)
+            ++records;
+        return records;
+    }
+
+private:
+    const uint8_t* _begin;
+    const uint8_t* _end;
+};
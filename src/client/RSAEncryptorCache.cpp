@@ -0,0 +1,81 @@
+#include "RSAEncryptorCache.h"
+#include <cstring>
+
+// Constructor
+RSAEncryptorCache::RSAEncryptorCache(const size_t capacity)
+    : _capacity(capacity > 0 ? capacity : 1)
+{
+}
+
+//This function returns the peer's encryptor and moves it to the front, a miss parses the key outside the lock
+std::shared_ptr<RSAPublicWrapper> RSAEncryptorCache::get(const ClientID& clientId, const PublicKey& publicKey)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _index.find(clientId);
+        if (it != _index.end() &&
+            memcmp(it->second->encryptor->getKey().publicKey, publicKey.publicKey, PUBLIC_KEY_SIZE) == 0)
+        {
+            _entries.splice(_entries.begin(), _entries, it->second);
+            ++_stats.hits;
+            return it->second->encryptor;
+        }
+        ++_stats.misses;
+    }
+
+    std::shared_ptr<RSAPublicWrapper> encryptor = std::make_shared<RSAPublicWrapper>(publicKey);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(clientId);
+    if (it != _index.end())
+        _entries.erase(it->second);
+    _entries.push_front(Entry{ clientId, encryptor });
+    _index[clientId] = _entries.begin();
+    evict();
+    return encryptor;
+}
+
+//This function drops the peer, called when the server hands out a different key for it
+void RSAEncryptorCache::invalidate(const ClientID& clientId)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(clientId);
+    if (it == _index.end())
+        return;
+    _entries.erase(it->second);
+    _index.erase(it);
+}
+
+void RSAEncryptorCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _index.clear();
+}
+
+void RSAEncryptorCache::setCapacity(const size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _capacity = capacity > 0 ? capacity : 1;
+    evict();
+}
+
+RSAEncryptorCache::Stats RSAEncryptorCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats stats = _stats;
+    stats.size = _entries.size();
+    stats.capacity = _capacity;
+    return stats;
+}
+
+// drop the least recently used peers until the cache fits, the lock is held by the caller
+void RSAEncryptorCache::evict()
+{
+    while (_entries.size() > _capacity)
+    {
+        _index.erase(_entries.back().clientId);
+        _entries.pop_back();
+        ++_stats.evictions;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "protocol.h"
+#include "RSAWrapper.h"
+
+const size_t RSA_ENCRYPTOR_CACHE_SIZE = 64;  // peers whose parsed public key is kept
+
+//This class keeps the parsed public keys (ready OAEP encryptors) of the most recently used peers.
+class RSAEncryptorCache
+{
+public:
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+    };
+
+    explicit RSAEncryptorCache(const size_t capacity = RSA_ENCRYPTOR_CACHE_SIZE);
+    virtual ~RSAEncryptorCache() = default;
+    RSAEncryptorCache(const RSAEncryptorCache& other) = delete;
+    RSAEncryptorCache(RSAEncryptorCache&& other) noexcept = delete;
+    RSAEncryptorCache& operator=(const RSAEncryptorCache& other) = delete;
+    RSAEncryptorCache& operator=(RSAEncryptorCache&& other) noexcept = delete;
+
+    // encryptor for the peer's key, parsed on the first use and again if the key is not the cached one
+    std::shared_ptr<RSAPublicWrapper> get(const ClientID& clientId, const PublicKey& publicKey);
+
+    void invalidate(const ClientID& clientId);
+    void clear();
+    void setCapacity(const size_t capacity);
+    Stats stats() const;
+
+private:
+    struct Entry
+    {
+        ClientID clientId;
+        std::shared_ptr<RSAPublicWrapper> encryptor;
+    };
+    typedef std::list<Entry> LRUList;  // most recently used first
+
+    void evict();
+
+    mutable std::mutex _mutex;
+    size_t  _capacity;
+    LRUList _entries;
+    std::unordered_map<ClientID, LRUList::iterator, ClientIDHash> _index;
+    Stats   _stats;
+};
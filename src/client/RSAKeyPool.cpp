@@ -0,0 +1,88 @@
+#include "RSAKeyPool.h"
+#include "RSAWrapper.h"
+#include <algorithm>
+
+RSAKeyPool::RSAKeyPool(const size_t size, size_t threads)
+    : _size(size)
+    , _waiting(0)
+    , _generating(0)
+    , _running(0)
+    , _stop(false)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    _running = threads;
+    for (size_t i = 0; i < threads; ++i)
+        _threads.emplace_back(&RSAKeyPool::run, this);
+}
+
+RSAKeyPool::~RSAKeyPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wanted.notify_all();
+    for (auto& thread : _threads)
+        thread.join();
+}
+
+bool RSAKeyPool::take(std::unique_ptr<RSAPrivateWrapper>& key, std::string& error)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    ++_waiting;
+    _wanted.notify_one();
+    _readyKey.wait(lock, [this] { return !_keys.empty() || _running == 0; });
+    --_waiting;
+    if (_keys.empty())
+    {
+        error = "RSA Error: " + _error;
+        return false;
+    }
+    key = std::move(_keys.front());
+    _keys.pop_front();
+    // the pool is short of one key now
+    _wanted.notify_one();
+    return true;
+}
+
+size_t RSAKeyPool::ready() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _keys.size();
+}
+
+//A generator thread: makes keys while the pool is short of them, a failure stops the thread
+void RSAKeyPool::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _wanted.wait(lock, [this] { return _stop || _keys.size() + _generating < _size + _waiting; });
+        if (_stop)
+            break;
+        ++_generating;
+        lock.unlock();
+
+        std::unique_ptr<RSAPrivateWrapper> key;
+        std::string error;
+        try {
+            key.reset(new RSAPrivateWrapper());
+        }
+        catch (const std::exception& ex) {
+            error = ex.what();
+        }
+
+        lock.lock();
+        --_generating;
+        if (!key)
+        {
+            _error = error;
+            break;
+        }
+        _keys.push_back(std::move(key));
+        _readyKey.notify_one();
+    }
+    --_running;
+    _readyKey.notify_all();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+class RSAPrivateWrapper;
+
+const size_t RSA_KEY_POOL_SIZE = 1;    // keys kept ready for an interactive registration
+
+//This class generates RSA key pairs on background threads ahead of demand, so taking one costs nothing
+//as long as the generators keep up. Generation goes on until size keys are ready plus one for every
+//take() that is waiting.
+class RSAKeyPool
+{
+public:
+    // threads 0 means one per processor
+    explicit RSAKeyPool(const size_t size = RSA_KEY_POOL_SIZE, size_t threads = 1);
+    // waits for the keys being generated, the ready ones are dropped
+    virtual ~RSAKeyPool();
+    RSAKeyPool(const RSAKeyPool& other) = delete;
+    RSAKeyPool(RSAKeyPool&& other) noexcept = delete;
+    RSAKeyPool& operator=(const RSAKeyPool& other) = delete;
+    RSAKeyPool& operator=(RSAKeyPool&& other) noexcept = delete;
+
+    // a ready key, waits for one if there is none, false if key generation failed
+    bool take(std::unique_ptr<RSAPrivateWrapper>& key, std::string& error);
+    size_t ready() const;
+
+private:
+    void run();
+
+    mutable std::mutex _mutex;
+    std::condition_variable _wanted;    // generators wait for room in the pool
+    std::condition_variable _readyKey;  // take() waits for a key
+    std::deque<std::unique_ptr<RSAPrivateWrapper>> _keys;
+    const size_t _size;
+    size_t _waiting;
+    size_t _generating;
+    size_t _running;
+    bool _stop;
+    std::string _error;
+    std::vector<std::thread> _threads;
+};
@@ -3,19 +3,23 @@
  */
 #include "RSAWrapper.h"
 #include "protocol.h"
+#include <stdexcept>
 
 
-RSAPublicWrapper::RSAPublicWrapper(const PublicKey& publicKey)
+RSAPublicWrapper::RSAPublicWrapper(const PublicKey& publicKey) : _publicKeyBytes(publicKey)
 {
 	CryptoPP::StringSource ss((publicKey.publicKey), sizeof(publicKey.publicKey), true);
-	_publicKey.Load(ss);
+	_encryptor.AccessKey().Load(ss);
 }
 
 std::string RSAPublicWrapper::encrypt(const uint8_t* plain, size_t length)
 {
-	std::string cipher;
-	CryptoPP::RSAES_OAEP_SHA_Encryptor e(_publicKey);
-	CryptoPP::StringSource ss(plain, length, true, new CryptoPP::PK_EncryptorFilter(randomNum, e, new CryptoPP::StringSink(cipher)));
+	if (length > _encryptor.FixedMaxPlaintextLength())
+		throw std::invalid_argument("RSA plaintext is too long");
+
+	std::string cipher(_encryptor.CiphertextLength(length), '\0');
+	std::lock_guard<std::mutex> lock(_mutex);
+	_encryptor.Encrypt(randomNum, plain, length, reinterpret_cast<CryptoPP::byte*>(&cipher[0]));
 	return cipher;
 }
 
@@ -5,6 +5,7 @@
 #include <osrng.h>
 #include <rsa.h>
 #include <string>
+#include <mutex>
 #include "protocol.h"
 
 
@@ -18,7 +19,9 @@ public:
 
 private:
 	CryptoPP::AutoSeededRandomPool randomNum;
-	CryptoPP::RSA::PublicKey       _publicKey;
+	PublicKey                      _publicKeyBytes;
+	CryptoPP::RSAES_OAEP_SHA_Encryptor _encryptor;	// holds the parsed key, built once
+	std::mutex                     _mutex;			// the random pool is not thread safe
 
 public:
 	RSAPublicWrapper(const PublicKey& publicKey);
@@ -29,6 +32,7 @@ public:
 	RSAPublicWrapper& operator=(const RSAPublicWrapper& other)     = delete;
 	RSAPublicWrapper& operator=(RSAPublicWrapper&& other) noexcept = delete;
 
+	const PublicKey& getKey() const { return _publicKeyBytes; }
 	std::string encrypt(const uint8_t* plain, size_t length);
 };
 
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+//Fixed size byte ring used by SocketHandler to keep bytes that were read ahead of the current message.
+template <size_t Capacity>
+class RingBuffer
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+public:
+    RingBuffer() : _head(0), _tail(0) {}
+
+    size_t size() const { return _tail - _head; }
+    size_t freeSpace() const { return Capacity - size(); }
+    bool empty() const { return _head == _tail; }
+    static constexpr size_t capacity() { return Capacity; }
+
+    void clear() { _head = _tail = 0; }
+
+    // Largest contiguous free region, a socket read can land here directly
+    uint8_t* writeRegion(size_t& length)
+    {
+        const size_t offset = _tail & (Capacity - 1);
+        length = std::min(freeSpace(), Capacity - offset);
+        return _data + offset;
+    }
+
+    // Mark bytes written into writeRegion() as readable
+    void commit(const size_t bytes) { _tail += bytes; }
+
+    // Copy up to bytes out of the ring, returns how many were copied
+    size_t read(uint8_t* const dest, const size_t bytes)
+    {
+        const size_t toRead = std::min(bytes, size());
+        const size_t offset = _head & (Capacity - 1);
+        const size_t first = std::min(toRead, Capacity - offset);
+        memcpy(dest, _data + offset, first);
+        memcpy(dest + first, _data, toRead - first);
+        _head += toRead;
+        return toRead;
+    }
+
+    // Drop up to bytes from the ring, returns how many were dropped
+    size_t discard(const size_t bytes)
+    {
+        const size_t toDrop = std::min(bytes, size());
+        _head += toDrop;
+        return toDrop;
+    }
+
+private:
+    uint8_t _data[Capacity];
+    size_t  _head;   // read position, never wrapped
+    size_t  _tail;   // write position, never wrapped
+};
@@ -0,0 +1,194 @@
+#include "SearchIndex.h"
+#include "WireCodec.h"
+#include <algorithm>
+#include <iterator>
+
+//This function splits text into words, anything but an ASCII letter or digit ends a word
+void SearchIndex::tokenize(const std::string& text, std::vector<std::string>& terms)
+{
+    terms.clear();
+    std::string term;
+    for (size_t i = 0; i <= text.size(); ++i)
+    {
+        const unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : 0;
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+        {
+            if (term.size() < SEARCH_TERM_MAX_SIZE)
+                term.push_back(static_cast<char>(c));
+        }
+        else if (c >= 'A' && c <= 'Z')
+        {
+            if (term.size() < SEARCH_TERM_MAX_SIZE)
+                term.push_back(static_cast<char>(c - 'A' + 'a'));
+        }
+        else if (!term.empty())
+        {
+            terms.push_back(term);
+            term.clear();
+        }
+    }
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+}
+
+void SearchIndex::appendVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void SearchIndex::decode(const Postings& postings, std::vector<uint64_t>& documents)
+{
+    documents.clear();
+    documents.reserve(postings.count);
+    uint64_t document = 0;
+    const uint8_t* position = postings.gaps.data();
+    const uint8_t* const end = position + postings.gaps.size();
+    while (position < end)
+    {
+        uint64_t gap = 0;
+        unsigned shift = 0;
+        while (position < end && (*position & 0x80) != 0)
+        {
+            gap |= static_cast<uint64_t>(*position++ & 0x7f) << shift;
+            shift += 7;
+        }
+        if (position < end)
+            gap |= static_cast<uint64_t>(*position++) << shift;
+        document += gap;
+        documents.push_back(document);
+    }
+}
+
+void SearchIndex::add(const uint64_t document, const std::vector<std::string>& terms)
+{
+    for (const std::string& term : terms)
+    {
+        Postings& postings = _terms[term];
+        if (postings.count > 0 && document <= postings.last)
+            continue;   // out of order, the lists only grow at the end
+        appendVarint(postings.gaps, document - postings.last);
+        postings.last = document;
+        ++postings.count;
+    }
+}
+
+//This function intersects the posting lists of the query words, starting from the shortest one
+void SearchIndex::find(const std::string& query, std::vector<uint64_t>& documents) const
+{
+    documents.clear();
+    std::vector<std::string> words;
+    tokenize(query, words);
+    if (words.empty())
+        return;
+
+    std::vector<const Postings*> lists;
+    for (const std::string& word : words)
+    {
+        const auto it = _terms.find(word);
+        if (it == _terms.end())
+            return;
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(),
+        [](const Postings* left, const Postings* right) { return left->count < right->count; });
+
+    decode(*lists.front(), documents);
+    std::vector<uint64_t> other;
+    std::vector<uint64_t> common;   // set_intersection may not write into one of its inputs
+    for (size_t i = 1; i < lists.size() && !documents.empty(); ++i)
+    {
+        decode(*lists[i], other);
+        common.clear();
+        std::set_intersection(documents.begin(), documents.end(), other.begin(), other.end(), std::back_inserter(common));
+        documents.swap(common);
+    }
+}
+
+void SearchIndex::dropBefore(const uint64_t first)
+{
+    std::vector<uint64_t> documents;
+    for (auto it = _terms.begin(); it != _terms.end();)
+    {
+        Postings& postings = it->second;
+        if (postings.last < first)
+        {
+            it = _terms.erase(it);
+            continue;
+        }
+        decode(postings, documents);
+        const auto keep = std::lower_bound(documents.begin(), documents.end(), first);
+        if (keep != documents.begin())
+        {
+            postings.gaps.clear();
+            postings.count = 0;
+            uint64_t previous = 0;
+            for (auto document = keep; document != documents.end(); ++document)
+            {
+                appendVarint(postings.gaps, *document - previous);
+                previous = *document;
+                ++postings.count;
+            }
+            postings.gaps.shrink_to_fit();
+        }
+        ++it;
+    }
+}
+
+void SearchIndex::clear()
+{
+    _terms.clear();
+}
+
+size_t SearchIndex::memoryUsage() const
+{
+    size_t usage = _terms.bucket_count() * sizeof(void*);
+    for (const auto& term : _terms)
+        usage += sizeof(term) + term.first.capacity() + term.second.gaps.capacity();
+    return usage;
+}
+
+void SearchIndex::save(WireWriter& writer) const
+{
+    writer.put(static_cast<uint32_t>(_terms.size()));
+    for (const auto& term : _terms)
+    {
+        writer.put(static_cast<uint8_t>(term.first.size()));
+        writer.bytes(term.first.data(), term.first.size());
+        writer.put(term.second.count);
+        writer.put(term.second.last);
+        writer.put(static_cast<uint32_t>(term.second.gaps.size()));
+        writer.bytes(term.second.gaps.data(), term.second.gaps.size());
+    }
+}
+
+bool SearchIndex::load(WireReader& reader)
+{
+    clear();
+    uint32_t count = 0;
+    if (!reader.get(count))
+        return false;
+    _terms.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint8_t length = 0;
+        const uint8_t* term = nullptr;
+        Postings postings;
+        uint32_t size = 0;
+        const uint8_t* gaps = nullptr;
+        if (!reader.get(length) || (term = reader.bytes(length)) == nullptr ||
+            !reader.get(postings.count) || !reader.get(postings.last) ||
+            !reader.get(size) || (gaps = reader.bytes(size)) == nullptr)
+        {
+            clear();
+            return false;
+        }
+        postings.gaps.assign(gaps, gaps + size);
+        _terms.emplace(std::string(reinterpret_cast<const char*>(term), length), std::move(postings));
+    }
+    return true;
+}
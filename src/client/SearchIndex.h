@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+class WireWriter;
+class WireReader;
+
+const size_t SEARCH_TERM_MAX_SIZE = 64;    // longer words are cut to this
+
+//This class is an inverted index over message texts: every word maps to the documents it appears in.
+//Documents are numbers given in increasing order, a posting list keeps the gaps between them as varints
+//so adding a document only appends to the lists of its words.
+class SearchIndex
+{
+public:
+    SearchIndex() = default;
+    virtual ~SearchIndex() = default;
+    SearchIndex(const SearchIndex& other) = delete;
+    SearchIndex(SearchIndex&& other) noexcept = delete;
+    SearchIndex& operator=(const SearchIndex& other) = delete;
+    SearchIndex& operator=(SearchIndex&& other) noexcept = delete;
+
+    // lower case runs of ASCII letters and digits, each word once
+    static void tokenize(const std::string& text, std::vector<std::string>& terms);
+
+    // terms as given by tokenize(), document must be above every document added before
+    void add(const uint64_t document, const std::vector<std::string>& terms);
+    // documents holding every word of the query, ascending
+    void find(const std::string& query, std::vector<uint64_t>& documents) const;
+    // forgets the documents below first
+    void dropBefore(const uint64_t first);
+
+    void clear();
+    bool empty() const { return _terms.empty(); }
+    size_t terms() const { return _terms.size(); }
+    size_t memoryUsage() const;
+
+    void save(WireWriter& writer) const;
+    bool load(WireReader& reader);
+
+private:
+    struct Postings
+    {
+        std::vector<uint8_t> gaps;  // varint gaps, the first one from 0
+        uint64_t last = 0;
+        uint32_t count = 0;
+    };
+
+    static void appendVarint(std::vector<uint8_t>& out, uint64_t value);
+    static void decode(const Postings& postings, std::vector<uint64_t>& documents);
+
+private:
+    std::unordered_map<std::string, Postings> _terms;
+};
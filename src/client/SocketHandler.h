@@ -3,18 +3,33 @@
 #include <string>
 #include <cstdint>
 #include <ostream>
+#include <memory>
+#include <vector>
+#include <boost/asio/buffer.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include "ConnectionPool.h"
+#include "RingBuffer.h"
 
 using boost::asio::ip::tcp;
 using boost::asio::io_context;
 
+typedef std::vector<boost::asio::const_buffer> BufferList;  // pieces of one message, written with a single gather write
+
 const size_t PACKET_SIZE = 1024;  
+const size_t RECEIVE_RING_SIZE = 4096;  // read-ahead buffer, bigger reads go straight to the caller
 
 //This class is responsible for handling socket communication.
 class SocketHandler
 {
 public:
 
+    // Exact writes/reads only the bytes of the message, Padded fills every message up to PACKET_SIZE like server.py send_response
+    enum class Framing
+    {
+        Exact,
+        Padded
+    };
+
     SocketHandler();
     virtual ~SocketHandler();
 
@@ -40,20 +55,57 @@ public:
     bool setSocketInfo( const std::string& port,  const std::string& address);
     bool connect();
     void close();
-    bool receive(uint8_t* const buffer, const size_t size) const;
+    bool receive(uint8_t* const buffer, const size_t size);
+    bool discard(size_t size);
+    bool endMessage();
     bool send(const uint8_t* const buffer, const size_t size) const;
+    bool send(const BufferList& buffers) const;
+    bool write(const BufferList& buffers) const;
+    bool endSend(const size_t messageSize) const;
+    bool receiveResponse(uint8_t* const response, const size_t resSize);
     bool sendReceive(const uint8_t* const toSend, const size_t size, uint8_t* const response, const size_t resSize);
+    bool sendReceive(const BufferList& toSend, uint8_t* const response, const size_t resSize);
+
+    bool warmUp(const size_t count = 1);
+    void setFraming(const Framing framing) { _framing = framing; }
+    void setKeepAlive(const bool keepAlive) { _keepAlive = keepAlive; }
+    void abort() { failed = true; }  // message was left half written, close() must not pool the connection
+    Framing getFraming() const { return _framing; }
+    bool getKeepAlive() const { return _keepAlive; }
 
 private:
 
     std::string    _address;     
     std::string    _port;         
     io_context*    _ioContext;    
-    tcp::resolver* _resolver;    
-    tcp::socket*   _socket;      
-    bool           bigEndian;    // Flag for big-endian.
+    ConnectionPool* _pool;        // warm connections, owns the cached resolve
+    std::unique_ptr<tcp::socket> _socket;  // connection borrowed from the pool
     bool           connected;    // conntection indicator
+    mutable bool   failed;       // set on i/o error so the socket is not returned to the pool
+    Framing        _framing;
+    bool           _keepAlive;   // server keeps connections open after a response, otherwise only fresh ones are pooled
+    RingBuffer<RECEIVE_RING_SIZE> _ring;  // bytes read from the socket but not handed out yet
+    size_t         _messageBytes;   // bytes handed out since the last endMessage()
+};
 
 
-    void swapBytes(uint8_t* const buffer, size_t size) const;
+//This class borrows a pooled connection for the scope of one request and gives it back when done.
+class ScopedConnection
+{
+public:
+    explicit ScopedConnection(SocketHandler& socketHandler)
+        : _socketHandler(socketHandler)
+        , _connected(socketHandler.connect())
+    {
+    }
+    ~ScopedConnection() { _socketHandler.close(); }
+
+    ScopedConnection(const ScopedConnection& other)            = delete;
+    ScopedConnection& operator=(const ScopedConnection& other) = delete;
+
+    bool isConnected() const { return _connected; }
+
+private:
+    SocketHandler& _socketHandler;
+    const bool     _connected;
 };
@@ -4,26 +4,31 @@
 #include <boost/algorithm/string.hpp>
 #include <cctype>
 #include <algorithm>
+#include <vector>
+#include "WireCodec.h"
 
 using boost::asio::ip::tcp;
 using boost::asio::io_context;
 
 // Constructor
 SocketHandler::SocketHandler()
-    : _ioContext(nullptr)
-    , _resolver(nullptr)
-    , _socket(nullptr)
+    : _ioContext(new io_context)
+    , _pool(nullptr)
     , connected(false)
+    , failed(false)
+    , _framing(Framing::Exact)
+    , _keepAlive(false)
+    , _messageBytes(0)
 {
-   
-    uint32_t endianValue = 1;
-    bigEndian = (*reinterpret_cast<uint8_t*>(&endianValue) == 0);
+    _pool = new ConnectionPool(*_ioContext);
 }
 
 
 SocketHandler::~SocketHandler()
 {
     close();
+    delete _pool;         // pooled sockets go before their io_context
+    delete _ioContext;
 }
 
 // Set address/port after checking validity
@@ -33,6 +38,7 @@ bool SocketHandler::setSocketInfo( const std::string& port, const std::string& a
     {
         _address = address;
         _port = port;
+        _pool->setEndpoint(address, port);
         return true;
     }
     return false;
@@ -62,134 +68,194 @@ bool SocketHandler::isValidPort(const std::string& port)
     return std::stoi(port) > 0;
 }
 
+// Borrow a connection from the pool, opens a new one only if no warm connection is available
 bool SocketHandler::connect()
 {
     if (!isValidAddress(_address) || !isValidPort(_port))
         return false;
-    try
-    {
-        close();  // Clean previous connection
 
-        _ioContext = new io_context;
-        _resolver = new tcp::resolver(*_ioContext);
-        _socket = new tcp::socket(*_ioContext);
-
-        boost::asio::connect(*_socket, _resolver->resolve(_address, _port));
-        _socket->non_blocking(false);  
-        connected = true;
-    }
-    catch (...)  
-    {
-        connected = false;
-    }
+    close();  // Return previous connection
+    _socket = _pool->acquire();
+    connected = (_socket != nullptr);
+    failed = false;
+    _ring.clear();
+    _messageBytes = 0;
     return connected;
 }
 
-// Close connection and cleanup resources
+// Give the connection back to the pool, it is dropped there if the server closed its side
 void SocketHandler::close()
 {
-    try
+    // bytes left in the ring belong to no request, such a stream is out of sync
+    if (_socket != nullptr)
     {
-        if (_socket != nullptr)
-            _socket->close();
+        _pool->release(std::move(_socket), _keepAlive && !failed && _ring.empty());
+        // a kept-alive connection that could not go back is replaced ahead of the next request, the pool runs one
+        // warm-up at a time. server.py closes after every response, warming for it would only park idle sockets there
+        if (_keepAlive && _pool->idleCount() == 0)
+            _pool->warmAsync();
     }
-    catch (...) {}
-
-    delete _socket;       
-    delete _resolver;     
-    delete _ioContext;    
-    _socket = nullptr;
-    _resolver = nullptr;
-    _ioContext = nullptr;
+    _socket.reset();
     connected = false;
+    failed = false;
+    _ring.clear();
+    _messageBytes = 0;
 }
 
-//This function Sends data in chunks with endian conversion
+// Open connections ahead of the next request
+bool SocketHandler::warmUp(const size_t count)
+{
+    if (!isValidAddress(_address) || !isValidPort(_port))
+        return false;
+    return _pool->warm(count);
+}
+
+//This function writes the message in one call, padded up to PACKET_SIZE only in Padded framing
 bool SocketHandler::send(const uint8_t* const buffer, const size_t size) const
 {
-    if (_socket == nullptr || !connected || buffer == nullptr || size == 0)
+    if (buffer == nullptr || size == 0)
         return false;
+    return send(BufferList{ boost::asio::buffer(buffer, size) });
+}
 
-    size_t totalBytesSent = 0;
-    while (totalBytesSent < size)
-    {
-        boost::system::error_code errorCode;
-        size_t chunkSize = std::min(PACKET_SIZE, size - totalBytesSent);
-        uint8_t packet[PACKET_SIZE] = { 0 };
-        memcpy(packet, buffer + totalBytesSent, chunkSize);
+//This function writes all the pieces of one message with a single gather write (writev / WSASend), nothing is staged
+bool SocketHandler::send(const BufferList& buffers) const
+{
+    const size_t size = boost::asio::buffer_size(buffers);
+    if (size == 0)
+        return false;
+    return write(buffers) && endSend(size);
+}
 
-        // Convert to network byte order if needed
-        if (bigEndian)
-            swapBytes(packet, chunkSize);
+//This function writes part of a message that is sent in pieces, byte order is already little-endian (WireCodec)
+bool SocketHandler::write(const BufferList& buffers) const
+{
+    const size_t size = boost::asio::buffer_size(buffers);
+    if (_socket == nullptr || !connected || size == 0)
+        return false;
 
-        // WARNING: Incorrect buffer size (should use chunkSize)
-        size_t bytesWritten = write(*_socket, boost::asio::buffer(packet, PACKET_SIZE), errorCode);
-        if (errorCode || bytesWritten == 0)
-            return false;
-        totalBytesSent += bytesWritten;
+    boost::system::error_code errorCode;
+    size_t bytesWritten = boost::asio::write(*_socket, buffers, errorCode);
+    if (errorCode || bytesWritten != size)
+    {
+        failed = true;
+        return false;
     }
     return true;
 }
 
-//This function Receivse data with endian conversion
-bool SocketHandler::receive(uint8_t* const buffer, const size_t size) const
+//This function ends a message of messageSize bytes, in Padded framing its last packet is filled up with zeros
+bool SocketHandler::endSend(const size_t messageSize) const
 {
-    
-    size_t amountReceived = 0;
-    uint8_t tempBuffer[PACKET_SIZE] = { 0 };
+    static const uint8_t padding[PACKET_SIZE] = { 0 };
+
+    const size_t paddingSize = (_framing == Framing::Padded) ? (PACKET_SIZE - messageSize % PACKET_SIZE) % PACKET_SIZE : 0;
+    if (paddingSize == 0)
+        return true;
+    return write(BufferList{ boost::asio::buffer(padding, paddingSize) });
+}
 
+//This function reads exactly size bytes, small reads are served from the ring so we dont cross into the next message
+bool SocketHandler::receive(uint8_t* const buffer, const size_t size)
+{
     if (!_socket || !connected || buffer == nullptr || size == 0)
         return false;
 
+    size_t amountReceived = _ring.read(buffer, size);
     while (amountReceived < size)
     {
         boost::system::error_code errorCode;
-        size_t bytesRead = read(*_socket, boost::asio::buffer(tempBuffer, PACKET_SIZE), errorCode);
-        if (bytesRead == 0)
+        const size_t remaining = size - amountReceived;
+        if (remaining >= _ring.capacity())
+        {
+            // Big payload, read straight into the callers buffer
+            size_t bytesRead = _socket->read_some(boost::asio::buffer(buffer + amountReceived, remaining), errorCode);
+            if (errorCode || bytesRead == 0)
+            {
+                failed = true;
+                return false;
+            }
+            amountReceived += bytesRead;
+            continue;
+        }
+
+        size_t freeLength = 0;
+        uint8_t* const region = _ring.writeRegion(freeLength);
+        size_t bytesRead = _socket->read_some(boost::asio::buffer(region, freeLength), errorCode);
+        if (errorCode || bytesRead == 0)
+        {
+            failed = true;
             return false;
+        }
+        _ring.commit(bytesRead);
+        amountReceived += _ring.read(buffer + amountReceived, remaining);
+    }
 
-  
-        if (bigEndian)
-            swapBytes(tempBuffer, bytesRead);
+    _messageBytes += size;
+    return true;
+}
 
-        // Copy to output buffer
-        size_t bytesToCopy = std::min(bytesRead, size - amountReceived);
-        memcpy(buffer + amountReceived, tempBuffer, bytesToCopy);
-        amountReceived += bytesToCopy;
+//This function skips bytes of the current message we have no use for
+bool SocketHandler::discard(size_t size)
+{
+    uint8_t sink[PACKET_SIZE];
+    while (size > 0)
+    {
+        const size_t chunk = std::min(size, sizeof(sink));
+        if (!receive(sink, chunk))
+            return false;
+        size -= chunk;
     }
     return true;
 }
 
-// This function Checks response and sends/receives data
+//This function closes the current message, in Padded framing the rest of its last packet is skipped
+bool SocketHandler::endMessage()
+{
+    bool booleanResponse = true;
+    if (_framing == Framing::Padded)
+        booleanResponse = discard((PACKET_SIZE - _messageBytes % PACKET_SIZE) % PACKET_SIZE);
+    _messageBytes = 0;
+    return booleanResponse;
+}
+
+// This function sends the request and reads back the response header and as much payload as fits the response buffer
 bool SocketHandler::sendReceive(const uint8_t* const toSend, const size_t size,
     uint8_t* const response, const size_t resSize)
 {
-    if (!connect())
+    if (toSend == nullptr || size == 0)
         return false;
+    return sendReceive(BufferList{ boost::asio::buffer(toSend, size) }, response, resSize);
+}
 
-    bool booleanResponse = false;
-    if (send(toSend, size))
-        booleanResponse = receive(response, resSize);
-    close();  // Always close after operation
-    return booleanResponse;
+// Same as above for a request made of several pieces
+bool SocketHandler::sendReceive(const BufferList& toSend, uint8_t* const response, const size_t resSize)
+{
+    if (response == nullptr || resSize < WireCodec::size<RESHeader>())
+        return false;
+
+    ScopedConnection connection(*this);
+    if (!connection.isConnected())
+        return false;
+
+    return send(toSend) && receiveResponse(response, resSize);  // connection goes back to the pool
 }
 
-// This function is for endian conversion it Swaps 32-bit order
-void SocketHandler::swapBytes(uint8_t* const buffer, size_t size) const
+// This function reads the response header and as much payload as fits the buffer, the rest of the payload is skipped
+bool SocketHandler::receiveResponse(uint8_t* const response, const size_t resSize)
 {
-    if (buffer == nullptr || size < sizeof(uint32_t))
-        return;
+    if (response == nullptr || resSize < WireCodec::size<RESHeader>())
+        return false;
+    if (!receive(response, WireCodec::size<RESHeader>()))
+        return false;
 
-    //  4-byte segment
-    const size_t numInts = size / sizeof(uint32_t);
-    uint32_t* const ptr = reinterpret_cast<uint32_t*>(buffer);
-    for (size_t i = 0; i < numInts; ++i)
-    {
-        // Reverse the bytes for each 32-bit value
-        uint32_t value = ptr[i];
-        ptr[i] = ((value & 0xFF000000) >> 24) |
-                 ((value & 0x00FF0000) >> 8) |
-                 ((value & 0x0000FF00) << 8) |
-                 ((value & 0x000000FF) << 24);
-    }
+    RESHeader header;
+    WireCodec::decode(response, header);
+    const size_t payloadSize = header.payloadSize;
+    const size_t toRead = std::min(payloadSize, resSize - WireCodec::size<RESHeader>());
+    if (toRead > 0 && !receive(response + WireCodec::size<RESHeader>(), toRead))
+        return false;
+    if (!discard(payloadSize - toRead))
+        return false;
+    return endMessage();
 }
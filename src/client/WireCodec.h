@@ -0,0 +1,322 @@
+/**
+ * Compile time description of the protocol.h messages and their little-endian encoding.
+ * Every message lists its fields in order in a WireLayout specialization, the codec walks
+ * that list at compile time. On little-endian hosts whole messages are copied with memcpy.
+ */
+#pragma once
+#include <array>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+#include <boost/predef/other/endian.h>
+#include "protocol.h"
+
+#if BOOST_ENDIAN_LITTLE_BYTE
+const bool HOST_LITTLE_ENDIAN = true;
+#else
+const bool HOST_LITTLE_ENDIAN = false;
+#endif
+
+// Field list of a message, specialized below for every wire struct
+template <typename T>
+struct WireLayout;
+
+// Raw byte arrays (ids, names, keys) have no byte order
+template <typename T>
+struct WireBytes : std::false_type {};
+template <> struct WireBytes<ClientID>     : std::true_type {};
+template <> struct WireBytes<ClientName>   : std::true_type {};
+template <> struct WireBytes<PublicKey>    : std::true_type {};
+template <> struct WireBytes<SymmetricKey> : std::true_type {};
+template <> struct WireBytes<RosterETag>   : std::true_type {};
+
+template <typename T, typename Enable = void>
+struct HasWireLayout : std::false_type {};
+template <typename T>
+struct HasWireLayout<T, std::void_t<decltype(WireLayout<T>::fields())>> : std::true_type {};
+
+template <typename T, typename Enable = void>
+struct WireField;
+
+// Integers, written byte by byte least significant first. Compilers fold this into a single load/store.
+template <typename T>
+struct WireField<T, typename std::enable_if<std::is_integral<T>::value>::type>
+{
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    static constexpr size_t size = sizeof(T);
+
+    static void encode(const T& value, uint8_t* const out)
+    {
+        const Unsigned bits = static_cast<Unsigned>(value);
+        for (size_t i = 0; i < sizeof(T); ++i)
+            out[i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+
+    static void decode(const uint8_t* const in, T& value)
+    {
+        Unsigned bits = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+            bits |= static_cast<Unsigned>(static_cast<Unsigned>(in[i]) << (8 * i));
+        value = static_cast<T>(bits);
+    }
+};
+
+template <typename T>
+struct WireField<T, typename std::enable_if<WireBytes<T>::value>::type>
+{
+    static constexpr size_t size = sizeof(T);
+
+    static void encode(const T& value, uint8_t* const out) { memcpy(out, &value, sizeof(T)); }
+    static void decode(const uint8_t* const in, T& value) { memcpy(&value, in, sizeof(T)); }
+};
+
+template <typename Fields>
+struct WireFieldsSize;
+
+template <typename... Members>
+struct WireFieldsSize<std::tuple<Members...>>
+{
+    template <typename M>
+    struct MemberType;
+    template <typename M, typename C>
+    struct MemberType<M C::*> { typedef typename std::remove_const<M>::type type; };
+
+    static constexpr size_t value = (size_t(0) + ... + WireField<typename MemberType<Members>::type>::size);
+};
+
+// Nested messages (a header inside a request, a payload struct) are walked field by field
+template <typename T>
+struct WireField<T, typename std::enable_if<HasWireLayout<T>::value>::type>
+{
+    typedef decltype(WireLayout<T>::fields()) Fields;
+    static constexpr size_t size = WireFieldsSize<Fields>::value;
+
+    // struct is laid out exactly like the wire, on little-endian hosts it can be copied as is
+    static constexpr bool memcpyCompatible = HOST_LITTLE_ENDIAN && sizeof(T) == size;
+
+    static void encode(const T& value, uint8_t* const out)
+    {
+        if constexpr (memcpyCompatible)
+            memcpy(out, &value, sizeof(T));
+        else
+            encodeFields(value, out, std::make_index_sequence<std::tuple_size<Fields>::value>());
+    }
+
+    static void decode(const uint8_t* const in, T& value)
+    {
+        if constexpr (memcpyCompatible)
+            memcpy(&value, in, sizeof(T));
+        else
+            decodeFields(in, value, std::make_index_sequence<std::tuple_size<Fields>::value>());
+    }
+
+private:
+    template <typename M, typename C>
+    static void encodeMember(const T& value, M C::* member, uint8_t*& out)
+    {
+        typedef typename std::remove_const<M>::type Field;
+        WireField<Field>::encode(value.*member, out);
+        out += WireField<Field>::size;
+    }
+
+    template <typename M, typename C>
+    static void decodeMember(const uint8_t*& in, T& value, M C::* member)
+    {
+        WireField<M>::decode(in, value.*member);
+        in += WireField<M>::size;
+    }
+
+    template <size_t... I>
+    static void encodeFields(const T& value, uint8_t* out, std::index_sequence<I...>)
+    {
+        const Fields fields = WireLayout<T>::fields();
+        (encodeMember(value, std::get<I>(fields), out), ...);
+    }
+
+    template <size_t... I>
+    static void decodeFields(const uint8_t* in, T& value, std::index_sequence<I...>)
+    {
+        const Fields fields = WireLayout<T>::fields();
+        (decodeMember(in, value, std::get<I>(fields)), ...);
+    }
+};
+
+
+//This class encodes and decodes protocol messages to and from their little-endian wire form.
+class WireCodec
+{
+public:
+    template <typename T>
+    static constexpr size_t size() { return WireField<T>::size; }
+
+    template <typename T>
+    static void encode(const T& message, uint8_t* const out) { WireField<T>::encode(message, out); }
+
+    template <typename T>
+    static std::array<uint8_t, WireField<T>::size> encode(const T& message)
+    {
+        std::array<uint8_t, WireField<T>::size> bytes;
+        WireField<T>::encode(message, bytes.data());
+        return bytes;
+    }
+
+    template <typename T>
+    static void decode(const uint8_t* const in, T& message) { WireField<T>::decode(in, message); }
+};
+
+
+// Appends fields in their wire form, used for the files the client keeps
+class WireWriter
+{
+public:
+    explicit WireWriter(std::vector<uint8_t>& out) : _out(out) {}
+
+    template <typename T>
+    void put(const T& value)
+    {
+        const size_t at = _out.size();
+        _out.resize(at + WireField<T>::size);
+        WireField<T>::encode(value, _out.data() + at);
+    }
+    void bytes(const void* data, const size_t size)
+    {
+        const uint8_t* begin = static_cast<const uint8_t*>(data);
+        _out.insert(_out.end(), begin, begin + size);
+    }
+
+private:
+    std::vector<uint8_t>& _out;
+};
+
+// Reads fields back, every read checks the bytes that are left
+class WireReader
+{
+public:
+    WireReader(const uint8_t* data, const size_t size) : _position(data), _end(data + size) {}
+
+    template <typename T>
+    bool get(T& value)
+    {
+        if (left() < WireField<T>::size)
+            return false;
+        WireField<T>::decode(_position, value);
+        _position += WireField<T>::size;
+        return true;
+    }
+    const uint8_t* bytes(const size_t size)
+    {
+        if (left() < size)
+            return nullptr;
+        const uint8_t* start = _position;
+        _position += size;
+        return start;
+    }
+    size_t left() const { return static_cast<size_t>(_end - _position); }
+
+private:
+    const uint8_t* _position;
+    const uint8_t* _end;
+};
+
+
+typedef decltype(REQRegistration::payload) REQRegistrationPayload;
+typedef decltype(RESPublicKey::payload)    RESPublicKeyPayload;
+typedef REQSendMessage::SPayloadHeader     REQSendMessagePayloadHeader;
+typedef RESMessageSend::SPayload           RESMessageSendPayload;
+
+template <> struct WireLayout<REQHeader>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQHeader::clientId, &REQHeader::version, &REQHeader::code, &REQHeader::payloadSize); }
+};
+template <> struct WireLayout<RESHeader>
+{
+    static constexpr auto fields() { return std::make_tuple(&RESHeader::version, &RESHeader::code, &RESHeader::payloadSize); }
+};
+template <> struct WireLayout<REQRegistrationPayload>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQRegistrationPayload::clientName, &REQRegistrationPayload::clientPublicKey); }
+};
+template <> struct WireLayout<REQRegistration>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQRegistration::header, &REQRegistration::payload); }
+};
+template <> struct WireLayout<RESRegistration>
+{
+    static constexpr auto fields() { return std::make_tuple(&RESRegistration::header, &RESRegistration::payload); }
+};
+template <> struct WireLayout<REQUsersList>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQUsersList::header); }
+};
+template <> struct WireLayout<REQUsersListConditional>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQUsersListConditional::header, &REQUsersListConditional::payload); }
+};
+template <> struct WireLayout<REQPublicKey>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQPublicKey::header, &REQPublicKey::payload); }
+};
+template <> struct WireLayout<RESPublicKeyPayload>
+{
+    static constexpr auto fields() { return std::make_tuple(&RESPublicKeyPayload::clientId, &RESPublicKeyPayload::clientPublicKey); }
+};
+template <> struct WireLayout<RESPublicKey>
+{
+    static constexpr auto fields() { return std::make_tuple(&RESPublicKey::header, &RESPublicKey::payload); }
+};
+template <> struct WireLayout<REQSendMessagePayloadHeader>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQSendMessagePayloadHeader::clientId, &REQSendMessagePayloadHeader::messageType, &REQSendMessagePayloadHeader::contentSize); }
+};
+template <> struct WireLayout<REQSendMessage>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQSendMessage::header, &REQSendMessage::payloadHeader); }
+};
+template <> struct WireLayout<RESMessageSendPayload>
+{
+    static constexpr auto fields() { return std::make_tuple(&RESMessageSendPayload::clientId, &RESMessageSendPayload::messageId); }
+};
+template <> struct WireLayout<RESMessageSend>
+{
+    static constexpr auto fields() { return std::make_tuple(&RESMessageSend::header, &RESMessageSend::payload); }
+};
+template <> struct WireLayout<REQMessages>
+{
+    static constexpr auto fields() { return std::make_tuple(&REQMessages::header); }
+};
+template <> struct WireLayout<PendingMessage>
+{
+    static constexpr auto fields() { return std::make_tuple(&PendingMessage::clientId, &PendingMessage::messageId, &PendingMessage::messageType, &PendingMessage::messageSize); }
+};
+template <> struct WireLayout<FilePartHeader>
+{
+    static constexpr auto fields() { return std::make_tuple(&FilePartHeader::transferId, &FilePartHeader::partIndex, &FilePartHeader::partCount, &FilePartHeader::fileSize); }
+};
+template <> struct WireLayout<AEADHeader>
+{
+    static constexpr auto fields() { return std::make_tuple(&AEADHeader::version, &AEADHeader::chunkShift, &AEADHeader::nonce, &AEADHeader::plainSize); }
+};
+
+// Sizes fixed by the protocol specification
+static_assert(WireCodec::size<REQHeader>() == CLIENT_ID_SIZE + 7, "request header is 23 bytes");
+static_assert(WireCodec::size<RESHeader>() == 7, "response header is 7 bytes");
+static_assert(WireCodec::size<REQRegistration>() == 23 + CLIENT_NAME_SIZE + PUBLIC_KEY_SIZE, "registration request");
+static_assert(WireCodec::size<RESRegistration>() == 7 + CLIENT_ID_SIZE, "registration response");
+static_assert(WireCodec::size<REQUsersList>() == 23, "users list request");
+static_assert(WireCodec::size<REQUsersListConditional>() == 23 + ROSTER_ETAG_SIZE, "conditional users list request");
+static_assert(WireCodec::size<REQPublicKey>() == 23 + CLIENT_ID_SIZE, "public key request");
+static_assert(WireCodec::size<RESPublicKey>() == 7 + CLIENT_ID_SIZE + PUBLIC_KEY_SIZE, "public key response");
+static_assert(WireCodec::size<REQSendMessage>() == 23 + CLIENT_ID_SIZE + 5, "send message request header");
+static_assert(WireCodec::size<RESMessageSend>() == 7 + CLIENT_ID_SIZE + 4, "message sent response");
+static_assert(WireCodec::size<REQMessages>() == 23, "pending messages request");
+static_assert(WireCodec::size<PendingMessage>() == CLIENT_ID_SIZE + 9, "pending message header");
+static_assert(WireCodec::size<FilePartHeader>() == 20, "file part header");
+static_assert(WireCodec::size<AEADHeader>() == 18, "AEAD message header");
+
+// #pragma pack keeps the structs identical to the wire, this is what makes the memcpy path valid
+static_assert(sizeof(RESHeader) == WireCodec::size<RESHeader>(), "RESHeader is not packed");
+static_assert(sizeof(REQHeader) == WireCodec::size<REQHeader>(), "REQHeader is not packed");
+static_assert(sizeof(PendingMessage) == WireCodec::size<PendingMessage>(), "PendingMessage is not packed");
@@ -7,6 +7,8 @@
 
 #define SERVER_INFO "server.info"
 #define CLIENT_INFO "me.info"
+#define PEER_DIRECTORY "peers.db"
+#define MESSAGE_LOG_FOLDER "history"
 
 typedef uint8_t  version_t;
 typedef uint16_t code_t;
@@ -21,7 +23,14 @@ const size_t    CLIENT_NAME_SIZE = 255;
 const size_t    PUBLIC_KEY_SIZE = 160;  
 const size_t    SYMMETRIC_KEY_SIZE = 16;  
 const size_t    REQUEST_OPTIONS = 5;
-const size_t    RESPONSE_OPTIONS = 6;
+const size_t    RESPONSE_OPTIONS = 7;
+const size_t    ROSTER_ETAG_SIZE = 16;  // truncated SHA-256 of a users list payload
+const uint64_t  FILE_PART_SIZE = 64 * 1024 * 1024;  // files larger than this are sent as several MSG_SEND_FILE_PART messages
+
+// versions of the encrypted message formats, a symmetric key request carries the newest one the requester reads
+const uint8_t   MESSAGE_VERSION_CBC = 1;    // MSG_SEND_TEXT, MSG_SEND_FILE, MSG_SEND_FILE_PART: AES-CBC, PKCS#7 padding
+const uint8_t   MESSAGE_VERSION_AEAD = 2;   // MSG_SEND_TEXT_AEAD, MSG_SEND_FILE_AEAD: chunked AES-GCM
+const uint8_t   MESSAGE_VERSION = MESSAGE_VERSION_AEAD;
 
 //better understaing when using them in functions instead of constans
 enum REQCode
@@ -40,6 +49,7 @@ enum RSPCode
     RESPONSE_PUBLIC_KEY = 2102,
     RESPONSE_MSG_SENT_TO_SERVER = 2103,
     RESPONSE_PULL_PENDING_MSGS = 2104,
+    RESPONSE_USERS_LIST_NOT_MODIFIED = 2105,   // answer to a conditional users list request, no payload
     RESPONSE_GENERAL_ERROR = 9000   
 };
 
@@ -48,7 +58,10 @@ enum MSGType
     MSG_SYMMETRIC_KEY_REQUEST = 1,  
     MSG_SYMMETRIC_KEY_SEND = 2,  
     MSG_SEND_TEXT = 3,  
-    MSG_SEND_FILE = 4   
+    MSG_SEND_FILE = 4,
+    MSG_SEND_FILE_PART = 5, // one part of a large file, content is FilePartHeader + ciphertext of the part
+    MSG_SEND_TEXT_AEAD = 6, // content is AEADHeader + the sealed chunks, only sent to peers that announced MESSAGE_VERSION_AEAD
+    MSG_SEND_FILE_AEAD = 7
 };
 
 
@@ -75,6 +88,23 @@ struct ClientID
     {
         return !(*this == otherID);
     }
+
+    bool operator<(const ClientID& otherID) const
+    {
+        return memcmp(uuid, otherID.uuid, CLIENT_ID_SIZE) < 0;
+    }
+};
+
+//ids are random uuids from the server, folding the two 64 bit halves is enough for unordered containers
+struct ClientIDHash
+{
+    size_t operator()(const ClientID& id) const
+    {
+        uint64_t low, high;
+        memcpy(&low, id.uuid, sizeof(low));
+        memcpy(&high, id.uuid + sizeof(low), sizeof(high));
+        return static_cast<size_t>(low ^ (high * 0x9E3779B97F4A7C15ULL));
+    }
 };
 
 struct ClientName
@@ -159,6 +189,25 @@ struct REQUsersList
     }
 };
 
+//identifies a users list payload, sent back to the server so an unchanged list is not transferred again
+struct RosterETag
+{
+    uint8_t tag[ROSTER_ETAG_SIZE] = { 0 };
+
+    bool operator==(const RosterETag& other) const { return memcmp(tag, other.tag, ROSTER_ETAG_SIZE) == 0; }
+    bool operator!=(const RosterETag& other) const { return !(*this == other); }
+};
+
+struct REQUsersListConditional
+{
+    REQHeader  header;
+    RosterETag payload;
+    REQUsersListConditional(const ClientID& id)
+        : header(id, REQUEST_USERS_LIST)
+    {
+    }
+};
+
 struct RESUsersList
 {
     RESHeader header;
@@ -252,4 +301,38 @@ struct PendingMessage
     }
 };
 
+//sent in the clear in front of the ciphertext of every file part, tells the receiver where the part goes
+struct FilePartHeader
+{
+    uint32_t transferId;
+    uint32_t partIndex;
+    uint32_t partCount;
+    uint64_t fileSize;
+
+    FilePartHeader()
+        : transferId(0)
+        , partIndex(0)
+        , partCount(0)
+        , fileSize(0)
+    {
+    }
+};
+
+//sent in the clear in front of the chunks of an AEAD message, every chunk authenticates it
+struct AEADHeader
+{
+    uint8_t  version;       // MESSAGE_VERSION_AEAD
+    uint8_t  chunkShift;    // every chunk but the last holds 1 << chunkShift bytes of plaintext
+    uint64_t nonce;         // random, with the chunk number it makes the GCM IV of the chunk
+    uint64_t plainSize;
+
+    AEADHeader()
+        : version(MESSAGE_VERSION_AEAD)
+        , chunkShift(0)
+        , nonce(0)
+        , plainSize(0)
+    {
+    }
+};
+
 #pragma pack(pop)
@@ -168,9 +168,17 @@ class Database:
         )
         return results[0][0] if results else None
 
-    def get_pending_messages(self, client_id):
-        # Retrieve all pending messages for the specified client.
+    def get_pending_message_sizes(self, client_id):
+        # Retrieve the ID and content size of every pending message for the specified client, oldest first.
         return self.execute(
-            f"SELECT ID, source_client, Type, Content FROM {Database.MESSAGES} WHERE target_client = :client_id",
+            f"SELECT ID, length(Content) FROM {Database.MESSAGES} WHERE target_client = :client_id ORDER BY ID",
             {"client_id": client_id}
         )
+
+    def get_message(self, msg_id):
+        # Retrieve one message with its content, None if it does not exist.
+        results = self.execute(
+            f"SELECT ID, source_client, Type, Content FROM {Database.MESSAGES} WHERE ID = :msg_id",
+            {"msg_id": msg_id}
+        )
+        return results[0] if results else None
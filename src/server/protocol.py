@@ -10,6 +10,10 @@ MSG_TYPE_MAX = 0xFF
 MSG_ID_MAX = 0xFFFFFFFF
 NAME_SIZE = 255
 PUBLIC_KEY_SIZE = 160
+RECEIVE_CHUNK_SIZE = 1024 * 1024   # largest single recv while reading message content
+MAX_PAYLOAD_SIZE = 0xFFFFFFFF      # payloadSize of a response is 4 bytes
+PENDING_MESSAGE_HEADER_SIZE = CLIENT_ID_SIZE + 9   # client ID, message ID (L), type (B), size (L)
+ROSTER_ETAG_SIZE = 16               # users list request payload: truncated SHA-256 of the list the client has
 
 # Request Codes
 class REQCode(Enum):
@@ -26,6 +30,7 @@ class RSPCode(Enum):
     RESPONSE_PUBLIC_KEY = 2102
     RESPONSE_MSG_SENT_TO_SERVER = 2103
     RESPONSE_PULL_PENDING_MSGS = 2104
+    RESPONSE_USERS_LIST_NOT_MODIFIED = 2105   # the users list equals the one the client sent the tag of (payloadSize = 0)
     RESPONSE_GENERAL_ERROR = 9000       # General error response (payload invalid; payloadSize = 0)
 
 class REQHeader:
@@ -125,14 +130,16 @@ class REQSendMessage:
             self.content = struct.unpack(f"<{bytesReadFromData}s", remainingData[offset:offset + bytesReadFromData])[0]
             totalBytesRead = bytesReadFromData
 
-            # Continue reading from the socket if content is incomplete
+            # Continue reading from the socket if content is incomplete, chunks are joined once at the end
+            chunks = [self.content]
             while totalBytesRead < self.contentSize:
-                chunkSize = self.contentSize - totalBytesRead
+                chunkSize = min(self.contentSize - totalBytesRead, RECEIVE_CHUNK_SIZE)
                 chunk = conn.recv(chunkSize)
                 if not chunk:
                     raise ValueError("Socket closed prematurely while reading message content.")
-                self.content += struct.unpack(f"<{len(chunk)}s", chunk)[0]
+                chunks.append(chunk)
                 totalBytesRead += len(chunk)
+            self.content = b"".join(chunks)
 
             return True
         except:
@@ -212,9 +219,14 @@ class PendingMessage:
     def to_bytes(self):
         """Little Endian: convert the Pending Message into binary data."""
         try:
-            data = struct.pack(f"<{CLIENT_ID_SIZE}s", self.messageClientID)
-            data += struct.pack("<LBL", self.messageID, self.messageType, self.messageSize)
+            data = self.header_to_bytes()
             data += struct.pack(f"<{self.messageSize}s", self.content)
             return data
         except:
             return b""
+
+    def header_to_bytes(self):
+        """Little Endian: convert everything of the Pending Message but the content into binary data."""
+        data = struct.pack(f"<{CLIENT_ID_SIZE}s", self.messageClientID)
+        data += struct.pack("<LBL", self.messageID, self.messageType, self.messageSize)
+        return data
@@ -3,6 +3,7 @@ import re
 import logging
 import socket
 import uuid
+import hashlib
 import database
 import selectors
 import protocol
@@ -22,6 +23,7 @@ class Server:
     PACKET_SIZE = 1024       
     MAX_USERS = 5           
     BLOCK_USAGE = False      
+    SEND_TIMEOUT = 10        # seconds a client may take to read a response
 
     def __init__(self, port):
         """Constructor of the server - initializes message formats and other requirements."""
@@ -35,36 +37,55 @@ class Server:
         self.sel = selectors.DefaultSelector()
         self.requestHandle = request_handlers
         self.database = database.Database(Server.DATABASE)
+        self.requests = {}   # connection -> bytes of its request received so far
         self.port = port
 
     def pack_pending(msg):
         """
-        this is a helper function to pack a pending message from a database record.
+        this is a helper function to pack the header of a pending message from a database record,
+        the content is sent as it is after it.
         """
         pending = protocol.PendingMessage()
         pending.messageID = int(msg[0])
         pending.messageClientID = msg[1]
         pending.messageType = int(msg[2])
-        pending.content = msg[3]
         pending.messageSize = len(msg[3])
-        return pending.to_bytes()
+        return pending.header_to_bytes()
 
     def accept_connection(self, sock, mask):
         """Accept a new connection and register it for reading."""
         conn, address = sock.accept()
         conn.setblocking(Server.BLOCK_USAGE)
+        self.logger.info("A client has connected.")
         self.sel.register(conn, selectors.EVENT_READ, self.read_requests)
 
     def read_requests(self, conn, mask):
-        """Read data from a client, parse the request, and pass it to the proper handler."""
-        self.logger.info("A client has connected.")
-        data = conn.recv(Server.PACKET_SIZE)
+        """
+        Read what a client has sent so far, once the whole request is in parse it and pass it to the proper handler.
+        Large file parts arrive over many events, the selector keeps serving the other clients in between.
+        """
+        try:
+            data = conn.recv(protocol.RECEIVE_CHUNK_SIZE)
+        except BlockingIOError:
+            return
+        except socket.error as se:
+            self.logger.error(f"Socket Error while reading a request: {se}")
+            data = b""
         if not data:
-            self.sel.unregister(conn)
-            conn.close()
+            self.close_connection(conn)
             return
 
+        buffer = self.requests.setdefault(conn, bytearray())
+        buffer += data
         reqHeader = protocol.REQHeader()
+        if len(buffer) < reqHeader.SIZE:
+            return
+        if reqHeader.from_bytes(buffer) and len(buffer) < reqHeader.SIZE + reqHeader.payloadSize:
+            return
+        data = bytes(buffer)
+
+        # the response is written in one go, a client that stops reading it is dropped
+        conn.settimeout(Server.SEND_TIMEOUT)
         if not reqHeader.from_bytes(data):
             self.logger.error("Failed to parse request header!")
             resHeader = protocol.RESHeader(protocol.RSPCode.RESPONSE_GENERAL_ERROR.value)
@@ -78,24 +99,35 @@ class Server:
                 resHeader = protocol.RESHeader(protocol.RSPCode.RESPONSE_GENERAL_ERROR.value)
                 self.send_response(conn, resHeader.to_bytes())
 
+        self.close_connection(conn)
+
+    def close_connection(self, conn):
+        """Stop watching a connection, forget its partly read request and close it."""
+        self.requests.pop(conn, None)
         self.sel.unregister(conn)
         conn.close()
 
     def send_response(self, conn, data):
         """Send a response back to the client in chunks."""
-        size = len(data)
-        for offset in range(0, size, Server.PACKET_SIZE):
-            chunk = data[offset:offset + Server.PACKET_SIZE]
-            if len(chunk) < Server.PACKET_SIZE:
-                chunk += bytearray(Server.PACKET_SIZE - len(chunk))
-            try:
-                sent = conn.send(chunk)
-                if sent != len(chunk):
-                    self.logger.error(f"Failed to send entire chunk. Sent {sent}/{len(chunk)} bytes.")
-                    return False
-            except Exception as e:
-                self.logger.error(f"Failed to send response: {e}")
-                return False
+        return self.send_pieces(conn, [data])
+
+    def send_pieces(self, conn, pieces):
+        """
+        Send a response made of several pieces without joining them, padded up to PACKET_SIZE at the end.
+        pieces may be a generator, so large contents are read only while they are sent.
+        """
+        size = 0
+        try:
+            for piece in pieces:
+                view = memoryview(piece)
+                for offset in range(0, len(view), protocol.RECEIVE_CHUNK_SIZE):
+                    conn.sendall(view[offset:offset + protocol.RECEIVE_CHUNK_SIZE])
+                size += len(view)
+            if size % Server.PACKET_SIZE != 0:
+                conn.sendall(bytes(Server.PACKET_SIZE - size % Server.PACKET_SIZE))
+        except Exception as e:
+            self.logger.error(f"Failed to send response: {e}")
+            return False
         self.logger.info("Response sent successfully.")
         return True
 
@@ -187,6 +219,15 @@ class Server:
                 payload_parts.append(name_bytes)
 
         payload = b"".join(payload_parts)
+
+        # a client that sent the tag of the list it already has only gets told that nothing changed
+        etag = hashlib.sha256(payload).digest()[:protocol.ROSTER_ETAG_SIZE]
+        if request.payloadSize == protocol.ROSTER_ETAG_SIZE and \
+                data[request.SIZE:request.SIZE + protocol.ROSTER_ETAG_SIZE] == etag:
+            response = protocol.RESHeader(protocol.RSPCode.RESPONSE_USERS_LIST_NOT_MODIFIED.value)
+            self.logger.info(f"Users list is not modified for clientID ({request.clientID}).")
+            return self.send_response(conn, response.to_bytes())
+
         response.payloadSize = len(payload)
         self.logger.info(f"Users list has been created successfully for clientID ({request.clientID}).")
         return self.send_response(conn, response.to_bytes() + payload)
@@ -251,14 +292,32 @@ class Server:
             self.logger.error(f"Pending messages request: Database error - {e}")
             return False
 
-        messages = self.database.get_pending_messages(request.clientID)
-        ids = [int(msg[0]) for msg in messages]
-        
-        payload = b"".join(Server.pack_pending(msg) for msg in messages)
-        response.payloadSize = len(payload)
+        # as many of the oldest messages as fit in one payload, the rest waits for the next pull
+        sizes = self.database.get_pending_message_sizes(request.clientID) or []
+        ids = []
+        for msg_id, size in sizes:
+            size = protocol.PENDING_MESSAGE_HEADER_SIZE + int(size or 0)
+            if response.payloadSize + size > protocol.MAX_PAYLOAD_SIZE:
+                break
+            ids.append(int(msg_id))
+            response.payloadSize += size
+        if sizes and not ids:
+            self.logger.error(f"Pending messages request: message {sizes[0][0]} is too large to be sent.")
+            return False
+        if len(ids) < len(sizes):
+            self.logger.info(f"Pending messages request: {len(sizes) - len(ids)} messages are left for the next pull.")
         self.logger.info(f"Pending messages for clientID ({request.clientID}) successfully extracted.")
-        
-        if self.send_response(conn, response.to_bytes() + payload):
+
+        def pieces():
+            yield response.to_bytes()
+            for msg_id in ids:
+                msg = self.database.get_message(msg_id)
+                if msg is None:
+                    raise ValueError(f"message {msg_id} disappeared while it was sent")
+                yield Server.pack_pending(msg)
+                yield msg[3]
+
+        if self.send_pieces(conn, pieces()):
             for msg_id in ids:
                 self.database.remove_message(msg_id)
             return True
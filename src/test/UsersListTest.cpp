@@ -0,0 +1,159 @@
+/**
+ * Users list refresh against users_list_standin.py: the first list is merged into an empty roster,
+ * the second one is fetched conditionally with the tag of the first and merged over it, a third
+ * conditional request carries the tag of the second and must come back as "not modified".
+ *
+ * users_list_test <address> <port> [--padded-framing] [--keep-alive]
+ *   (started by users_list_standin.py, which also builds the lists and checks the connections of --keep-alive)
+ * exits with 0 if every check passed.
+ */
+#include "ClientRoster.h"
+#include "Communication.h"
+#include "SocketHandler.h"
+#include "FileOperations.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check(const bool condition, const std::string& what)
+    {
+        if (!condition)
+        {
+            std::printf("FAIL %s\n", what.c_str());
+            ++failures;
+        }
+    }
+
+    // same ids as users_list_standin.py: every byte of the id is the user's number
+    ClientID userId(const uint8_t number)
+    {
+        ClientID id;
+        memset(id.uuid, number, CLIENT_ID_SIZE);
+        return id;
+    }
+
+    PublicKey publicKeyOf(const uint8_t seed)
+    {
+        PublicKey key;
+        memset(key.publicKey, seed, PUBLIC_KEY_SIZE);
+        return key;
+    }
+
+    SymmetricKey symmetricKeyOf(const uint8_t seed)
+    {
+        SymmetricKey key;
+        memset(key.symmetricKey, seed, SYMMETRIC_KEY_SIZE);
+        return key;
+    }
+
+    bool sameChanges(const std::vector<ClientRoster::Change>& changes, const std::string& username, const uint8_t number)
+    {
+        return changes.size() == 1 && changes[0].username == username && changes[0].id == userId(number);
+    }
+
+    // one users list refresh the way MainLogic::requestClientsList does it
+    bool refresh(Communication& communication, ClientRoster& roster, const RosterETag* ifNoneMatch, RosterETag& etag,
+        bool& notModified, ClientRoster::MergeResult& changes)
+    {
+        ClientRoster fresh;
+        std::string error;
+        if (!communication.requestAndParseClientsList(ClientID(), ifNoneMatch, fresh, etag, notModified, error))
+        {
+            std::printf("FAIL users list request: %s\n", error.c_str());
+            ++failures;
+            return false;
+        }
+        if (!notModified)
+            changes = roster.merge(std::move(fresh));
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::printf("usage: users_list_test <address> <port> [--padded-framing] [--keep-alive]\n");
+        return 2;
+    }
+    SocketHandler socketHandler;
+    if (!socketHandler.setSocketInfo(argv[2], argv[1]))
+    {
+        std::printf("FAIL invalid server address %s:%s\n", argv[1], argv[2]);
+        return 1;
+    }
+    for (int i = 3; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--padded-framing")
+            socketHandler.setFraming(SocketHandler::Framing::Padded);
+        else if (std::string(argv[i]) == "--keep-alive")
+            socketHandler.setKeepAlive(true);
+    }
+    Communication communication(&socketHandler, std::make_shared<FileOperations>(), nullptr, nullptr);
+    ClientRoster roster;
+    ClientRoster::MergeResult changes;
+    bool notModified = false;
+
+    // alice, bob and dave
+    RosterETag firstTag;
+    if (!refresh(communication, roster, nullptr, firstTag, notModified, changes))
+        return 1;
+    check(!notModified, "an unconditional request was answered with not modified");
+    check(changes.initial && changes.added.size() == 3 && changes.removed.empty(), "first list is not an initial merge of 3 users");
+
+    const ClientRoster::Handle alice = roster.handle("alice");
+    const ClientRoster::Handle bob = roster.handle("bob");
+    check(alice != ClientRoster::INVALID_HANDLE && bob != ClientRoster::INVALID_HANDLE, "alice or bob missing from the first list");
+    if (failures > 0)
+        return 1;
+    roster.setPublicKey(alice, publicKeyOf(0xA1));
+    roster.setSymmetricKey(alice, symmetricKeyOf(0xA2));
+    roster.setPublicKey(bob, publicKeyOf(0xB1));
+
+    // bob left, carol joined
+    RosterETag secondTag;
+    if (!refresh(communication, roster, &firstTag, secondTag, notModified, changes))
+        return 1;
+    check(!notModified, "a changed list was answered with not modified");
+    check(secondTag != firstTag, "the tag did not change with the list");
+    check(!changes.initial, "second list was merged as an initial list");
+    check(sameChanges(changes.added, "carol", 3), "carol is not reported as the only added user");
+    check(sameChanges(changes.removed, "bob", 2), "bob is not reported as the only removed user");
+    check(roster.size() == 3 && roster.handle(userId(2)) == ClientRoster::INVALID_HANDLE, "bob is still in the roster");
+
+    const ClientRoster::Handle keptAlice = roster.handle(userId(1));
+    check(keptAlice != ClientRoster::INVALID_HANDLE, "alice is missing after the merge");
+    if (keptAlice != ClientRoster::INVALID_HANDLE)
+    {
+        const PublicKey* publicKey = roster.publicKey(keptAlice);
+        const SymmetricKey* symmetricKey = roster.symmetricKey(keptAlice);
+        const PublicKey expectedPublic = publicKeyOf(0xA1);
+        const SymmetricKey expectedSymmetric = symmetricKeyOf(0xA2);
+        check(publicKey != nullptr && memcmp(publicKey->publicKey, expectedPublic.publicKey, PUBLIC_KEY_SIZE) == 0,
+            "alice lost the public key in the merge");
+        check(symmetricKey != nullptr && memcmp(symmetricKey->symmetricKey, expectedSymmetric.symmetricKey, SYMMETRIC_KEY_SIZE) == 0,
+            "alice lost the symmetric key in the merge");
+    }
+    const ClientRoster::Handle carol = roster.handle("carol");
+    check(carol != ClientRoster::INVALID_HANDLE && roster.publicKey(carol) == nullptr && roster.symmetricKey(carol) == nullptr,
+        "carol joined with keys");
+    const ClientRoster::Handle dave = roster.handle("dave");
+    check(dave != ClientRoster::INVALID_HANDLE && roster.publicKey(dave) == nullptr, "dave got a key in the merge");
+
+    // the list did not change since
+    RosterETag thirdTag;
+    changes = ClientRoster::MergeResult();
+    if (!refresh(communication, roster, &secondTag, thirdTag, notModified, changes))
+        return 1;
+    check(notModified, "an unchanged list was sent again");
+    check(changes.added.empty() && changes.removed.empty() && roster.size() == 3, "not modified changed the roster");
+
+    std::printf("%s users list test\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
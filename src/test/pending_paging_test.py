@@ -0,0 +1,148 @@
+"""
+Pending messages that add up to more than the 4 GB a response payload can hold.
+
+The real server.py request handling runs on top of a scripted database holding MESSAGES messages of
+MESSAGE_SIZE bytes each for one client, over 5 GB together. The first pull must carry as many of the
+oldest messages as fit under the 4 byte payloadSize and leave the rest, the second pull the rest.
+Only the messages that were sent are deleted.
+
+python pending_paging_test.py
+exits with 0 if every check passed. Needs a little over 1 GB of memory, the messages share one buffer.
+"""
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "server"))
+import protocol
+import server
+
+SELF_ID = bytes([7]) * protocol.CLIENT_ID_SIZE
+SENDER_ID = bytes([9]) * protocol.CLIENT_ID_SIZE
+MESSAGE_SIZE = 1024 * 1024 * 1024
+MESSAGES = 5
+MSG_SEND_FILE_PART = 7
+
+
+class ScriptedDatabase:
+    """Pending messages for SELF_ID, every content is the same buffer."""
+    def __init__(self):
+        self.content = bytes(MESSAGE_SIZE)
+        self.messages = {msg_id: (msg_id, SENDER_ID, MSG_SEND_FILE_PART, self.content)
+                         for msg_id in range(1, MESSAGES + 1)}
+        self.removed = []
+
+    def initialize(self):
+        return True
+
+    def client_id_exists(self, client_id):
+        return client_id == SELF_ID
+
+    def get_pending_message_sizes(self, client_id):
+        return [(msg_id, len(msg[3])) for msg_id, msg in sorted(self.messages.items())]
+
+    def get_message(self, msg_id):
+        return self.messages.get(msg_id)
+
+    def remove_message(self, msg_id):
+        self.removed.append(msg_id)
+        del self.messages[msg_id]
+        return True
+
+
+def free_port():
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
+        sock.bind(("127.0.0.1", 0))
+        return sock.getsockname()[1]
+
+
+def start_server(port, database):
+    standin = server.Server(port)
+    standin.database = database
+    threading.Thread(target=standin.run_server, daemon=True).start()
+    for _ in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", port)).close()
+            return standin
+        except OSError:
+            time.sleep(0.1)
+    raise RuntimeError("stand-in server did not start")
+
+
+def read_exact(conn, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            raise ValueError(f"connection closed, {size - len(data)} bytes missing")
+        data += chunk
+    return bytes(data)
+
+
+def skip(conn, size, buffer):
+    view = memoryview(buffer)
+    while size > 0:
+        received = conn.recv_into(view[:min(size, len(buffer))])
+        if received == 0:
+            raise ValueError(f"connection closed, {size} bytes missing")
+        size -= received
+
+
+def pull(port):
+    """One pending messages request, returns the message IDs of the response and its payload size."""
+    request = SELF_ID + struct.pack("<BHL", protocol.SERVER_VERSION,
+                                    protocol.REQCode.REQUEST_PULL_PENDING_MSGS.value, 0)
+    buffer = bytearray(protocol.RECEIVE_CHUNK_SIZE)
+    with socket.create_connection(("127.0.0.1", port)) as conn:
+        conn.sendall(request)
+        version, code, payload_size = struct.unpack("<BHL", read_exact(conn, protocol.HEADER_SIZE))
+        if code != protocol.RSPCode.RESPONSE_PULL_PENDING_MSGS.value:
+            raise ValueError(f"expected code {protocol.RSPCode.RESPONSE_PULL_PENDING_MSGS.value}, got {code}")
+        ids = []
+        left = payload_size
+        while left > 0:
+            header = read_exact(conn, protocol.PENDING_MESSAGE_HEADER_SIZE)
+            msg_id, msg_type, size = struct.unpack("<LBL", header[protocol.CLIENT_ID_SIZE:])
+            skip(conn, size, buffer)
+            ids.append(msg_id)
+            left -= protocol.PENDING_MESSAGE_HEADER_SIZE + size
+        if left != 0:
+            raise ValueError("payloadSize does not end on a message")
+        # the padding, the server closes once it has deleted what it sent
+        while conn.recv_into(buffer) > 0:
+            pass
+    return ids, payload_size
+
+
+def main():
+    database = ScriptedDatabase()
+    port = free_port()
+    start_server(port, database)
+
+    fitting = protocol.MAX_PAYLOAD_SIZE // (protocol.PENDING_MESSAGE_HEADER_SIZE + MESSAGE_SIZE)
+    failures = []
+    ids, payload_size = pull(port)
+    if ids != list(range(1, fitting + 1)):
+        failures.append(f"first pull carried messages {ids}, expected 1 to {fitting}")
+    if payload_size > protocol.MAX_PAYLOAD_SIZE:
+        failures.append(f"first pull has payload size {payload_size}")
+    if database.removed != ids:
+        failures.append(f"first pull deleted messages {database.removed}, sent {ids}")
+
+    ids, payload_size = pull(port)
+    if ids != list(range(fitting + 1, MESSAGES + 1)):
+        failures.append(f"second pull carried messages {ids}, expected {fitting + 1} to {MESSAGES}")
+    if database.messages:
+        failures.append(f"messages {sorted(database.messages)} are still pending")
+
+    for failure in failures:
+        print(f"FAIL {failure}")
+    print("PASS" if not failures else "FAIL")
+    return 0 if not failures else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
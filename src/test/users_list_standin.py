@@ -0,0 +1,169 @@
+"""
+Stand-in server for the users list refresh of the client.
+
+The real server.py request handling runs on top of a scripted database: the first users list request is
+answered with FIRST_LIST, every later one with SECOND_LIST. The stand-in runs the users_list_test program
+against it and then checks the wire format of the "not modified" answer itself.
+The program runs a second time with --padded-framing --keep-alive against PacketServer, which only takes
+requests filled up to whole packets and keeps the connection open, all three requests must share one connection.
+
+python users_list_standin.py <path to users_list_test>
+exits with 0 if both the client test and the wire check pass.
+"""
+import hashlib
+import os
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "server"))
+import protocol
+import server
+
+SELF_ID = bytes.fromhex("00" * protocol.CLIENT_ID_SIZE)
+
+
+def user(number, name):
+    return bytes([number]) * protocol.CLIENT_ID_SIZE, name.encode("utf-8")
+
+
+FIRST_LIST = [user(1, "alice"), user(2, "bob"), user(4, "dave")]
+SECOND_LIST = [user(1, "alice"), user(3, "carol"), user(4, "dave")]
+
+
+class ScriptedDatabase:
+    """Answers the queries of the users list handler from the two lists above."""
+    def __init__(self):
+        self.requests = 0
+
+    def initialize(self):
+        return True
+
+    def client_id_exists(self, client_id):
+        return True
+
+    def get_clients_list(self):
+        self.requests += 1
+        return FIRST_LIST if self.requests == 1 else SECOND_LIST
+
+
+class PacketServer(server.Server):
+    """server.py reading requests in whole PACKET_SIZE packets and keeping the connection open after a response."""
+    def __init__(self, port):
+        super().__init__(port)
+        self.connections = 0
+
+    def accept_connection(self, sock, mask):
+        self.connections += 1
+        super().accept_connection(sock, mask)
+
+    def read_requests(self, conn, mask):
+        try:
+            data = conn.recv(protocol.RECEIVE_CHUNK_SIZE)
+        except BlockingIOError:
+            return
+        except socket.error:
+            data = b""
+        if not data:
+            self.close_connection(conn)
+            return
+
+        buffer = self.requests.setdefault(conn, bytearray())
+        buffer += data
+        reqHeader = protocol.REQHeader()
+        while len(buffer) >= reqHeader.SIZE and reqHeader.from_bytes(buffer):
+            size = reqHeader.SIZE + reqHeader.payloadSize
+            size += -size % server.Server.PACKET_SIZE
+            if len(buffer) < size:
+                return
+            request = bytes(buffer[:size])
+            del buffer[:size]
+            conn.settimeout(server.Server.SEND_TIMEOUT)
+            if reqHeader.code not in self.requestHandle or not self.requestHandle[reqHeader.code](self, conn, request):
+                self.send_response(conn, protocol.RESHeader(protocol.RSPCode.RESPONSE_GENERAL_ERROR.value).to_bytes())
+            conn.setblocking(server.Server.BLOCK_USAGE)
+
+
+def free_port():
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
+        sock.bind(("127.0.0.1", 0))
+        return sock.getsockname()[1]
+
+
+def start_server(port, server_class=server.Server):
+    standin = server_class(port)
+    standin.database = ScriptedDatabase()
+    threading.Thread(target=standin.run_server, daemon=True).start()
+    for _ in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", port)).close()
+            return standin
+        except OSError:
+            time.sleep(0.1)
+    raise RuntimeError("stand-in server did not start")
+
+
+def run_client(program, port, *options):
+    try:
+        return subprocess.run([program, "127.0.0.1", str(port), *options], timeout=60).returncode == 0
+    except subprocess.TimeoutExpired:
+        print(f"FAIL users_list_test {' '.join(options)} did not finish")
+        return False
+
+
+def users_list_payload(users):
+    return b"".join(client_id + name.ljust(protocol.NAME_SIZE, b"\0") for client_id, name in users)
+
+
+def check_not_modified(port):
+    """A conditional request carrying the tag of the current list gets 2105, no payload and only padding."""
+    etag = hashlib.sha256(users_list_payload(SECOND_LIST)).digest()[:protocol.ROSTER_ETAG_SIZE]
+    request = SELF_ID + struct.pack("<BHL", protocol.SERVER_VERSION, protocol.REQCode.REQUEST_USERS_LIST.value,
+                                    len(etag)) + etag
+    with socket.create_connection(("127.0.0.1", port)) as conn:
+        conn.sendall(request)
+        response = b""
+        while True:
+            data = conn.recv(protocol.RECEIVE_CHUNK_SIZE)
+            if not data:
+                break
+            response += data
+
+    version, code, payload_size = struct.unpack("<BHL", response[:protocol.HEADER_SIZE])
+    failures = []
+    if code != protocol.RSPCode.RESPONSE_USERS_LIST_NOT_MODIFIED.value:
+        failures.append(f"expected code {protocol.RSPCode.RESPONSE_USERS_LIST_NOT_MODIFIED.value}, got {code}")
+    if payload_size != 0:
+        failures.append(f"expected no payload, payload size is {payload_size}")
+    if len(response) != server.Server.PACKET_SIZE or any(response[protocol.HEADER_SIZE:]):
+        failures.append("response carries more than the header and its padding")
+    for failure in failures:
+        print(f"FAIL not modified response: {failure}")
+    return not failures
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(f"usage: {sys.argv[0]} <path to users_list_test>")
+        return 2
+    port = free_port()
+    start_server(port)
+    passed = run_client(sys.argv[1], port)
+    passed = check_not_modified(port) and passed
+
+    port = free_port()
+    standin = start_server(port, PacketServer)
+    standin.connections = 0
+    passed = run_client(sys.argv[1], port, "--padded-framing", "--keep-alive") and passed
+    if standin.connections != 1:
+        print(f"FAIL --keep-alive opened {standin.connections} connections for three requests")
+        passed = False
+    print("PASS" if passed else "FAIL")
+    return 0 if passed else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())